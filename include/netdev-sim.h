@@ -25,7 +25,8 @@
                              (!strncmp((s1), (s2), strlen((s2)))))
 
 #define MAX_CMD_LEN     2048
-#define SWNS_EXEC       "/sbin/ip netns exec swns"
+
+struct sset;
 
 /* SIM provider API. */
 void netdev_sim_register(void);
@@ -34,4 +35,6 @@ extern void netdev_sflow_reset(struct netdev *netdev);
 extern void netdev_sflow_stats_enable(struct netdev *netdev, bool enabled);
 extern void netdev_sim_l3stats_xtables_rules_create(struct netdev *netdev);
 extern void netdev_sim_l3stats_xtables_rules_delete(struct netdev *netdev);
+extern int netdev_sim_link_poll(uint64_t *seqno, struct sset *names);
+extern void netdev_sim_link_poll_wait(uint64_t seqno);
 #endif /* netdev-sim.h */
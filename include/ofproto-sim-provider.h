@@ -22,9 +22,9 @@
 
 #include "ofproto/ofproto-provider.h"
 #include "hmapx.h"
+#include "sim-asic-ovsdb.h"
 
 #define MAX_CLI                 1024
-#define OVS_VSCTL               "/opt/openvswitch/bin/ovs-vsctl"
 #define ASIC_OVSDB_PATH         "/var/run/openvswitch-sim/ovsdb.db"
 #define APPCTL                  "/opt/openvswitch/bin/ovs-appctl"
 #define OVS_SIM                 "ovs-vswitchd-sim"
@@ -32,6 +32,9 @@
 #define HOSTSFLOW_CFG_FILENAME  "/etc/hsflowd.conf"
 #define HOSTSFLOW_NFLOG_GRP     5
 
+/* Executor key that orders the iptables and host-sflow updates of sFlow. */
+#define SFLOW_EXEC_KEY          "sflow"
+
 #define MAX_MIRRORS 32
 #define MAX_MIRROR_NAME_LEN 64
 
@@ -66,6 +69,9 @@ struct mirror {
     int64_t byte_count;         /* Number of bytes sent. */
 
     char *name; /* Mirror name for logging */
+    bool synced;                /* Whether the ASIC OVS has this config. */
+    bool staged;                /* Changed in the ofproto's 'asic_txn'. */
+    bool created;               /* Whether the ASIC OVS has a row for it. */
 };
 
 struct mbridge {
@@ -91,6 +97,16 @@ struct sim_provider_group {
     uint64_t byte_count OVS_GUARDED;    /* Number of bytes received. */
 };
 
+/* VLAN configuration of a bundle's port as last written to the ASIC OVS. */
+struct ofbundle_asic_state {
+    bool synced;                /* False if the ASIC OVS may differ, e.g.
+                                 * after a failed transaction. */
+    enum port_vlan_mode vlan_mode;
+    int tag;                    /* Access or native VLAN, -1 if none. */
+    unsigned long *trunks;      /* Trunked VLANs, NULL in access mode. */
+    struct sset members;        /* Names of the member interfaces. */
+};
+
 struct ofbundle {
     struct hmap_node hmap_node; /* In struct ofproto's "bundles" hmap. */
     struct sim_provider_node *ofproto;  /* Owning ofproto. */
@@ -115,6 +131,7 @@ struct ofbundle {
 
     bool is_added_to_sim_ovs;   /* If this bundle is added to ASIC simulating
                                  * OVS. */
+    struct ofbundle_asic_state applied; /* Valid if 'is_added_to_sim_ovs'. */
 
     bool is_vlan_routing_enabled;       /* If VLAN routing is enabled on this
                                          * bundle. */
@@ -223,7 +240,7 @@ struct sim_provider_node {
     struct sset ghost_ports;    /* Ports with no datapath port. */
     struct sset port_poll_set;  /* Queued names for port_poll() reply. */
     int port_poll_errno;        /* Last errno for port_poll() reply. */
-    uint64_t change_seq;        /* Connectivity status changes. */
+    uint64_t change_seq;        /* Last netdev_sim_link_poll() seqno. */
 
     /* Work queues. */
     struct guarded_list pins;   /* Contains "struct ofputil_packet_in"s. */
@@ -235,6 +252,11 @@ struct sim_provider_node {
     bool vrf;                   /* Specifies whether specific ofproto instance
                                  * is backing up VRF and not bridge */
     struct sim_sflow_cfg sflow; /* sflow configuration */
+
+    /* ASIC OVS changes staged during the current reconfiguration, committed
+     * as one transaction by run(). */
+    struct asic_ovsdb_txn *asic_txn;
+    bool asic_txn_has_sflow;    /* 'asic_txn' changes the sFlow config. */
 };
 
 struct sim_provider_port_dump_state {
@@ -0,0 +1,106 @@
+/*
+ * (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SIM_ASIC_OVSDB_H
+#define SIM_ASIC_OVSDB_H 1
+
+#include <stdbool.h>
+#include "shash.h"
+#include "sset.h"
+
+/* Client for the OVSDB server of the "ASIC" OVS.
+ *
+ * The simulation provider used to program the ASIC OVS by forking ovs-vsctl
+ * for every change.  This module keeps a single JSON-RPC connection to the
+ * ovsdb-server-sim socket open for the lifetime of ops-switchd and writes the
+ * Bridge, Port, Interface, Mirror and sFlow rows directly.
+ *
+ * Changes are collected in a 'struct asic_ovsdb_txn' and sent to the server
+ * as one "transact" request when the transaction is committed. */
+
+#define ASIC_OVSDB_SOCKET   "unix:/var/run/openvswitch-sim/db.sock"
+#define ASIC_OVSDB_DB_NAME  "Open_vSwitch"
+
+struct asic_ovsdb_txn;
+
+/* VLAN configuration of a port in the ASIC OVS. */
+struct asic_port_cfg {
+    const char *vlan_mode;          /* "access", "trunk", ... or NULL. */
+    int tag;                        /* Access VLAN, or -1 for none. */
+    const unsigned long *trunks;    /* 4096-bit bitmap of trunked VLANs, or
+                                     * NULL for none. */
+};
+
+/* Columns of a port's VLAN configuration, for asic_ovsdb_update_port(). */
+enum asic_port_column {
+    ASIC_PORT_VLAN_MODE = 1 << 0,
+    ASIC_PORT_TAG = 1 << 1,
+    ASIC_PORT_TRUNKS = 1 << 2,
+    ASIC_PORT_ALL = ASIC_PORT_VLAN_MODE | ASIC_PORT_TAG | ASIC_PORT_TRUNKS
+};
+
+/* VLAN configuration of a port as read back from the ASIC OVSDB. */
+struct asic_port_info {
+    char *vlan_mode;                /* NULL if not set. */
+    int tag;                        /* -1 if not set. */
+    unsigned long *trunks;          /* NULL if no VLAN is listed. */
+};
+
+void asic_ovsdb_init(void);
+void asic_ovsdb_run(void);
+void asic_ovsdb_wait(void);
+
+struct asic_ovsdb_txn *asic_ovsdb_txn_create(void);
+bool asic_ovsdb_txn_is_empty(const struct asic_ovsdb_txn *);
+int asic_ovsdb_txn_commit(struct asic_ovsdb_txn *, bool wait);
+void asic_ovsdb_txn_abort(struct asic_ovsdb_txn *);
+
+bool asic_ovsdb_port_exists(const char *port);
+bool asic_ovsdb_txn_port_exists(const struct asic_ovsdb_txn *,
+                                const char *port);
+int asic_ovsdb_read_ports(struct shash *ports);
+void asic_ovsdb_port_infos_destroy(struct shash *ports);
+
+void asic_ovsdb_add_bridge(struct asic_ovsdb_txn *, const char *bridge);
+void asic_ovsdb_del_bridge(struct asic_ovsdb_txn *, const char *bridge);
+
+void asic_ovsdb_add_port(struct asic_ovsdb_txn *, const char *bridge,
+                         const char *port, const struct asic_port_cfg *);
+void asic_ovsdb_update_port(struct asic_ovsdb_txn *, const char *port,
+                            const struct asic_port_cfg *,
+                            unsigned int columns);
+void asic_ovsdb_del_port(struct asic_ovsdb_txn *, const char *port);
+void asic_ovsdb_set_port_trunks(struct asic_ovsdb_txn *, const char *port,
+                                const unsigned long *trunks);
+void asic_ovsdb_add_port_trunk(struct asic_ovsdb_txn *, const char *port,
+                               int vid);
+void asic_ovsdb_del_port_trunk(struct asic_ovsdb_txn *, const char *port,
+                               int vid);
+
+void asic_ovsdb_add_mirror(struct asic_ovsdb_txn *, const char *bridge,
+                           const char *mirror,
+                           const char **srcs, size_t n_srcs,
+                           const char **dsts, size_t n_dsts,
+                           const char *output);
+void asic_ovsdb_del_mirror(struct asic_ovsdb_txn *, const char *bridge,
+                           const char *mirror);
+
+void asic_ovsdb_set_sflow(struct asic_ovsdb_txn *, const char *bridge,
+                          const char *agent, const struct sset *targets,
+                          int header, int sampling, int polling);
+void asic_ovsdb_clear_sflow(struct asic_ovsdb_txn *, const char *bridge);
+
+#endif /* sim-asic-ovsdb.h */
@@ -0,0 +1,55 @@
+/*
+ * (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SIM_EXECUTOR_H
+#define SIM_EXECUTOR_H 1
+
+/* Executor for slow external work.
+ *
+ * Programming the kernel of the simulated switch means running tools such as
+ * iptables, ip and bridge, each of which may take a long time (iptables -w
+ * waits for the xtables lock).  Instead of blocking the switchd main loop,
+ * callers hand that work to a small pool of worker threads.
+ *
+ * Every job is submitted under a key that names the object it works on, e.g.
+ * an interface, a bridge or a feature.  Jobs with the same key run one at a
+ * time in submission order, jobs with different keys run in parallel.  Once a
+ * job has run, its completion callback is invoked from sim_executor_run(), on
+ * the main thread, with the status that the job returned.
+ *
+ * The number of outstanding jobs is bounded by SIM_EXEC_MAX_DEPTH.  Submitting
+ * more blocks until the workers catch up. */
+
+#define SIM_EXEC_N_WORKERS  4
+#define SIM_EXEC_MAX_DEPTH  4096
+
+/* Runs on a worker thread.  Returns 0 on success, otherwise a nonzero status
+ * that is passed to the completion callback. */
+typedef int sim_exec_work_func(void *aux);
+
+/* Runs on the main thread once the job's work function has returned. */
+typedef void sim_exec_done_func(int status, void *aux);
+
+void sim_executor_init(void);
+void sim_executor_run(void);
+void sim_executor_wait(void);
+
+void sim_exec_submit(const char *key, sim_exec_work_func *work,
+                     sim_exec_done_func *done, void *aux);
+void sim_exec_spawn(const char *key, const char *const argv[]);
+void sim_exec_swns_spawn(const char *key, const char *const argv[]);
+
+#endif /* sim-executor.h */
@@ -0,0 +1,109 @@
+/*
+ * (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SIM_FIREWALL_H
+#define SIM_FIREWALL_H 1
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct shash;
+struct svec;
+
+/* Kernel firewall state of the simulated switch.
+ *
+ * The plugin uses the firewall of the switch namespace for three things:
+ * dropping the IP traffic of L2 ports, which the ASIC OVS switches, counting
+ * the unicast and multicast packets of L3 interfaces, and sampling packets
+ * of sFlow-enabled ports to host-sflow through NFLOG.  A backend implements
+ * them on top of one kernel interface:
+ *
+ *   - "iptables": iptables and ip6tables rules, with an ipset of the L2
+ *     ports, applied in batches with iptables-restore.  This is the
+ *     default.
+ *
+ *   - "nftables": one "inet" table owned by the plugin, with sets of the L2
+ *     and sFlow ports, verdict maps to per-interface counter chains, and
+ *     every update applied as one atomic transaction.
+ *
+ * The backend is selected at startup by the SIM_FIREWALL_BACKEND environment
+ * variable.  If the requested backend cannot be initialized, the iptables
+ * backend is used.
+ *
+ * The operations block until the kernel has been updated, so they are meant
+ * to be called from executor jobs.  They return 0 on success, otherwise a
+ * nonzero status. */
+
+#define SIM_FIREWALL_ENV "SIM_FIREWALL_BACKEND"
+
+/* Packets and bytes of one L3 interface, family and direction. */
+struct sim_firewall_l3_stats {
+    uint64_t uc_packets;
+    uint64_t uc_bytes;
+    uint64_t mc_packets;
+    uint64_t mc_bytes;
+};
+
+/* Counters of the firewall rules of one interface. */
+struct sim_firewall_if_stats {
+    struct sim_firewall_l3_stats l3[2][2];  /* By [is_v6][is_ingress]. */
+    uint64_t sflow_packets[2];              /* IPv4 only, by [is_ingress]. */
+    uint64_t sflow_bytes[2];
+};
+
+struct sim_firewall_class {
+    const char *name;
+
+    /* Prepares the backend.  Returns 0 if it can be used. */
+    int (*init)(void);
+
+    /* Starts dropping the IP traffic received on 'port' if 'drop' is true,
+     * otherwise stops. */
+    int (*l2_port_set)(const char *port, bool drop);
+
+    /* Removes the L3 statistics counters of the interfaces in 'del_ifs',
+     * then adds those of the interfaces in 'add_ifs', all at once.  Existing
+     * counters are kept when adding. */
+    int (*l3stats_update)(const struct svec *add_ifs,
+                          const struct svec *del_ifs);
+
+    /* Stops sampling the packets of the ports in 'del_ports', then starts
+     * sampling the IPv4 packets that the ports in 'add_ports' receive and
+     * send, to NFLOG group 'nflog_group' at 1 in 'sampling_rate'.  The
+     * changes of one call are applied together, e.g. those of one sFlow
+     * reconfiguration. */
+    int (*sflow_update)(const struct svec *add_ports,
+                        const struct svec *del_ports,
+                        unsigned int sampling_rate, int nflog_group);
+
+    /* Stops sampling packets on every port. */
+    int (*sflow_del_all)(void);
+
+    /* Adds the counters of the L3 statistics and sFlow rules to 'stats',
+     * which maps interface names to 'struct sim_firewall_if_stats'. */
+    int (*dump_stats)(struct shash *stats);
+};
+
+extern const struct sim_firewall_class sim_firewall_iptables_class;
+extern const struct sim_firewall_class sim_firewall_nft_class;
+
+void sim_firewall_init(void);
+const struct sim_firewall_class *sim_firewall(void);
+
+struct sim_firewall_if_stats *sim_firewall_if_stats_get(struct shash *,
+                                                        const char *if_name);
+
+#endif /* sim-firewall.h */
@@ -0,0 +1,69 @@
+/*
+ * (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SIM_LINK_H
+#define SIM_LINK_H 1
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Kernel link configuration of the switch interfaces.
+ *
+ * The VLAN devices of subinterfaces, and the MTU, MAC address, admin state,
+ * transmit queues, offloads and channels that the hardware configuration of
+ * the ports asks for, are recorded per interface instead of being applied one
+ * ioctl or command at a time.  sim_link_run() then hands all the recorded
+ * changes to a single executor job, which applies them to the switch
+ * namespace as one batch of rtnetlink messages and one of ethtool generic
+ * netlink messages, each sent together, with one acknowledgement per message.
+ * A later change of an interface overrides an earlier one that is still
+ * pending, so a reconfiguration of hundreds of ports costs a few system
+ * calls.
+ *
+ * Pause frames and autonegotiation are applied only where the driver
+ * supports them.  The job queries them back, and sim_link_get_pause() and
+ * sim_link_get_autoneg() return what the driver reported, if anything.
+ *
+ * The other functions must be called from the main thread.  Failures are
+ * logged when the job completes. */
+
+void sim_link_set_vlan(const char *name, const char *parent, uint16_t vlan_id);
+void sim_link_set_mtu(const char *name, uint32_t mtu);
+void sim_link_set_mac(const char *name, const uint8_t mac[6]);
+void sim_link_set_up(const char *name, bool up);
+void sim_link_set_queues(const char *name, uint64_t rate);
+
+/* Offloads of an interface. */
+enum sim_link_feature {
+    SIM_LINK_F_GRO,             /* Generic receive offload. */
+    SIM_LINK_F_GSO,             /* Generic segmentation offload. */
+    SIM_LINK_F_TSO,             /* TCP segmentation offload. */
+    SIM_LINK_F_CSUM,            /* Receive and transmit checksum offload. */
+    SIM_LINK_N_FEATURES
+};
+
+void sim_link_set_feature(const char *name, enum sim_link_feature, bool on);
+void sim_link_set_channels(const char *name, uint32_t rx, uint32_t tx);
+
+void sim_link_set_pause(const char *name, bool rx, bool tx);
+void sim_link_set_autoneg(const char *name, bool autoneg);
+bool sim_link_get_pause(const char *name, bool *rx, bool *tx);
+bool sim_link_get_autoneg(const char *name, bool *autoneg);
+
+void sim_link_run(void);
+void sim_link_wait(void);
+
+#endif /* sim-link.h */
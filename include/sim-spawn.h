@@ -0,0 +1,43 @@
+/*
+ * (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SIM_SPAWN_H
+#define SIM_SPAWN_H 1
+
+struct ds;
+
+/* Runs external programs without a shell.
+ *
+ * Commands are given as an explicit, null-terminated argv, so that arguments
+ * never need quoting and running one command costs one posix_spawn() instead
+ * of a shell plus one process per pipeline stage.  Output that used to be
+ * filtered through grep and awk is captured and parsed by the caller.
+ *
+ * The time taken by every command is accounted per program and reported by
+ * "container/spawn-stats".  "container/spawn-benchmark [N]" compares the cost
+ * of a trivial command run through sim_spawn() and through system(), on an
+ * executor worker rather than the main thread. */
+
+void sim_spawn_init(void);
+
+int sim_spawn(const char *const argv[], struct ds *output);
+int sim_spawn_input(const char *const argv[], const char *input,
+                    struct ds *output);
+int sim_spawn_netns(int netns_fd, const char *const argv[], const char *input,
+                    struct ds *output);
+void sim_spawn_format_argv(const char *const argv[], struct ds *);
+
+#endif /* sim-spawn.h */
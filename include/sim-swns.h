@@ -0,0 +1,61 @@
+/*
+ * (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SIM_SWNS_H
+#define SIM_SWNS_H 1
+
+#include <stdbool.h>
+
+struct ds;
+
+/* Worker thread inside the switch network namespace.
+ *
+ * The interfaces of the simulated switch live in the "swns" namespace.
+ * Instead of prefixing every command with "ip netns exec swns", which costs
+ * an extra exec per command, a single thread enters the namespace once with
+ * setns() and keeps an ioctl socket and an rtnetlink socket open inside it.
+ * Socket operations on the switch interfaces are dispatched to that thread.
+ * Programs are not: sim_swns_spawn() starts them from the calling thread and
+ * each child enters the namespace itself before exec, so executor jobs run
+ * their commands in parallel and the swns thread never waits on a process.
+ *
+ * Nothing falls back to the namespace of ops-switchd.  While the switch
+ * namespace cannot be entered, the operations fail and return -1.  If it is
+ * deleted and created again, the thread and later children enter the new
+ * one.
+ *
+ * sim_swns_call() and the helpers built on it block until the operation has
+ * run, so they may be called from any thread, including executor jobs. */
+
+#define SWNS_NETNS_PATH "/var/run/netns/swns"
+
+/* Runs on the swns thread.  The return value is passed back to the caller of
+ * sim_swns_call(). */
+typedef int sim_swns_func(void *aux);
+
+void sim_swns_init(void);
+
+int sim_swns_call(sim_swns_func *, void *aux);
+int sim_swns_spawn(const char *const argv[], struct ds *output);
+int sim_swns_spawn_input(const char *const argv[], const char *input,
+                         struct ds *output);
+int sim_swns_ioctl(unsigned long int cmd, void *arg);
+
+/* Only valid on the swns thread, i.e. in a sim_swns_func. */
+int sim_swns_rtnl_sock(void);
+unsigned int sim_swns_rtnl_next_seq(void);
+
+#endif /* sim-swns.h */
@@ -0,0 +1,86 @@
+# -*- coding: utf-8 -*-
+# (C) Copyright 2016 Hewlett Packard Enterprise Development LP
+# All Rights Reserved.
+#
+#    Licensed under the Apache License, Version 2.0 (the "License"); you may
+#    not use this file except in compliance with the License. You may obtain
+#    a copy of the License at
+#
+#         http://www.apache.org/licenses/LICENSE-2.0
+#
+#    Unless required by applicable law or agreed to in writing, software
+#    distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+#    WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+#    License for the specific language governing permissions and limitations
+#    under the License.
+#
+##########################################################################
+
+"""
+OpenSwitch Test for the applied-state cache of the ASIC OVS ports.
+"""
+
+from time import sleep
+from pytest import mark
+
+TOPOLOGY = """
+# +-------+
+# |  ops1 |
+# +-------+
+
+# Nodes
+[type=openswitch name="OpenSwitch 1"] ops1
+"""
+
+SHOW_CACHE = ("ovs-appctl -t ops-switchd "
+              "container/show-asic-port-cache bridge_normal")
+
+
+@mark.platform_incompatible(['ostl'])
+def test_switchd_container_ct_asic_port_cache(topology, step):
+    ops1 = topology.get("ops1")
+    assert ops1 is not None
+
+    step("Add VLAN100 and VLAN200 to global VLAN table on Switch")
+    with ops1.libs.vtysh.ConfigVlan("100") as ctx:
+        ctx.no_shutdown()
+    with ops1.libs.vtysh.ConfigVlan("200") as ctx:
+        ctx.no_shutdown()
+
+    step("Add port 1 in access mode and port 2 in trunk mode")
+    with ops1.libs.vtysh.ConfigInterface("1") as ctx:
+        ctx.no_routing()
+        ctx.no_shutdown()
+        ctx.vlan_access("100")
+    with ops1.libs.vtysh.ConfigInterface("2") as ctx:
+        ctx.no_routing()
+        ctx.no_shutdown()
+        ctx.vlan_trunk_allowed("100")
+        ctx.vlan_trunk_allowed("200")
+    sleep(1)
+
+    step("Verify the cache matches the ASIC simulating Internal OVS")
+    cache = ops1(SHOW_CACHE, shell="bash")
+    assert "1: vlan_mode=access tag=100 trunks=none" in cache
+    assert "2: vlan_mode=trunk tag=-1 trunks=100,200" in cache
+    assert "0 mismatches" in cache
+
+    step("Delete VLAN200 and verify only the trunk port changes")
+    with ops1.libs.vtysh.Configure() as ctx:
+        ctx.no_vlan(200)
+    sleep(1)
+
+    cache = ops1(SHOW_CACHE, shell="bash")
+    assert "1: vlan_mode=access tag=100 trunks=none" in cache
+    assert "2: vlan_mode=trunk tag=-1 trunks=100 " in cache
+    assert "0 mismatches" in cache
+
+    step("Delete VLAN100 and verify both ports are removed")
+    with ops1.libs.vtysh.Configure() as ctx:
+        ctx.no_vlan(100)
+    sleep(1)
+
+    cache = ops1(SHOW_CACHE, shell="bash")
+    assert "1: not in ASIC OVS" in cache
+    assert "2: not in ASIC OVS" in cache
+    assert "0 mismatches" in cache
@@ -0,0 +1,125 @@
+# -*- coding: utf-8 -*-
+# (C) Copyright 2016 Hewlett Packard Enterprise Development LP
+# All Rights Reserved.
+#
+#    Licensed under the Apache License, Version 2.0 (the "License"); you may
+#    not use this file except in compliance with the License. You may obtain
+#    a copy of the License at
+#
+#         http://www.apache.org/licenses/LICENSE-2.0
+#
+#    Unless required by applicable law or agreed to in writing, software
+#    distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+#    WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+#    License for the specific language governing permissions and limitations
+#    under the License.
+#
+##########################################################################
+
+"""
+OpenSwitch Test for the forwarding rate of the kernel datapath against the
+number of L3 interfaces, whose statistics rules every routed packet may go
+through.
+"""
+
+from re import search
+from time import sleep
+from pytest import mark
+
+TOPOLOGY = """
+# +-------+
+# |  ops1 |
+# +-------+
+
+# Nodes
+[type=openswitch name="OpenSwitch 1"] ops1
+[type=host name="Host 1"] hs1
+[type=host name="Host 2"] hs2
+
+ops1:if01 -- hs1:eth0
+ops1:if02 -- hs2:eth0
+"""
+
+FLOOD_COUNT = 5000
+EXTRA_L3_INTERFACES = 64
+FIRST_VLAN = 1000
+
+
+def forwarding_pps(hs1):
+    out = hs1("ping -f -q -c {} 200.0.0.2".format(FLOOD_COUNT))
+    match = search(r"(\d+) packets transmitted, (\d+) received.*"
+                   r"time (\d+)ms", out)
+    assert match is not None
+    sent, received, msec = (int(x) for x in match.groups())
+    assert received >= sent * 9 // 10
+    return received * 1000 // max(msec, 1)
+
+
+@mark.platform_incompatible(['ostl'])
+def test_switchd_container_ct_l3_forwarding_scale(topology, step):
+    ops1 = topology.get("ops1")
+    hs1 = topology.get("hs1")
+    hs2 = topology.get("hs2")
+
+    assert ops1 is not None
+    assert hs1 is not None
+    assert hs2 is not None
+
+    step("Configure routed interfaces 1 and 2 and the hosts")
+    ops1("configure terminal")
+
+    ops1("interface 1")
+    ops1("no shutdown")
+    ops1("ip address 100.0.0.1/24")
+    ops1("exit")
+
+    ops1("interface 2")
+    ops1("no shutdown")
+    ops1("ip address 200.0.0.1/24")
+    ops1("exit")
+
+    hs1.libs.ip.interface('eth0', addr='100.0.0.2/24', up=True)
+    hs1("ip route add 200.0.0.0/24 via 100.0.0.1")
+
+    hs2.libs.ip.interface('eth0', addr='200.0.0.2/24', up=True)
+    hs2("ip route add 100.0.0.0/24 via 200.0.0.1")
+
+    sleep(5)
+
+    ping = hs1.libs.ping.ping(6, '200.0.0.2')
+    assert ping["received"] >= 4
+
+    step("Check the L3 statistics chains of interface 1")
+    port = ops1.ports["if01"]
+    rules = ops1("ip netns exec swns iptables -S", shell="bash")
+    assert "-N L3RX-{}".format(port) in rules
+    assert "-A INPUT -i {port} -j L3RX-{port}".format(port=port) in rules
+
+    step("Measure the forwarding rate with 2 L3 interfaces")
+    base_pps = forwarding_pps(hs1)
+
+    step("Add {} L3 interfaces".format(EXTRA_L3_INTERFACES))
+    for i in range(EXTRA_L3_INTERFACES):
+        vlan = FIRST_VLAN + i
+        ops1("vlan {}".format(vlan))
+        ops1("no shutdown")
+        ops1("exit")
+        ops1("interface vlan {}".format(vlan))
+        ops1("ip address 10.{}.{}.1/24".format(i // 256, i % 256))
+        ops1("exit")
+
+    sleep(30)
+
+    step("Measure the forwarding rate with {} L3 interfaces".format(
+        EXTRA_L3_INTERFACES + 2))
+    scaled_pps = forwarding_pps(hs1)
+
+    step("Forwarding rate: {} pps with 2 L3 interfaces, {} pps with "
+         "{}".format(base_pps, scaled_pps, EXTRA_L3_INTERFACES + 2))
+
+    step("Remove the added L3 interfaces")
+    for i in range(EXTRA_L3_INTERFACES):
+        vlan = FIRST_VLAN + i
+        ops1("no interface vlan {}".format(vlan))
+        ops1("no vlan {}".format(vlan))
+    ops1("end")
@@ -0,0 +1,74 @@
+# -*- coding: utf-8 -*-
+# (C) Copyright 2016 Hewlett Packard Enterprise Development LP
+# All Rights Reserved.
+#
+#    Licensed under the Apache License, Version 2.0 (the "License"); you may
+#    not use this file except in compliance with the License. You may obtain
+#    a copy of the License at
+#
+#         http://www.apache.org/licenses/LICENSE-2.0
+#
+#    Unless required by applicable law or agreed to in writing, software
+#    distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+#    WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+#    License for the specific language governing permissions and limitations
+#    under the License.
+#
+##########################################################################
+
+"""
+OpenSwitch Test for the link state of interfaces following their peer.
+"""
+
+from time import sleep
+from pytest import mark
+
+TOPOLOGY = """
+# +-------+
+# |  ops1 |
+# +-------+
+
+# Nodes
+[type=openswitch name="OpenSwitch 1"] ops1
+[type=host name="Host 1"] hs1
+
+ops1:if01 -- hs1:eth0
+"""
+
+
+def interface_is_up(ops1, port):
+    out = ops1("do show interface {}".format(port))
+    return "Interface {} is up".format(port) in out
+
+
+@mark.platform_incompatible(['ostl'])
+def test_switchd_container_ct_link_state(topology, step):
+    ops1 = topology.get("ops1")
+    hs1 = topology.get("hs1")
+
+    assert ops1 is not None
+    assert hs1 is not None
+
+    port = ops1.ports["if01"]
+
+    step("Enable interface 1")
+    ops1("configure terminal")
+    ops1("interface {}".format(port))
+    ops1("no shutdown")
+    ops1("exit")
+
+    hs1("ip link set dev eth0 up")
+    sleep(3)
+    assert interface_is_up(ops1, port)
+
+    step("Take the host side of the link down")
+    hs1("ip link set dev eth0 down")
+    sleep(3)
+    assert not interface_is_up(ops1, port)
+
+    step("Bring the host side of the link back up")
+    hs1("ip link set dev eth0 up")
+    sleep(3)
+    assert interface_is_up(ops1, port)
+
+    ops1("end")
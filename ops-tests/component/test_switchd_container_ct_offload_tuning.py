@@ -0,0 +1,111 @@
+# -*- coding: utf-8 -*-
+# (C) Copyright 2016 Hewlett Packard Enterprise Development LP
+# All Rights Reserved.
+#
+#    Licensed under the Apache License, Version 2.0 (the "License"); you may
+#    not use this file except in compliance with the License. You may obtain
+#    a copy of the License at
+#
+#         http://www.apache.org/licenses/LICENSE-2.0
+#
+#    Unless required by applicable law or agreed to in writing, software
+#    distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+#    WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+#    License for the specific language governing permissions and limitations
+#    under the License.
+#
+##########################################################################
+
+"""
+OpenSwitch benchmark of the iperf throughput through the switch with the
+offloads of its ports turned off and on.
+"""
+
+from time import sleep
+from pytest import mark
+
+TOPOLOGY = """
+# +-------+
+# |  ops1 |
+# +-------+
+
+# Nodes
+[type=openswitch name="OpenSwitch 1"] ops1
+[type=host name="Host 1"] hs1
+[type=host name="Host 2"] hs2
+
+ops1:if01 -- hs1:if01
+ops1:if02 -- hs2:if01
+"""
+
+OFFLOAD_KEYS = ["gro", "gso", "tso", "checksum"]
+
+
+def set_offloads(ops1, ports, on):
+    value = "true" if on else "false"
+    for port in ports:
+        settings = " ".join("hw_intf_config:{}={}".format(key, value)
+                            for key in OFFLOAD_KEYS)
+        ops1("/opt/openvswitch/bin/ovs-vsctl set interface {} {}"
+             .format(port, settings), shell="bash")
+    sleep(2)
+
+
+def iperf_throughput(hs1, server):
+    """Returns the TCP throughput from hs1 to 'server', in bits/s."""
+    out = hs1("iperf -c {} -t 5 -y C".format(server))
+    lines = [line for line in out.splitlines() if line.count(",") >= 8]
+    assert lines, "iperf failed: {}".format(out)
+    return int(lines[-1].split(",")[-1])
+
+
+@mark.platform_incompatible(['ostl'])
+def test_switchd_container_ct_offload_tuning(topology, step):
+    ops1 = topology.get("ops1")
+    hs1 = topology.get("hs1")
+    hs2 = topology.get("hs2")
+    assert ops1 is not None
+    assert hs1 is not None
+    assert hs2 is not None
+
+    p1 = ops1.ports["if01"]
+    p2 = ops1.ports["if02"]
+
+    step("Add ports 1 and 2 to VLAN 100")
+    with ops1.libs.vtysh.ConfigVlan("100") as ctx:
+        ctx.no_shutdown()
+    for port in [p1, p2]:
+        with ops1.libs.vtysh.ConfigInterface(port) as ctx:
+            ctx.no_routing()
+            ctx.no_shutdown()
+            ctx.vlan_access("100")
+
+    hs1.libs.ip.interface('if01', addr="10.0.0.1/8", up=True)
+    hs2.libs.ip.interface('if01', addr="10.0.0.2/8", up=True)
+    ping4 = hs1.libs.ping.ping(5, "10.0.0.2")
+    assert ping4["received"] >= 3
+
+    hs2("iperf -s -D")
+    sleep(1)
+
+    step("Measure the throughput with the offloads of the ports off")
+    set_offloads(ops1, [p1, p2], False)
+    untuned = iperf_throughput(hs1, "10.0.0.2")
+
+    step("Measure the throughput with the offloads of the ports on")
+    set_offloads(ops1, [p1, p2], True)
+    tuned = iperf_throughput(hs1, "10.0.0.2")
+
+    print("iperf throughput: untuned {:.1f} Mbps, tuned {:.1f} Mbps, "
+          "delta {:+.1f} Mbps".format(untuned / 1e6, tuned / 1e6,
+                                      (tuned - untuned) / 1e6))
+    assert untuned > 0
+    assert tuned > 0
+
+    hs2("pkill iperf")
+    with ops1.libs.vtysh.Configure() as ctx:
+        ctx.no_vlan(100)
+    for port in [p1, p2]:
+        with ops1.libs.vtysh.ConfigInterface(port) as ctx:
+            ctx.routing()
+            ctx.shutdown()
@@ -0,0 +1,85 @@
+# -*- coding: utf-8 -*-
+# (C) Copyright 2016 Hewlett Packard Enterprise Development LP
+# All Rights Reserved.
+#
+#    Licensed under the Apache License, Version 2.0 (the "License"); you may
+#    not use this file except in compliance with the License. You may obtain
+#    a copy of the License at
+#
+#         http://www.apache.org/licenses/LICENSE-2.0
+#
+#    Unless required by applicable law or agreed to in writing, software
+#    distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+#    WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+#    License for the specific language governing permissions and limitations
+#    under the License.
+#
+##########################################################################
+
+"""
+OpenSwitch Test for routed subinterfaces backed by kernel 802.1Q devices.
+"""
+
+from time import sleep
+from pytest import mark
+
+TOPOLOGY = """
+# +-------+
+# |  ops1 |
+# +-------+
+
+# Nodes
+[type=openswitch name="OpenSwitch 1"] ops1
+[type=host name="Host 1"] hs1
+
+ops1:if01 -- hs1:if01
+"""
+
+
+@mark.platform_incompatible(['ostl'])
+def test_switchd_container_ct_subinterface(topology, step):
+    ops1 = topology.get("ops1")
+    hs1 = topology.get("hs1")
+    assert ops1 is not None
+    assert hs1 is not None
+
+    port = ops1.ports["if01"]
+    subint = "{}.10".format(port)
+
+    step("Configure subinterface {} for VLAN 10".format(subint))
+    with ops1.libs.vtysh.ConfigInterface(port) as ctx:
+        ctx.routing()
+        ctx.no_shutdown()
+    ops1("configure terminal")
+    ops1("interface {}".format(subint))
+    ops1("ip address 10.0.10.1/24")
+    ops1("encapsulation dot1Q 10")
+    ops1("no shutdown")
+    ops1("end")
+    sleep(3)
+
+    step("Check the 802.1Q device in the switch namespace")
+    out = ops1("ip netns exec swns ip -d link show {}".format(subint),
+               shell="bash")
+    assert "vlan protocol 802.1Q id 10" in out
+
+    step("Ping the subinterface over a tagged host interface")
+    hs1("ip link add link if01 name if01.10 type vlan id 10")
+    hs1.libs.ip.interface('if01', up=True)
+    hs1("ip addr add 10.0.10.2/24 dev if01.10")
+    hs1("ip link set dev if01.10 up")
+    ping4 = hs1.libs.ping.ping(5, "10.0.10.1")
+    assert ping4["received"] >= 3
+
+    step("Remove the subinterface and check its device is gone")
+    ops1("configure terminal")
+    ops1("no interface {}".format(subint))
+    ops1("end")
+    sleep(3)
+    out = ops1("ip netns exec swns ip link show {}".format(subint),
+               shell="bash")
+    assert "does not exist" in out
+
+    hs1("ip link del if01.10")
+    with ops1.libs.vtysh.ConfigInterface(port) as ctx:
+        ctx.shutdown()
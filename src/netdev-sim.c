@@ -19,24 +19,47 @@
 
 #include "netdev-sim.h"
 
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <errno.h>
+#include <poll.h>
+#include <time.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <net/ethernet.h>
 #include <linux/ethtool.h>
+#include <linux/gen_stats.h>
 #include <linux/netlink.h>
+#include <linux/pkt_sched.h>
 #include <linux/rtnetlink.h>
 #include <sys/ioctl.h>
 #include <netinet/in.h>
 #include <net/if_arp.h>
 #include <net/if.h>
 
+#include "dynamic-string.h"
 #include "openswitch-idl.h"
 #include "openvswitch/vlog.h"
 #include "ovs-atomic.h"
+#include "sim-executor.h"
+#include "sim-firewall.h"
+#include "sim-link.h"
+#include "sim-swns.h"
+#include "hash.h"
+#include "hmap.h"
+#include "latch.h"
+#include "ovs-rcu.h"
+#include "ovs-thread.h"
+#include "poll-loop.h"
+#include "seq.h"
+#include "shash.h"
+#include "simap.h"
+#include "sset.h"
+#include "svec.h"
+#include "timeval.h"
+#include "unixctl.h"
 
 VLOG_DEFINE_THIS_MODULE(netdev_sim);
 
@@ -49,6 +72,30 @@ static struct ovs_mutex sim_list_mutex = OVS_MUTEX_INITIALIZER;
 static struct ovs_list sim_list OVS_GUARDED_BY(sim_list_mutex)
     = OVS_LIST_INITIALIZER(&sim_list);
 
+/* Statistics state of a netdev_sim.  It is kept apart from the
+ * configuration that 'mutex' protects, on cache lines of its own, so that
+ * collecting, resetting and reading statistics never waits for configuration
+ * changes, or the other way around. */
+struct netdev_sim_stats_block {
+    /* Written from any thread. */
+    atomic_bool sflow_stats_enabled;
+    atomic_count sflow_resets;          /* Incremented by each sFlow reset. */
+
+    /* Written by the L3 statistics rule jobs, read by the collector. */
+    atomic_bool l3_stats_enabled;
+
+    /* Only accessed by the stats collector, which holds sim_list_mutex. */
+    unsigned int sflow_resets_seen;
+    struct netdev_stats stats;          /* Last collected. */
+    uint64_t sflow_prev_ingress_pkts;
+    uint64_t sflow_prev_ingress_bytes;
+    uint64_t sflow_prev_egress_pkts;
+    uint64_t sflow_prev_egress_bytes;
+
+    /* Latest statistics published by the stats collector, or NULL. */
+    OVSRCU_TYPE(struct netdev_sim_stats_snapshot *) snapshot;
+};
+
 struct netdev_sim {
     struct netdev up;
 
@@ -60,7 +107,6 @@ struct netdev_sim {
 
     uint8_t hwaddr[ETH_ADDR_LEN] OVS_GUARDED;
     char hw_addr_str[18];
-    struct netdev_stats stats OVS_GUARDED;
     enum netdev_flags flags OVS_GUARDED;
 
     char linux_intf_name[16];
@@ -72,37 +118,61 @@ struct netdev_sim {
     bool pause_tx;
     bool pause_rx;
 
-    /* used for maintaining L3 sflow stats */
-    bool     sflow_stats_enabled;
-    uint32_t sflow_resets;
-    uint64_t sflow_prev_ingress_pkts;
-    uint64_t sflow_prev_ingress_bytes;
-    uint64_t sflow_prev_egress_pkts;
-    uint64_t sflow_prev_egress_bytes;
-
-    /* used for maintaining general L3 stats */
-    struct ovs_mutex l3_stats_mutex;
-    bool   l3_stats_enabled;
-};
-
-struct kernel_l3_stats {
-    uint64_t uc_packets;
-    uint64_t uc_bytes;
-    uint64_t mc_packets;
-    uint64_t mc_bytes;
+    /* Whether the port is enabled by its hardware configuration, or the
+     * subinterface by its VLAN. */
+    bool hw_enable;
+
+    /* 802.1Q device requested of the kernel for a subinterface: its parent
+     * interface and its VLAN, 0 if none. */
+    char vlan_parent[IFNAMSIZ];
+    uint16_t vlan_id;
+
+    /* Shaping rate of the transmit queues installed on the kernel interface,
+     * in bytes/s, 0 if unshaped, if 'queues_installed'. */
+    bool queues_installed;
+    uint64_t queues_rate;
+
+    /* Offloads requested of the kernel interface, by enum sim_link_feature:
+     * 1 if on, 0 if off, -1 if never set.  Channel counts requested, 0 if
+     * never set. */
+    signed char features[SIM_LINK_N_FEATURES];
+    uint32_t rx_channels;
+    uint32_t tx_channels;
+
+    /* Last state of 'linux_intf_name' reported by the kernel: its IFF_*
+     * flags and its MTU, 0 if not reported yet.  Until the first report the
+     * interface is assumed to be up and running. */
+    unsigned int kernel_flags;
+    uint32_t kernel_mtu;
+
+    /* Index of 'linux_intf_name' in the switch namespace, 0 if not known
+     * yet.  Protected by 'kernel_stats_mutex'. */
+    int ifindex;
+
+    struct netdev_sim_stats_block sb OVS_ALIGNED_VAR(CACHE_LINE_SIZE);
 };
 
 static int netdev_sim_construct(struct netdev *);
 
-static void
-netdev_parse_netlink_msg(struct nlmsghdr *h, struct netdev_stats *stats);
-
 static int
-netdev_get_kernel_stats(const char *if_name, struct netdev_stats *stats);
+netdev_get_kernel_stats(struct netdev_sim *dev, const char *name,
+                        struct netdev_stats *stats);
 
 static int
 netdev_sim_get_kernel_l3_stats(const char *if_name, struct netdev_stats *stats);
 
+static unixctl_cb_func netdev_sim_unixctl_l3stats_queue;
+static unixctl_cb_func netdev_sim_unixctl_stats_collector;
+static unixctl_cb_func netdev_sim_unixctl_stats_benchmark;
+static unixctl_cb_func netdev_sim_unixctl_port_rates;
+static unixctl_cb_func netdev_sim_unixctl_link_shaping;
+
+static void netdev_sim_stats_collector_start(void);
+static void kernel_stats_refresh(void);
+static bool netdev_get_kernel_queue_stats(
+    struct netdev_sim *, struct netdev_queue_stats queues[NUM_QUEUES],
+    uint64_t *qdisc_drops);
+
 static bool
 is_sim_class(const struct netdev_class *class)
 {
@@ -119,7 +189,7 @@ netdev_sim_cast(const struct netdev *netdev)
 static struct netdev *
 netdev_sim_alloc(void)
 {
-    struct netdev_sim *netdev = xzalloc(sizeof *netdev);
+    struct netdev_sim *netdev = xzalloc_cacheline(sizeof *netdev);
     return &netdev->up;
 }
 
@@ -143,21 +213,22 @@ netdev_sim_construct(struct netdev *netdev_)
     netdev->mtu = 1500;
     netdev->flags = 0;
     netdev->link_state = 0;
-    netdev->sflow_resets = 0;
-    netdev->sflow_stats_enabled = false;
-    netdev->sflow_prev_ingress_pkts = 0;
-    netdev->sflow_prev_ingress_bytes = 0;
-    netdev->sflow_prev_egress_pkts = 0;
-    netdev->sflow_prev_egress_bytes = 0;
-    netdev->l3_stats_enabled = false;
-    ovs_mutex_init(&netdev->l3_stats_mutex);
-
+    netdev->kernel_flags = IFF_UP | IFF_RUNNING;
+    memset(netdev->features, -1, sizeof netdev->features);
     ovs_mutex_unlock(&netdev->mutex);
 
+    /* The rest of the stats block is zeroed by netdev_sim_alloc(). */
+    atomic_init(&netdev->sb.sflow_stats_enabled, false);
+    atomic_count_init(&netdev->sb.sflow_resets, 0);
+    atomic_init(&netdev->sb.l3_stats_enabled, false);
+    ovsrcu_init(&netdev->sb.snapshot, NULL);
+
     ovs_mutex_lock(&sim_list_mutex);
     list_push_back(&sim_list, &netdev->list_node);
     ovs_mutex_unlock(&sim_list_mutex);
 
+    netdev_sim_stats_collector_start();
+
     return 0;
 }
 
@@ -165,10 +236,21 @@ static void
 netdev_sim_destruct(struct netdev *netdev_)
 {
     struct netdev_sim *netdev = netdev_sim_cast(netdev_);
+    struct netdev_sim_stats_snapshot *snap;
+
+    if (netdev->vlan_id) {
+        sim_link_set_vlan(netdev->up.name, NULL, 0);
+    }
 
     ovs_mutex_lock(&sim_list_mutex);
     list_remove(&netdev->list_node);
+    snap = ovsrcu_get_protected(struct netdev_sim_stats_snapshot *,
+                                &netdev->sb.snapshot);
     ovs_mutex_unlock(&sim_list_mutex);
+
+    if (snap) {
+        ovsrcu_postpone(free, snap);
+    }
 }
 
 static void
@@ -176,52 +258,342 @@ netdev_sim_dealloc(struct netdev *netdev_)
 {
     struct netdev_sim *netdev = netdev_sim_cast(netdev_);
 
-    free(netdev);
+    free_cacheline(netdev);
+}
+
+/* Link state tracking.
+ *
+ * A netlink socket in the switch namespace listens to RTNLGRP_LINK, so that
+ * the carrier, flags and MTU of every port follow its kernel interface, e.g.
+ * when the veth peer of a port goes down.  netdev_sim_run() reads the
+ * notifications and netdev_sim_wait() wakes the main loop when some arrive.
+ * Changed ports are also remembered in 'link_change_log', from which
+ * netdev_sim_link_poll() serves the port_poll() of the ofproto provider. */
+#define LINK_CHANGE_LOG_SIZE 64
+
+static int link_sock = -1;
+static bool link_dump_pending;  /* An RTM_GETLINK dump is in progress. */
+static bool link_dump_again;    /* Start another one when it finishes. */
+
+static struct ovs_mutex link_change_mutex = OVS_MUTEX_INITIALIZER;
+static char link_change_log[LINK_CHANGE_LOG_SIZE][IFNAMSIZ]
+    OVS_GUARDED_BY(link_change_mutex);
+static uint64_t link_change_n OVS_GUARDED_BY(link_change_mutex);
+static struct seq *link_change_seq;
+
+/* Index of every interface of the switch namespace, by name, as reported by
+ * link notifications.  The stats collector looks interfaces up here, so that
+ * it never has to ask the kernel while it holds 'sim_list_mutex', and adds
+ * those that it resolved itself (see kernel_ifindex_resolve()). */
+static struct ovs_mutex kernel_ifindex_mutex = OVS_MUTEX_INITIALIZER;
+static struct simap kernel_ifindexes OVS_GUARDED_BY(kernel_ifindex_mutex)
+    = SIMAP_INITIALIZER(&kernel_ifindexes);
+
+/* Number of link notifications received, which kernel_ifindex_resolve()
+ * uses to retry the interfaces that it could not resolve. */
+static atomic_count kernel_link_events = ATOMIC_COUNT_INIT(0);
+
+/* Recomputes the flags, carrier and MTU of 'dev' from its hardware
+ * configuration and the last kernel report.  Returns true if any of them
+ * changed. */
+static bool
+netdev_sim_link_refresh(struct netdev_sim *dev)
+    OVS_REQUIRES(dev->mutex)
+{
+    enum netdev_flags flags = dev->flags & ~(NETDEV_UP | NETDEV_PROMISC);
+    int link_state = 0;
+    uint32_t mtu = dev->mtu;
+    bool changed;
+
+    if (dev->hw_enable) {
+        if (dev->kernel_flags & IFF_UP) {
+            flags |= NETDEV_UP;
+        }
+        link_state = (dev->kernel_flags & IFF_RUNNING) != 0;
+        if (dev->kernel_mtu) {
+            mtu = dev->kernel_mtu;
+        }
+    }
+    if (dev->kernel_flags & IFF_PROMISC) {
+        flags |= NETDEV_PROMISC;
+    }
+
+    if (link_state != dev->link_state) {
+        VLOG_INFO("%s: link state changed to %s", dev->up.name,
+                  link_state ? "up" : "down");
+    }
+    changed = (flags != dev->flags || link_state != dev->link_state
+               || mtu != dev->mtu);
+    dev->flags = flags;
+    dev->link_state = link_state;
+    dev->mtu = mtu;
+
+    return changed;
+}
+
+static void
+netdev_sim_link_changed(const char *name)
+{
+    ovs_mutex_lock(&link_change_mutex);
+    ovs_strlcpy(link_change_log[link_change_n % LINK_CHANGE_LOG_SIZE], name,
+                IFNAMSIZ);
+    link_change_n++;
+    seq_change(link_change_seq);
+    ovs_mutex_unlock(&link_change_mutex);
+}
+
+/* Adds to 'names' the ports whose carrier, flags or MTU changed since
+ * '*seqno', then advances '*seqno'.  Returns ENOBUFS, without adding any
+ * name, if more ports changed than are remembered, in which case the caller
+ * should check all of its ports.  Otherwise returns 0. */
+int
+netdev_sim_link_poll(uint64_t *seqno, struct sset *names)
+{
+    int error = 0;
+
+    ovs_mutex_lock(&link_change_mutex);
+    if (link_change_n - *seqno > LINK_CHANGE_LOG_SIZE) {
+        error = ENOBUFS;
+    } else {
+        uint64_t i;
+
+        for (i = *seqno; i < link_change_n; i++) {
+            sset_add(names, link_change_log[i % LINK_CHANGE_LOG_SIZE]);
+        }
+    }
+    *seqno = link_change_n;
+    ovs_mutex_unlock(&link_change_mutex);
+
+    return error;
+}
+
+/* Arranges for poll_block() to wake up when netdev_sim_link_poll() has
+ * changes after 'seqno' to report. */
+void
+netdev_sim_link_poll_wait(uint64_t seqno)
+{
+    ovs_mutex_lock(&link_change_mutex);
+    if (link_change_n != seqno) {
+        poll_immediate_wake();
+    } else {
+        seq_wait(link_change_seq, seq_read(link_change_seq));
+    }
+    ovs_mutex_unlock(&link_change_mutex);
+}
+
+/* Updates the port named in the RTM_NEWLINK or RTM_DELLINK message 'h'. */
+static void
+netdev_sim_link_parse_msg(struct nlmsghdr *h)
+{
+    struct ifinfomsg *iface = NLMSG_DATA(h);
+    const char *name = NULL;
+    struct rtattr *attribute;
+    struct netdev_sim *dev;
+    unsigned int flags;
+    uint32_t mtu = 0;
+    int len;
+
+    if (h->nlmsg_len < NLMSG_LENGTH(sizeof *iface)) {
+        return;
+    }
+    len = h->nlmsg_len - NLMSG_LENGTH(sizeof *iface);
+    for (attribute = IFLA_RTA(iface); RTA_OK(attribute, len);
+         attribute = RTA_NEXT(attribute, len)) {
+        if (attribute->rta_type == IFLA_IFNAME
+            && memchr(RTA_DATA(attribute), '\0', RTA_PAYLOAD(attribute))) {
+            name = RTA_DATA(attribute);
+        } else if (attribute->rta_type == IFLA_MTU
+                   && RTA_PAYLOAD(attribute) >= sizeof mtu) {
+            memcpy(&mtu, RTA_DATA(attribute), sizeof mtu);
+        }
+    }
+    if (!name) {
+        return;
+    }
+    flags = h->nlmsg_type == RTM_DELLINK ? 0 : iface->ifi_flags;
+
+    ovs_mutex_lock(&kernel_ifindex_mutex);
+    if (h->nlmsg_type == RTM_DELLINK) {
+        simap_find_and_delete(&kernel_ifindexes, name);
+    } else {
+        simap_put(&kernel_ifindexes, name, iface->ifi_index);
+    }
+    ovs_mutex_unlock(&kernel_ifindex_mutex);
+    atomic_count_inc(&kernel_link_events);
+
+    ovs_mutex_lock(&sim_list_mutex);
+    LIST_FOR_EACH (dev, list_node, &sim_list) {
+        ovs_mutex_lock(&dev->mutex);
+        if (!strcmp(dev->linux_intf_name, name)) {
+            dev->kernel_flags = flags;
+            if (mtu) {
+                dev->kernel_mtu = mtu;
+            }
+            if (netdev_sim_link_refresh(dev)) {
+                netdev_change_seq_changed(&dev->up);
+                netdev_sim_link_changed(dev->up.name);
+            }
+        }
+        ovs_mutex_unlock(&dev->mutex);
+    }
+    ovs_mutex_unlock(&sim_list_mutex);
+}
+
+/* Asks for the state of every interface, e.g. after notifications were
+ * lost. */
+static void
+netdev_sim_link_request_dump(void)
+{
+    struct {
+        struct nlmsghdr hdr;
+        struct ifinfomsg ifi;
+    } req;
+    struct sockaddr_nl kernel;
+
+    if (link_dump_pending) {
+        link_dump_again = true;
+        return;
+    }
+
+    memset(&req, 0, sizeof req);
+    req.hdr.nlmsg_len = NLMSG_LENGTH(sizeof req.ifi);
+    req.hdr.nlmsg_type = RTM_GETLINK;
+    req.hdr.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    req.ifi.ifi_family = AF_UNSPEC;
+
+    memset(&kernel, 0, sizeof kernel);
+    kernel.nl_family = AF_NETLINK;
+
+    if (sendto(link_sock, &req, req.hdr.nlmsg_len, 0,
+               (struct sockaddr *) &kernel, sizeof kernel) < 0) {
+        VLOG_WARN("link state dump request failed (%s)", ovs_strerror(errno));
+        return;
+    }
+    link_dump_pending = true;
+    link_dump_again = false;
+}
+
+/* Opens the link notification socket.  Runs on the swns thread, so that the
+ * socket belongs to the switch namespace.  Returns the socket, otherwise a
+ * negative errno value. */
+static int
+netdev_sim_link_sock_open__(void *aux OVS_UNUSED)
+{
+    struct sockaddr_nl local;
+    int sock;
+
+    sock = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC | SOCK_NONBLOCK,
+                  NETLINK_ROUTE);
+    if (sock < 0) {
+        return -errno;
+    }
+
+    memset(&local, 0, sizeof local);
+    local.nl_family = AF_NETLINK;
+    local.nl_groups = RTMGRP_LINK;
+    if (bind(sock, (struct sockaddr *) &local, sizeof local) < 0) {
+        int error = errno;
+
+        close(sock);
+        return -error;
+    }
+    return sock;
+}
+
+/* Opens the link notification socket, once, and asks for the current state
+ * of the interfaces.  Returns false if there is no socket. */
+static bool
+netdev_sim_link_listener_start(void)
+{
+    static bool started;
+
+    if (!started) {
+        started = true;
+        link_sock = sim_swns_call(netdev_sim_link_sock_open__, NULL);
+        if (link_sock < 0) {
+            VLOG_ERR("link state notification socket failed (%s), port "
+                     "carrier will not follow the kernel",
+                     ovs_strerror(-link_sock));
+        } else {
+            netdev_sim_link_request_dump();
+        }
+    }
+    return link_sock >= 0;
 }
 
 static void
 netdev_sim_run(void)
 {
-    /* HALON_TODO: Currently we are not supporting to change the
-     * link state on the go. So ignoring this function. */
+    static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(1, 5);
+    static char buffer[32768];
+
+    if (!netdev_sim_link_listener_start()) {
+        return;
+    }
+
+    for (;;) {
+        struct nlmsghdr *nlh;
+        ssize_t ret;
+
+        ret = recv(link_sock, buffer, sizeof buffer, MSG_DONTWAIT);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            } else if (errno == ENOBUFS) {
+                /* The socket overflowed, so some changes were lost. */
+                VLOG_WARN_RL(&rl, "link state notifications lost, "
+                             "resynchronizing");
+                netdev_sim_link_request_dump();
+                continue;
+            } else if (errno != EAGAIN) {
+                VLOG_WARN_RL(&rl, "link state notification receive failed "
+                             "(%s)", ovs_strerror(errno));
+            }
+            break;
+        }
+
+        for (nlh = (struct nlmsghdr *) buffer; NLMSG_OK(nlh, ret);
+             nlh = NLMSG_NEXT(nlh, ret)) {
+            if (nlh->nlmsg_type == RTM_NEWLINK
+                || nlh->nlmsg_type == RTM_DELLINK) {
+                netdev_sim_link_parse_msg(nlh);
+            } else if (nlh->nlmsg_type == NLMSG_DONE
+                       || nlh->nlmsg_type == NLMSG_ERROR) {
+                link_dump_pending = false;
+                if (link_dump_again) {
+                    netdev_sim_link_request_dump();
+                }
+            }
+        }
+    }
 }
 
-/* Use SIOCSIFHWADDR to change MAC address of intf.
+static void
+netdev_sim_wait(void)
+{
+    if (link_sock >= 0) {
+        poll_fd_wait(link_sock, POLLIN);
+    }
+}
+
+/* Queues the change of the MAC address of intf, which sim_link_run()
+ * applies along with the other link changes of the reconfiguration.
  * Linux tun tap interfaces does not seem to need
  * an admin down before MAC change. */
 static int
 netdev_sim_set_macaddr(char *intf, char *macaddr)
 {
-    struct ifreq ifr;
-    int sock;
+    uint8_t mac[ETH_ADDR_LEN];
 
-    snprintf(ifr.ifr_name, IFNAMSIZ, "%s", intf);
-    ifr.ifr_hwaddr.sa_family = ARPHRD_ETHER;
     if (sscanf(macaddr, "%hhx:%hhx:%hhx:%hhx:%hhx:%hhx",
-               &ifr.ifr_hwaddr.sa_data[0],
-               &ifr.ifr_hwaddr.sa_data[1],
-               &ifr.ifr_hwaddr.sa_data[2],
-               &ifr.ifr_hwaddr.sa_data[3],
-               &ifr.ifr_hwaddr.sa_data[4],
-               &ifr.ifr_hwaddr.sa_data[5]) != ETH_ADDR_LEN) {
+               &mac[0], &mac[1], &mac[2],
+               &mac[3], &mac[4], &mac[5]) != ETH_ADDR_LEN) {
         VLOG_ERR("netdev_set_macaddr (%s) sscanf failed for (%s)\n",
                   intf, macaddr);
         return -1;
     }
-    if ((sock = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
-        VLOG_ERR("netdev_set_macaddr (%s) MAC (%s) socket failed '%s'\n",
-                  intf, macaddr, strerror(errno));
-        return -1;
-    }
-
-    if (ioctl(sock, SIOCSIFHWADDR, &ifr) < 0) {
-        VLOG_ERR("netdev_set_macaddr (%s) MAC (%s) ioctl failed '%s'\n",
-                  intf, macaddr, strerror(errno));
-        close(sock);
-        return -1;
-    }
+    sim_link_set_mac(intf, mac);
 
-    close(sock);
     return 0;
 }
 
@@ -231,7 +603,6 @@ netdev_sim_set_hw_intf_info(struct netdev *netdev_, const struct smap *args)
     struct netdev_sim *netdev = netdev_sim_cast(netdev_);
     const char *max_speed = smap_get(args, INTERFACE_HW_INTF_INFO_MAP_MAX_SPEED);
     const char *mac_addr = smap_get(args, INTERFACE_HW_INTF_INFO_MAP_MAC_ADDR);
-    char cmd[1024];
 
     ovs_mutex_lock(&netdev->mutex);
 
@@ -283,10 +654,30 @@ netdev_sim_set_config(struct netdev *netdev_, const struct smap *args)
     VLOG_DBG("vlan %d\n", vlan);
     VLOG_DBG("parent_intf_name %s\n", parent ? parent : NULL );
 
-    if (0 != vlan) {
-        netdev->flags |= NETDEV_UP;
-    } else {
-        netdev->flags &= ~NETDEV_UP;
+    /* The subinterface is an 802.1Q device of the same name on its parent,
+     * so its statistics and link state come from the kernel like those of a
+     * port. */
+    ovs_strlcpy(netdev->linux_intf_name, netdev->up.name,
+                sizeof netdev->linux_intf_name);
+
+    if (!parent || vlan <= 0 || vlan > 4094) {
+        vlan = 0;
+    }
+    netdev->hw_enable = vlan != 0;
+    if (vlan != netdev->vlan_id
+        || (vlan && strcmp(parent, netdev->vlan_parent))) {
+        sim_link_set_vlan(netdev->up.name, vlan ? parent : NULL, vlan);
+        if (vlan) {
+            sim_link_set_up(netdev->up.name, true);
+        }
+        ovs_strlcpy(netdev->vlan_parent, vlan ? parent : "",
+                    sizeof netdev->vlan_parent);
+        netdev->vlan_id = vlan;
+    }
+
+    if (netdev_sim_link_refresh(netdev)) {
+        netdev_sim_link_changed(netdev->up.name);
+        netdev_change_seq_changed(netdev_);
     }
 
     ovs_mutex_unlock(&netdev->mutex);
@@ -294,6 +685,121 @@ netdev_sim_set_config(struct netdev *netdev_, const struct smap *args)
 }
 
 
+/* Link speed emulation.
+ *
+ * Every enabled port gets one transmit queue per local priority, so that
+ * netdev_sim_dump_queue_stats() has real counters to report.  When
+ * 'link_shaping' is on, which "container/link-shaping on" does, the queues
+ * are also shaped to the speed that the port advertises, so that capacity
+ * tests see oversubscription as a real switch would. */
+static bool link_shaping;
+
+/* Installs or updates the queues of 'dev' for its current link speed. */
+static void
+netdev_sim_queues_update(struct netdev_sim *dev)
+    OVS_REQUIRES(dev->mutex)
+{
+    /* 'link_speed' is in Mbps. */
+    uint64_t rate = link_shaping ? dev->link_speed * UINT64_C(125000) : 0;
+
+    if (!dev->queues_installed || rate != dev->queues_rate) {
+        sim_link_set_queues(dev->up.name, rate);
+        dev->queues_installed = true;
+        dev->queues_rate = rate;
+    }
+}
+
+static void
+netdev_sim_unixctl_link_shaping(struct unixctl_conn *conn, int argc,
+                                const char *argv[], void *aux OVS_UNUSED)
+{
+    struct ds reply = DS_EMPTY_INITIALIZER;
+    struct netdev_sim *dev;
+
+    if (argc > 1) {
+        if (!strcmp(argv[1], "on")) {
+            link_shaping = true;
+        } else if (!strcmp(argv[1], "off")) {
+            link_shaping = false;
+        } else {
+            unixctl_command_reply_error(conn, "expected \"on\" or \"off\"");
+            return;
+        }
+    }
+
+    ds_put_format(&reply, "link shaping: %s\n", link_shaping ? "on" : "off");
+    ovs_mutex_lock(&sim_list_mutex);
+    LIST_FOR_EACH (dev, list_node, &sim_list) {
+        ovs_mutex_lock(&dev->mutex);
+        if (dev->hw_enable
+            && !strcmp(netdev_get_type(&dev->up), "system")) {
+            netdev_sim_queues_update(dev);
+            if (dev->queues_rate) {
+                ds_put_format(&reply, "%s: %"PRIu32" Mbps\n", dev->up.name,
+                              dev->link_speed);
+            }
+        }
+        ovs_mutex_unlock(&dev->mutex);
+    }
+    ovs_mutex_unlock(&sim_list_mutex);
+
+    unixctl_command_reply(conn, ds_cstr(&reply));
+    ds_destroy(&reply);
+}
+
+/* Offload tuning.
+ *
+ * These hw_intf_config keys set the offloads and the channel counts of the
+ * kernel interface of a port, through ethtool, so that throughput tests can
+ * compare tuned and untuned ports.  A key that is absent leaves the kernel
+ * setting as it is. */
+#define HW_INTF_CONFIG_GRO "gro"
+#define HW_INTF_CONFIG_GSO "gso"
+#define HW_INTF_CONFIG_TSO "tso"
+#define HW_INTF_CONFIG_CSUM "checksum"
+#define HW_INTF_CONFIG_RX_CHANNELS "rx_channels"
+#define HW_INTF_CONFIG_TX_CHANNELS "tx_channels"
+
+static const char *const offload_keys[SIM_LINK_N_FEATURES] = {
+    [SIM_LINK_F_GRO] = HW_INTF_CONFIG_GRO,
+    [SIM_LINK_F_GSO] = HW_INTF_CONFIG_GSO,
+    [SIM_LINK_F_TSO] = HW_INTF_CONFIG_TSO,
+    [SIM_LINK_F_CSUM] = HW_INTF_CONFIG_CSUM,
+};
+
+/* Requests the offloads and channel counts of 'args' that differ from those
+ * last requested for 'dev'. */
+static void
+netdev_sim_offloads_update(struct netdev_sim *dev, const struct smap *args)
+    OVS_REQUIRES(dev->mutex)
+{
+    int rx = smap_get_int(args, HW_INTF_CONFIG_RX_CHANNELS, 0);
+    int tx = smap_get_int(args, HW_INTF_CONFIG_TX_CHANNELS, 0);
+    int f;
+
+    for (f = 0; f < SIM_LINK_N_FEATURES; f++) {
+        const char *value = smap_get(args, offload_keys[f]);
+        bool on;
+
+        if (!value) {
+            continue;
+        }
+        on = !strcmp(value, "true") || !strcmp(value, "on");
+        if (dev->features[f] != on) {
+            sim_link_set_feature(dev->up.name, f, on);
+            dev->features[f] = on;
+        }
+    }
+
+    rx = rx > 0 && rx != dev->rx_channels ? rx : 0;
+    tx = tx > 0 && tx != dev->tx_channels ? tx : 0;
+    if (rx || tx) {
+        sim_link_set_channels(dev->up.name, rx, tx);
+        dev->rx_channels = rx ? rx : dev->rx_channels;
+        dev->tx_channels = tx ? tx : dev->tx_channels;
+    }
+}
+
 static int
 netdev_sim_set_hw_intf_config(struct netdev *netdev_, const struct smap *args)
 {
@@ -309,10 +815,8 @@ netdev_sim_set_hw_intf_config(struct netdev *netdev_, const struct smap *args)
 
     VLOG_DBG("Interface=%s hw_enable=%d ", netdev->linux_intf_name, hw_enable);
 
+    netdev->hw_enable = hw_enable;
     if (hw_enable) {
-        netdev->flags |= NETDEV_UP;
-        netdev->link_state = 1;
-
         /* In simulator Links always come up at its max speed. */
         netdev->link_speed = netdev->hw_info_link_speed;
         netdev->mtu = mtu;
@@ -321,8 +825,6 @@ netdev_sim_set_hw_intf_config(struct netdev *netdev_, const struct smap *args)
             get_interface_pause_config(pause, &(netdev->pause_rx), &(netdev->pause_tx));
 
     } else {
-        netdev->flags &= ~NETDEV_UP;
-        netdev->link_state = 0;
         netdev->link_speed = 0;
         netdev->mtu = 0;
         netdev->autoneg = false;
@@ -331,6 +833,25 @@ netdev_sim_set_hw_intf_config(struct netdev *netdev_, const struct smap *args)
 
     }
 
+    /* Push the admin state, MTU, queues, offloads, autonegotiation and pause
+     * frames to the kernel interface of the port. */
+    if (!strcmp(netdev_get_type(netdev_), "system")) {
+        if (hw_enable && mtu > 0) {
+            sim_link_set_mtu(netdev->up.name, mtu);
+        }
+        sim_link_set_up(netdev->up.name, hw_enable);
+        if (hw_enable) {
+            netdev_sim_queues_update(netdev);
+            netdev_sim_offloads_update(netdev, args);
+            sim_link_set_autoneg(netdev->up.name, autoneg);
+            sim_link_set_pause(netdev->up.name, netdev->pause_rx,
+                               netdev->pause_tx);
+        }
+    }
+    if (netdev_sim_link_refresh(netdev)) {
+        netdev_sim_link_changed(netdev->up.name);
+    }
+
     netdev_change_seq_changed(netdev_);
 
     ovs_mutex_unlock(&netdev->mutex);
@@ -367,6 +888,38 @@ netdev_sim_get_etheraddr(const struct netdev *netdev,
     return 0;
 }
 
+/* Counters of the firewall rules, for L3 statistics and sFlow, of every
+ * interface in the switch namespace, mapping interface names to 'struct
+ * sim_firewall_if_stats'.  The stats collector refreshes them once per pass
+ * by one dump of the firewall, parsed once, instead of a dump per interface,
+ * family and direction. */
+static struct ovs_mutex firewall_stats_mutex = OVS_MUTEX_INITIALIZER;
+static struct shash firewall_stats_cache OVS_GUARDED_BY(firewall_stats_mutex)
+    = SHASH_INITIALIZER(&firewall_stats_cache);
+
+/* Whether the last dump of the firewall succeeded. */
+static bool firewall_stats_valid OVS_GUARDED_BY(firewall_stats_mutex);
+
+static void
+firewall_stats_refresh(void)
+{
+    ovs_mutex_lock(&firewall_stats_mutex);
+    shash_clear_free_data(&firewall_stats_cache);
+    firewall_stats_valid = !sim_firewall()->dump_stats(&firewall_stats_cache);
+    ovs_mutex_unlock(&firewall_stats_mutex);
+}
+
+/* Locks the firewall counters cache and returns the counters of 'if_name',
+ * or NULL if it has no rules.  The caller must unlock
+ * 'firewall_stats_mutex'. */
+static const struct sim_firewall_if_stats *
+firewall_stats_lock(const char *if_name)
+    OVS_ACQUIRES(firewall_stats_mutex)
+{
+    ovs_mutex_lock(&firewall_stats_mutex);
+    return shash_find_data(&firewall_stats_cache, if_name);
+}
+
 /* Gets the sflow counters from iptable rules. They get reset to zero when
  * sflow gets disabled and re-enabled.
  */
@@ -374,161 +927,703 @@ static void
 netdev_sim_get_iptable_stats(char *port, bool ingress, uint64_t *pkts,
                              uint64_t *bytes)
 {
-    FILE *fp;
-    char cmd_str[MAX_CMD_LEN];
-    char buffer[16] = {0};
+    const struct sim_firewall_if_stats *ifs;
 
     *pkts = 0;
     *bytes = 0;
-    snprintf(cmd_str, sizeof(cmd_str), "%s iptables -S -v -w | grep SFLOW | grep '%c %s' "
-             "| awk -F ' ' '{print $12}' | awk '{ sum+=$1} END {print sum}'",
-             SWNS_EXEC, ingress ? 'i' : 'o', port);
-    fp = popen(cmd_str, "r");
-    if (fgets(buffer, sizeof(buffer), fp) == NULL) {
-        VLOG_ERR("sflow counters: cannot read iptable rules");
-        pclose(fp);
-        return;
-    }
-    *pkts = atoll(buffer);
-    pclose(fp);
 
-    snprintf(cmd_str, sizeof(cmd_str), "%s iptables -S -v -w | grep SFLOW | grep '%c %s' "
-             "| awk -F ' ' '{print $13}' | awk '{ sum+=$1} END {print sum}'",
-             SWNS_EXEC, ingress ? 'i' : 'o', port);
-    fp = popen(cmd_str, "r");
-    if (fgets(buffer, sizeof(buffer), fp) == NULL) {
+    ifs = firewall_stats_lock(port);
+    if (!firewall_stats_valid) {
         VLOG_ERR("sflow counters: cannot read iptable rules");
-        pclose(fp);
-        return;
+    } else if (ifs) {
+        *pkts = ifs->sflow_packets[ingress];
+        *bytes = ifs->sflow_bytes[ingress];
     }
-    *bytes = atoll(buffer);
-    pclose(fp);
-
+    ovs_mutex_unlock(&firewall_stats_mutex);
 }
 
+/* Adds the sFlow counters of 'netdev' since the last call to 'stats', which
+ * then becomes the statistics of 'netdev'.  Only for the stats collector. */
 static void
-netdev_sim_update_sflow_stats(struct netdev_sim *netdev)
+netdev_sim_update_sflow_stats(struct netdev_sim *netdev,
+                              struct netdev_stats *stats)
 {
+    struct netdev_sim_stats_block *sb = &netdev->sb;
     uint64_t in_pkts = 0, in_bytes = 0;
     uint64_t out_pkts = 0, out_bytes = 0;
+    unsigned int resets;
+    bool enabled;
 
-    if (netdev->sflow_stats_enabled) {
+    atomic_read_relaxed(&sb->sflow_stats_enabled, &enabled);
+    if (enabled) {
         netdev_sim_get_iptable_stats(netdev->up.name, true,
                                      &in_pkts, &in_bytes);
         netdev_sim_get_iptable_stats(netdev->up.name, false,
                                      &out_pkts, &out_bytes);
     }
 
-    ovs_mutex_lock(&netdev->mutex);
-
     /* Note: sFlow stats is only supported for L3 interfaces because sampling in
        L2 interfaces is done in sim OVS which does not offer statistics. */
 
-    if (netdev->sflow_resets > 0 ||
-        netdev->sflow_prev_ingress_pkts > in_pkts ||
-        netdev->sflow_prev_egress_pkts > out_pkts) {
+    resets = atomic_count_get(&sb->sflow_resets);
+    if (resets != sb->sflow_resets_seen ||
+        sb->sflow_prev_ingress_pkts > in_pkts ||
+        sb->sflow_prev_egress_pkts > out_pkts) {
         /* This part of the code is run when sflow is enabled/disabled
            on an interface(s). When sflow is disabled, the iptable rules
            are removed. So the next time the interface shows up (sFlow was enabled
            on it again), the number of packets from iptables must be added
            directly with the existing count. */
-        netdev->stats.sflow_ingress_packets += in_pkts;
-        netdev->stats.sflow_ingress_bytes += in_bytes;
-        netdev->stats.sflow_egress_packets += out_pkts;
-        netdev->stats.sflow_egress_bytes += out_bytes;
+        stats->sflow_ingress_packets += in_pkts;
+        stats->sflow_ingress_bytes += in_bytes;
+        stats->sflow_egress_packets += out_pkts;
+        stats->sflow_egress_bytes += out_bytes;
     } else {
         /* This is the normal flow. After getting the stats from iptable
            rules, we need to get the delta (i.e. Number of packets
            from the iptable rules - Number of packets previously written
            to the DB) */
-        netdev->stats.sflow_ingress_packets += in_pkts -
-                                            netdev->sflow_prev_ingress_pkts;
-        netdev->stats.sflow_ingress_bytes += in_bytes -
-                                            netdev->sflow_prev_ingress_bytes;
-        netdev->stats.sflow_egress_packets += out_pkts -
-                                            netdev->sflow_prev_egress_pkts;
-        netdev->stats.sflow_egress_bytes += out_bytes -
-                                            netdev->sflow_prev_egress_bytes;
+        stats->sflow_ingress_packets += in_pkts - sb->sflow_prev_ingress_pkts;
+        stats->sflow_ingress_bytes += in_bytes - sb->sflow_prev_ingress_bytes;
+        stats->sflow_egress_packets += out_pkts - sb->sflow_prev_egress_pkts;
+        stats->sflow_egress_bytes += out_bytes - sb->sflow_prev_egress_bytes;
     }
 
     /* Update the previous counters so that we can find delta in next run */
-    netdev->sflow_prev_ingress_pkts = in_pkts;
-    netdev->sflow_prev_ingress_bytes = in_bytes;
-    netdev->sflow_prev_egress_pkts = out_pkts;
-    netdev->sflow_prev_egress_bytes = out_bytes;
-    netdev->sflow_resets = 0;
+    sb->sflow_prev_ingress_pkts = in_pkts;
+    sb->sflow_prev_ingress_bytes = in_bytes;
+    sb->sflow_prev_egress_pkts = out_pkts;
+    sb->sflow_prev_egress_bytes = out_bytes;
+    sb->sflow_resets_seen = resets;
 
-    ovs_mutex_unlock(&netdev->mutex);
+    sb->stats = *stats;
+}
+
+/* Reports the transmit counters of the prio qdisc bands of 'netdev', as of
+ * the last pass of the statistics collector. */
+int
+netdev_sim_dump_queue_stats(const struct netdev* netdev,
+                            netdev_dump_queue_stats_cb* cb,
+                            void* aux)
+{
+    struct netdev_sim *dev = netdev_sim_cast(netdev);
+    const struct netdev_sim_stats_snapshot *snap;
+    int q;
+
+    snap = ovsrcu_get(struct netdev_sim_stats_snapshot *, &dev->sb.snapshot);
+    if (!snap) {
+        return EAGAIN;
+    }
+    if (!snap->has_queues) {
+        return EOPNOTSUPP;
+    }
+
+    for (q = 0; q < NUM_QUEUES; q++) {
+        struct netdev_queue_stats qstats = snap->queues[q];
+
+        (*cb)(q, &qstats, aux);
+    }
+
+    return 0;
+}
+
+/* Statistics collector.
+ *
+ * Reading the statistics of an interface takes a kernel link dump and a
+ * firewall dump, which may block for a long time.  Instead of doing that on
+ * the thread that asks for them, a collector thread refreshes the statistics
+ * of every interface every 'stats_interval' msec and publishes them as an
+ * immutable snapshot per interface, through RCU.  netdev_sim_get_stats() then
+ * only copies the latest snapshot, without blocking. */
+#define STATS_INTERVAL_DEFAULT 1000
+#define STATS_INTERVAL_MIN 100
+
+/* Packet and byte rates of an interface, kept by the collector as
+ * exponentially weighted moving averages over the horizons in
+ * 'rate_horizons_msec'.  They are fixed-point numbers of packets or bytes per
+ * second, with RATE_FRAC_BITS fraction bits.  A sample 'dt' msec after the
+ * previous one moves each average by alpha = dt / (horizon + dt) of the
+ * difference, a first-order approximation of 1 - exp(-dt / horizon) that
+ * stays correct when the collection interval changes or a pass is late. */
+#define RATE_FRAC_BITS 8
+#define RATE_ALPHA_BITS 16
+#define RATE_N_HORIZONS 3
+
+static const int rate_horizons_msec[RATE_N_HORIZONS] = { 1000, 10000, 60000 };
+static const char *const rate_horizon_names[RATE_N_HORIZONS] = {
+    "1s", "10s", "60s"
+};
+
+enum rate_counter {
+    RATE_RX_PACKETS,
+    RATE_TX_PACKETS,
+    RATE_RX_BYTES,
+    RATE_TX_BYTES,
+    N_RATE_COUNTERS
+};
+
+struct netdev_sim_rates {
+    uint64_t rate[N_RATE_COUNTERS][RATE_N_HORIZONS];
+};
+
+struct netdev_sim_stats_snapshot {
+    struct netdev_stats stats;
+    struct netdev_sim_rates rates;
+    bool has_queues;                /* False if 'queues' are not known. */
+    struct netdev_queue_stats queues[NUM_QUEUES];
+    long long int time;             /* time_msec() when collected. */
+};
+
+static void
+rate_counters_get(const struct netdev_stats *stats,
+                  uint64_t counters[N_RATE_COUNTERS])
+{
+    counters[RATE_RX_PACKETS] = stats->rx_packets;
+    counters[RATE_TX_PACKETS] = stats->tx_packets;
+    counters[RATE_RX_BYTES] = stats->rx_bytes;
+    counters[RATE_TX_BYTES] = stats->tx_bytes;
+}
+
+/* Updates the rates of 'snap' from those of 'prev', the previous snapshot of
+ * the same interface, or initializes them if 'prev' is NULL. */
+static void
+netdev_sim_rates_update(struct netdev_sim_stats_snapshot *snap,
+                        const struct netdev_sim_stats_snapshot *prev)
+{
+    uint64_t cur[N_RATE_COUNTERS], old[N_RATE_COUNTERS];
+    long long int dt;
+    int c, h;
+
+    if (!prev) {
+        memset(&snap->rates, 0, sizeof snap->rates);
+        return;
+    } else if (snap->time <= prev->time) {
+        snap->rates = prev->rates;
+        return;
+    }
+
+    dt = snap->time - prev->time;
+    rate_counters_get(&snap->stats, cur);
+    rate_counters_get(&prev->stats, old);
+    for (c = 0; c < N_RATE_COUNTERS; c++) {
+        /* A counter that went backward was reset: count nothing for it. */
+        uint64_t delta = cur[c] >= old[c] ? cur[c] - old[c] : 0;
+        uint64_t sample = (delta << RATE_FRAC_BITS) * 1000 / dt;
+
+        for (h = 0; h < RATE_N_HORIZONS; h++) {
+            uint64_t alpha = ((uint64_t) dt << RATE_ALPHA_BITS)
+                             / (rate_horizons_msec[h] + dt);
+            uint64_t rate = prev->rates.rate[c][h];
+
+            if (sample >= rate) {
+                rate += ((sample - rate) * alpha) >> RATE_ALPHA_BITS;
+            } else {
+                rate -= ((rate - sample) * alpha) >> RATE_ALPHA_BITS;
+            }
+            snap->rates.rate[c][h] = rate;
+        }
+    }
+}
+
+static atomic_int stats_interval = ATOMIC_VAR_INIT(STATS_INTERVAL_DEFAULT);
+static struct latch stats_collector_latch;
+static atomic_count stats_n_passes = ATOMIC_COUNT_INIT(0);
+static atomic_llong stats_pass_msec = ATOMIC_VAR_INIT(0);
+
+/* Collects the statistics of 'dev' and publishes them.  If they cannot be
+ * read, the previous snapshot stays in place and grows stale. */
+static void
+netdev_sim_collect_dev_stats(struct netdev_sim *dev)
+    OVS_REQUIRES(sim_list_mutex)
+{
+    static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(1, 5);
+    struct netdev_sim_stats_snapshot *snap, *old;
+    struct netdev_stats stats = dev->sb.stats;
+    char name[sizeof dev->linux_intf_name];
+    bool l3_stats_enabled;
+    uint64_t qdisc_drops;
+
+    ovs_mutex_lock(&dev->mutex);
+    ovs_strlcpy(name, dev->linux_intf_name, sizeof name);
+    ovs_mutex_unlock(&dev->mutex);
+
+    if (netdev_get_kernel_stats(dev, name, &stats) < 0) {
+        VLOG_ERR_RL(&rl, "Failed to get interface statistics for interface %s",
+                    name);
+        return;
+    }
+
+    /* If L3 stats are enabled fetch statistics from iptables*/
+    atomic_read_relaxed(&dev->sb.l3_stats_enabled, &l3_stats_enabled);
+    if (l3_stats_enabled
+        && netdev_sim_get_kernel_l3_stats(name, &stats) < 0) {
+        VLOG_ERR_RL(&rl, "Failed to get L3 interface statistics for "
+                    "interface %s", name);
+        return;
+    }
+
+    netdev_sim_update_sflow_stats(dev, &stats);
+
+    snap = xmalloc(sizeof *snap);
+    snap->has_queues = netdev_get_kernel_queue_stats(dev, snap->queues,
+                                                     &qdisc_drops);
+    /* Packets dropped by the queues or the shaper never reach the link. */
+    stats.tx_dropped += qdisc_drops;
+    snap->stats = stats;
+    snap->time = time_msec();
+    old = ovsrcu_get_protected(struct netdev_sim_stats_snapshot *,
+                               &dev->sb.snapshot);
+    netdev_sim_rates_update(snap, old);
+    ovsrcu_set(&dev->sb.snapshot, snap);
+    if (old) {
+        ovsrcu_postpone(free, old);
+    }
+}
+
+static void *
+netdev_sim_stats_collector(void *arg OVS_UNUSED)
+{
+    for (;;) {
+        long long int start = time_msec();
+        struct netdev_sim *dev;
+        int interval;
+
+        /* The dumps go first, without 'sim_list_mutex', so that creating
+         * and destroying interfaces does not wait for them. */
+        kernel_stats_refresh();
+        firewall_stats_refresh();
+        kernel_ifindex_resolve();
+
+        ovs_mutex_lock(&sim_list_mutex);
+        LIST_FOR_EACH (dev, list_node, &sim_list) {
+            netdev_sim_collect_dev_stats(dev);
+        }
+        ovs_mutex_unlock(&sim_list_mutex);
+
+        atomic_store_relaxed(&stats_pass_msec, time_msec() - start);
+        atomic_count_inc(&stats_n_passes);
+
+        atomic_read_relaxed(&stats_interval, &interval);
+        latch_poll(&stats_collector_latch);
+        latch_wait(&stats_collector_latch);
+        poll_timer_wait_until(start + interval);
+        poll_block();
+    }
+
+    return NULL;
+}
+
+/* Starts the stats collector.  It is safe to call this more than once. */
+static void
+netdev_sim_stats_collector_start(void)
+{
+    static struct ovsthread_once once = OVSTHREAD_ONCE_INITIALIZER;
+
+    if (ovsthread_once_start(&once)) {
+        latch_init(&stats_collector_latch);
+        ovs_thread_create("sim_stats", netdev_sim_stats_collector, NULL);
+        ovsthread_once_done(&once);
+    }
+}
+
+static void
+netdev_sim_unixctl_stats_collector(struct unixctl_conn *conn, int argc,
+                                   const char *argv[], void *aux OVS_UNUSED)
+{
+    struct ds ds = DS_EMPTY_INITIALIZER;
+    long long int now = time_msec();
+    long long int pass_msec;
+    struct netdev_sim *dev;
+    int interval;
+
+    netdev_sim_stats_collector_start();
+    if (argc > 1) {
+        if (!str_to_int(argv[1], 10, &interval)
+            || interval < STATS_INTERVAL_MIN) {
+            unixctl_command_reply_error(conn, "invalid interval");
+            return;
+        }
+        atomic_store_relaxed(&stats_interval, interval);
+        latch_set(&stats_collector_latch);
+    }
+
+    atomic_read_relaxed(&stats_interval, &interval);
+    atomic_read_relaxed(&stats_pass_msec, &pass_msec);
+    ds_put_format(&ds, "interval: %d msec\n", interval);
+    ds_put_format(&ds, "passes: %u (last took %lld msec)\n",
+                  atomic_count_get(&stats_n_passes), pass_msec);
+
+    ovs_mutex_lock(&sim_list_mutex);
+    LIST_FOR_EACH (dev, list_node, &sim_list) {
+        const struct netdev_sim_stats_snapshot *snap;
+
+        snap = ovsrcu_get(struct netdev_sim_stats_snapshot *,
+                          &dev->sb.snapshot);
+        if (snap) {
+            ds_put_format(&ds, "%s: age %lld msec\n", dev->up.name,
+                          now - snap->time);
+        } else {
+            ds_put_format(&ds, "%s: not collected yet\n", dev->up.name);
+        }
+    }
+    ovs_mutex_unlock(&sim_list_mutex);
+
+    unixctl_command_reply(conn, ds_cstr(&ds));
+    ds_destroy(&ds);
+}
+
+static int
+netdev_sim_get_stats(const struct netdev *netdev, struct netdev_stats *stats)
+{
+    struct netdev_sim *dev = netdev_sim_cast(netdev);
+    const struct netdev_sim_stats_snapshot *snap;
+
+    snap = ovsrcu_get(struct netdev_sim_stats_snapshot *, &dev->sb.snapshot);
+    if (!snap) {
+        /* The collector has not run since the interface was created. */
+        return EAGAIN;
+    }
+    *stats = snap->stats;
+
+    return 0;
+}
+
+/* Contention benchmark for statistics reads.
+ *
+ * Reader threads read the statistics of a set of interfaces in a loop while a
+ * writer thread keeps taking the configuration mutex of each interface, as
+ * configuration changes do.  It runs once with readers that copy the
+ * statistics under that mutex, as netdev_sim_get_stats() used to, and once
+ * through the RCU snapshot, as netdev_sim_get_stats() does now.
+ *
+ * The interfaces are private copies of the sim interfaces, each with a mutex
+ * and a snapshot of its own, so that the benchmark never contends with the
+ * collector or with configuration changes.  It runs as an executor job and
+ * replies once it is done, so that the main loop keeps running. */
+#define STATS_BENCH_EXEC_KEY "stats-benchmark"
+
+struct stats_bench_dev {
+    struct ovs_mutex mutex;     /* Stands in for the configuration mutex. */
+    OVSRCU_TYPE(struct netdev_sim_stats_snapshot *) snapshot;
+};
+
+struct stats_bench {
+    struct unixctl_conn *conn;
+    int n_readers;
+    int msec;                   /* Duration of each run. */
+
+    struct stats_bench_dev *devs;
+    size_t n_devs;
+    bool use_mutex;
+    atomic_bool stop;
+    unsigned long long int n_writes;
+
+    struct ds report;
+};
+
+struct stats_bench_reader {
+    struct stats_bench *bench;
+    unsigned long long int n_reads;
+    uint64_t sum;                   /* Keeps the reads from being elided. */
+};
+
+static void *
+stats_bench_reader(void *reader_)
+{
+    struct stats_bench_reader *reader = reader_;
+    struct stats_bench *bench = reader->bench;
+    bool stop = false;
+
+    while (!stop) {
+        size_t i;
+
+        for (i = 0; i < bench->n_devs; i++) {
+            struct stats_bench_dev *dev = &bench->devs[i];
+            const struct netdev_sim_stats_snapshot *snap;
+            struct netdev_stats stats;
+
+            if (bench->use_mutex) {
+                ovs_mutex_lock(&dev->mutex);
+                snap = ovsrcu_get(struct netdev_sim_stats_snapshot *,
+                                  &dev->snapshot);
+                reader->sum += snap->stats.rx_packets;
+                ovs_mutex_unlock(&dev->mutex);
+            } else {
+                snap = ovsrcu_get(struct netdev_sim_stats_snapshot *,
+                                  &dev->snapshot);
+                stats = snap->stats;
+                reader->sum += stats.rx_packets;
+            }
+            reader->n_reads++;
+        }
+        ovsrcu_quiesce();
+        atomic_read_relaxed(&bench->stop, &stop);
+    }
+
+    return NULL;
+}
+
+static void *
+stats_bench_writer(void *bench_)
+{
+    struct stats_bench *bench = bench_;
+    bool stop = false;
+
+    while (!stop) {
+        size_t i;
+
+        for (i = 0; i < bench->n_devs; i++) {
+            struct stats_bench_dev *dev = &bench->devs[i];
+
+            ovs_mutex_lock(&dev->mutex);
+            bench->n_writes++;
+            ovs_mutex_unlock(&dev->mutex);
+        }
+        atomic_read_relaxed(&bench->stop, &stop);
+    }
+
+    return NULL;
+}
+
+/* Runs 'bench->n_readers' readers and one writer for 'bench->msec' and
+ * returns the number of reads. */
+static unsigned long long int
+stats_bench_run(struct stats_bench *bench, bool use_mutex)
+{
+    int n_readers = bench->n_readers;
+    struct stats_bench_reader *readers = xcalloc(n_readers, sizeof *readers);
+    pthread_t *threads = xcalloc(n_readers + 1, sizeof *threads);
+    unsigned long long int n_reads = 0;
+    struct timespec ts;
+    int i;
+
+    bench->use_mutex = use_mutex;
+    bench->n_writes = 0;
+    atomic_store_relaxed(&bench->stop, false);
+    for (i = 0; i < n_readers; i++) {
+        readers[i].bench = bench;
+        threads[i] = ovs_thread_create("sim_bench_reader", stats_bench_reader,
+                                       &readers[i]);
+    }
+    threads[n_readers] = ovs_thread_create("sim_bench_writer",
+                                           stats_bench_writer, bench);
+
+    ts.tv_sec = bench->msec / 1000;
+    ts.tv_nsec = (bench->msec % 1000) * 1000000L;
+    ovsrcu_quiesce_start();
+    nanosleep(&ts, NULL);
+    ovsrcu_quiesce_end();
+
+    atomic_store_relaxed(&bench->stop, true);
+    for (i = 0; i <= n_readers; i++) {
+        xpthread_join(threads[i], NULL);
+    }
+    for (i = 0; i < n_readers; i++) {
+        n_reads += readers[i].n_reads;
+    }
+    free(readers);
+    free(threads);
+
+    return n_reads;
+}
+
+static int
+stats_bench_work(void *bench_)
+{
+    struct stats_bench *bench = bench_;
+    unsigned long long int mutex_reads, mutex_writes, rcu_reads, rcu_writes;
+    int msec = bench->msec;
+
+    atomic_init(&bench->stop, false);
+    mutex_reads = stats_bench_run(bench, true);
+    mutex_writes = bench->n_writes;
+    rcu_reads = stats_bench_run(bench, false);
+    rcu_writes = bench->n_writes;
+
+    ds_put_format(&bench->report, "%d readers, %"PRIuSIZE" interfaces, one "
+                  "configuration writer, %d msec per run:\n",
+                  bench->n_readers, bench->n_devs, msec);
+    ds_put_format(&bench->report, "  reads under the netdev mutex "
+                  "%12llu reads/s, %12llu writes/s\n",
+                  mutex_reads * 1000 / msec, mutex_writes * 1000 / msec);
+    ds_put_format(&bench->report, "  RCU snapshot reads           "
+                  "%12llu reads/s, %12llu writes/s\n",
+                  rcu_reads * 1000 / msec, rcu_writes * 1000 / msec);
+    return 0;
 }
 
-int
-netdev_sim_dump_queue_stats(const struct netdev* netdev,
-                            netdev_dump_queue_stats_cb* cb,
-                            void* aux)
+/* Frees 'bench'.  No thread may be reading its snapshots anymore. */
+static void
+stats_bench_destroy(struct stats_bench *bench)
 {
-    /* static struct that mimics stateful hardware stats data */
-    static struct netdev_queue_stats lstats[NUM_QUEUES];
+    size_t i;
 
-    struct netdev_sim *dev = netdev_sim_cast(netdev);
-    int q = 0;
+    for (i = 0; i < bench->n_devs; i++) {
+        struct stats_bench_dev *dev = &bench->devs[i];
 
-    ovs_mutex_lock(&dev->mutex);
+        ovs_mutex_destroy(&dev->mutex);
+        free(ovsrcu_get_protected(struct netdev_sim_stats_snapshot *,
+                                  &dev->snapshot));
+    }
+    free(bench->devs);
+    ds_destroy(&bench->report);
+    free(bench);
+}
 
-    for (q=0; q<NUM_QUEUES; q++) {
+static void
+stats_bench_done(int status OVS_UNUSED, void *bench_)
+{
+    struct stats_bench *bench = bench_;
 
-        /* fake queue stats increase */
-        if (lstats[q].tx_bytes == 0)
-            lstats[q].tx_bytes = q+1;
-        else
-            lstats[q].tx_bytes += 10;
+    unixctl_command_reply(bench->conn, ds_cstr(&bench->report));
+    stats_bench_destroy(bench);
+}
 
-        if (lstats[q].tx_packets == 0)
-            lstats[q].tx_packets = q+1;
-        else
-            lstats[q].tx_packets += 10;
+static void
+netdev_sim_unixctl_stats_benchmark(struct unixctl_conn *conn, int argc,
+                                   const char *argv[], void *aux OVS_UNUSED)
+{
+    struct stats_bench *bench;
+    struct netdev_sim *dev;
+    int n_readers = 4;
+    int msec = 1000;
+
+    if (argc > 1 && (!str_to_int(argv[1], 10, &n_readers)
+                     || n_readers < 1 || n_readers > 64)) {
+        unixctl_command_reply_error(conn, "readers must be 1 to 64");
+        return;
+    }
+    if (argc > 2 && (!str_to_int(argv[2], 10, &msec)
+                     || msec < 100 || msec > 10000)) {
+        unixctl_command_reply_error(conn, "msec must be 100 to 10000");
+        return;
+    }
 
-        if (lstats[q].tx_errors == 0)
-            lstats[q].tx_errors = q+1;
-        else
-            lstats[q].tx_errors += 10;
+    bench = xzalloc(sizeof *bench);
+    bench->conn = conn;
+    bench->n_readers = n_readers;
+    bench->msec = msec;
+    ds_init(&bench->report);
 
-        /* punt our PI qstats array on through aux */
-        (*cb)(q, &lstats[q], aux);
+    /* Copy the latest snapshot of every interface. */
+    ovs_mutex_lock(&sim_list_mutex);
+    bench->devs = xcalloc(MAX(list_size(&sim_list), 1), sizeof *bench->devs);
+    LIST_FOR_EACH (dev, list_node, &sim_list) {
+        const struct netdev_sim_stats_snapshot *snap;
+        struct stats_bench_dev *copy = &bench->devs[bench->n_devs++];
+
+        snap = ovsrcu_get(struct netdev_sim_stats_snapshot *,
+                          &dev->sb.snapshot);
+        ovs_mutex_init(&copy->mutex);
+        ovsrcu_init(&copy->snapshot,
+                    (snap
+                     ? xmemdup(snap, sizeof *snap)
+                     : xzalloc(sizeof(struct netdev_sim_stats_snapshot))));
     }
+    ovs_mutex_unlock(&sim_list_mutex);
 
-    ovs_mutex_unlock(&dev->mutex);
+    if (!bench->n_devs) {
+        unixctl_command_reply_error(conn, "no interfaces");
+        stats_bench_destroy(bench);
+        return;
+    }
 
-    return 0;
+    sim_exec_submit(STATS_BENCH_EXEC_KEY, stats_bench_work, stats_bench_done,
+                    bench);
 }
 
+struct port_rates {
+    char *name;
+    struct netdev_sim_rates rates;
+};
+
+static int port_rates_horizon;
+
 static int
-netdev_sim_get_stats(const struct netdev *netdev, struct netdev_stats *stats)
+port_rates_compare(const void *a_, const void *b_)
 {
-    struct netdev_sim *dev = netdev_sim_cast(netdev);
+    const struct port_rates *a = a_;
+    const struct port_rates *b = b_;
+    int h = port_rates_horizon;
+    uint64_t a_bytes = (a->rates.rate[RATE_RX_BYTES][h]
+                        + a->rates.rate[RATE_TX_BYTES][h]);
+    uint64_t b_bytes = (b->rates.rate[RATE_RX_BYTES][h]
+                        + b->rates.rate[RATE_TX_BYTES][h]);
+
+    return (a_bytes < b_bytes ? 1
+            : a_bytes > b_bytes ? -1
+            : strcmp(a->name, b->name));
+}
 
-    int rc = 0;
-    rc = netdev_get_kernel_stats(dev->linux_intf_name, &dev->stats);
-    if (rc < 0)
-    {
-        VLOG_ERR("Failed to get interface statistics for interface %s", dev->linux_intf_name);
-        return -1;
+/* Lists the rates of the interfaces, top talkers first by received plus sent
+ * bytes over the given horizon, 10s by default. */
+static void
+netdev_sim_unixctl_port_rates(struct unixctl_conn *conn, int argc,
+                              const char *argv[], void *aux OVS_UNUSED)
+{
+    struct ds ds = DS_EMPTY_INITIALIZER;
+    struct port_rates *ports = NULL;
+    size_t n_ports = 0, allocated = 0;
+    struct netdev_sim *dev;
+    int sort_horizon = 1;           /* 10s. */
+    size_t i;
+    int h;
+
+    if (argc > 1) {
+        for (h = 0; h < RATE_N_HORIZONS; h++) {
+            if (!strcmp(argv[1], rate_horizon_names[h])) {
+                break;
+            }
+        }
+        if (h == RATE_N_HORIZONS) {
+            unixctl_command_reply_error(conn, "horizon must be 1s, 10s or "
+                                        "60s");
+            return;
+        }
+        sort_horizon = h;
     }
 
-    /* If L3 stats are enabled fetch statistics from iptables*/
-    if (dev->l3_stats_enabled) {
-        rc = netdev_sim_get_kernel_l3_stats(dev->linux_intf_name, &dev->stats);
-        if (rc < 0) {
-            VLOG_ERR("Failed to get L3 interface statistics for interface %s", dev->linux_intf_name);
-            return -1;
+    ovs_mutex_lock(&sim_list_mutex);
+    LIST_FOR_EACH (dev, list_node, &sim_list) {
+        const struct netdev_sim_stats_snapshot *snap;
+
+        snap = ovsrcu_get(struct netdev_sim_stats_snapshot *,
+                          &dev->sb.snapshot);
+        if (snap) {
+            if (n_ports >= allocated) {
+                ports = x2nrealloc(ports, &allocated, sizeof *ports);
+            }
+            ports[n_ports].name = xstrdup(dev->up.name);
+            ports[n_ports].rates = snap->rates;
+            n_ports++;
         }
     }
+    ovs_mutex_unlock(&sim_list_mutex);
 
-    netdev_sim_update_sflow_stats(dev);
-    ovs_mutex_lock(&dev->mutex);
-    *stats = dev->stats;
-    ovs_mutex_unlock(&dev->mutex);
+    /* Only the main thread runs unixctl commands. */
+    port_rates_horizon = sort_horizon;
+    qsort(ports, n_ports, sizeof *ports, port_rates_compare);
+
+    ds_put_format(&ds, "%-16s %-7s %14s %14s %16s %16s\n", "interface",
+                  "horizon", "rx pps", "tx pps", "rx bps", "tx bps");
+    for (i = 0; i < n_ports; i++) {
+        const struct netdev_sim_rates *r = &ports[i].rates;
+
+        for (h = 0; h < RATE_N_HORIZONS; h++) {
+            ds_put_format(&ds, "%-16s %-7s %14"PRIu64" %14"PRIu64
+                          " %16"PRIu64" %16"PRIu64"\n",
+                          h ? "" : ports[i].name, rate_horizon_names[h],
+                          r->rate[RATE_RX_PACKETS][h] >> RATE_FRAC_BITS,
+                          r->rate[RATE_TX_PACKETS][h] >> RATE_FRAC_BITS,
+                          (r->rate[RATE_RX_BYTES][h] * 8) >> RATE_FRAC_BITS,
+                          (r->rate[RATE_TX_BYTES][h] * 8) >> RATE_FRAC_BITS);
+        }
+        free(ports[i].name);
+    }
+    free(ports);
 
-    return 0;
+    unixctl_command_reply(conn, ds_cstr(&ds));
+    ds_destroy(&ds);
 }
 
 static int
@@ -539,11 +1634,22 @@ netdev_sim_get_features(const struct netdev *netdev_,
                         enum netdev_features *peer)
 {
     struct netdev_sim *netdev = netdev_sim_cast(netdev_);
+    bool autoneg, pause_rx, pause_tx;
 
     ovs_mutex_lock(&netdev->mutex);
 
     *current = 0;
 
+    /* Prefer what the driver of the kernel interface reported for the
+     * configuration, where it supports it. */
+    autoneg = netdev->autoneg;
+    pause_rx = netdev->pause_rx;
+    pause_tx = netdev->pause_tx;
+    if (netdev->hw_enable) {
+        sim_link_get_autoneg(netdev->up.name, &autoneg);
+        sim_link_get_pause(netdev->up.name, &pause_rx, &pause_tx);
+    }
+
     /* Current settings. */
     if (netdev->link_speed == SPEED_10) {
         *current |= NETDEV_F_10MB_FD;
@@ -559,16 +1665,16 @@ netdev_sim_get_features(const struct netdev *netdev_,
         *current |= NETDEV_F_100GB_FD;
     }
 
-    if (netdev->autoneg) {
+    if (autoneg) {
         *current |= NETDEV_F_AUTONEG;
     }
 
-    if (netdev->pause_tx && netdev->pause_rx) {
+    if (pause_tx && pause_rx) {
         *current |= NETDEV_F_PAUSE;
-    } else if (netdev->pause_rx) {
+    } else if (pause_rx) {
         *current |= NETDEV_F_PAUSE;
         *current |= NETDEV_F_PAUSE_ASYM;
-    } else if (netdev->pause_tx) {
+    } else if (pause_tx) {
         *current |= NETDEV_F_PAUSE_ASYM;
     }
 
@@ -618,7 +1724,7 @@ static const struct netdev_class sim_class = {
     "system",
     NULL,                       /* init */
     netdev_sim_run,
-    NULL,                       /* wait */
+    netdev_sim_wait,
 
     netdev_sim_alloc,
     netdev_sim_construct,
@@ -688,7 +1794,7 @@ static const struct netdev_class sim_internal_class = {
     "internal",
     NULL,                       /* init */
     netdev_sim_run,
-    NULL,                       /* wait */
+    netdev_sim_wait,
 
     netdev_sim_alloc,
     netdev_sim_construct,
@@ -758,7 +1864,7 @@ static const struct netdev_class sim_subinterface_class = {
     "vlansubint",
     NULL,                       /* init */
     netdev_sim_run,
-    NULL,                       /* wait */
+    netdev_sim_wait,
 
     netdev_sim_alloc,
     netdev_sim_construct,
@@ -828,7 +1934,7 @@ static const struct netdev_class sim_loopback_class = {
     "loopback",
     NULL,                       /* init */
     netdev_sim_run,
-    NULL,                       /* wait */
+    netdev_sim_wait,
 
     netdev_sim_alloc,
     netdev_sim_construct,
@@ -901,219 +2007,404 @@ netdev_sim_register(void)
     netdev_register_provider(&sim_internal_class);
     netdev_register_provider(&sim_subinterface_class);
     netdev_register_provider(&sim_loopback_class);
+
+    link_change_seq = seq_create();
+
+    unixctl_command_register("container/l3stats-queue", "", 0, 0,
+                             netdev_sim_unixctl_l3stats_queue, NULL);
+    unixctl_command_register("container/stats-collector", "[interval-msec]",
+                             0, 1, netdev_sim_unixctl_stats_collector, NULL);
+    unixctl_command_register("container/stats-benchmark", "[readers] [msec]",
+                             0, 2, netdev_sim_unixctl_stats_benchmark, NULL);
+    unixctl_command_register("container/port-rates", "[1s|10s|60s]", 0, 1,
+                             netdev_sim_unixctl_port_rates, NULL);
+    unixctl_command_register("container/link-shaping", "[on|off]", 0, 1,
+                             netdev_sim_unixctl_link_shaping, NULL);
 }
 
-static bool
-netdev_sim_l3stats_xtables_rule_installed(const char *if_name,
-                                          const char *xtables_cmd,
-                                          const char *chain,
-                                          const char *pkttype)
+/* L3 statistics rule updates.
+ *
+ * Making an interface L3 or L2 only records, in 'l3stats_pending', whether
+ * its L3 statistics rules should exist.  A single executor job, under
+ * L3STATS_EXEC_KEY, then takes every pending interface and updates their
+ * rules in one firewall transaction, so that configuring hundreds of
+ * interfaces at once costs a few batches instead of one job per interface.
+ * A new request for an interface replaces the pending one, so a create
+ * followed by a delete before the job runs leaves the rules untouched.  If
+ * the transaction fails, the job updates the interfaces one at a time, so a
+ * bad interface does not cost the rest of the batch its rules. */
+#define L3STATS_EXEC_KEY "l3stats"
+
+struct l3stats_request {
+    struct hmap_node hmap_node;     /* In 'l3stats_pending', by 'dev'. */
+    struct netdev_sim *dev;         /* Holds a reference. */
+    char name[IFNAMSIZ];            /* 'dev->linux_intf_name' when queued. */
+    bool enable;                    /* Whether the rules should exist. */
+    long long int requested;        /* time_msec() of the first request. */
+    int error;                      /* Update result, set by the job. */
+};
+
+/* A set of requests taken by one job. */
+struct l3stats_batch {
+    struct hmap requests;
+};
+
+static struct ovs_mutex l3stats_mutex = OVS_MUTEX_INITIALIZER;
+static struct hmap l3stats_pending OVS_GUARDED_BY(l3stats_mutex)
+    = HMAP_INITIALIZER(&l3stats_pending);
+static bool l3stats_job_queued OVS_GUARDED_BY(l3stats_mutex);
+
+/* Statistics for "container/l3stats-queue". */
+static unsigned long long int l3stats_n_requests OVS_GUARDED_BY(l3stats_mutex);
+static unsigned long long int l3stats_n_coalesced OVS_GUARDED_BY(l3stats_mutex);
+static unsigned long long int l3stats_n_batches OVS_GUARDED_BY(l3stats_mutex);
+static unsigned long long int l3stats_n_failed OVS_GUARDED_BY(l3stats_mutex);
+static unsigned long long int l3stats_n_dropped OVS_GUARDED_BY(l3stats_mutex);
+static unsigned long long int l3stats_n_updated OVS_GUARDED_BY(l3stats_mutex);
+static unsigned long long int l3stats_n_taken OVS_GUARDED_BY(l3stats_mutex);
+static long long int l3stats_total_msec OVS_GUARDED_BY(l3stats_mutex);
+static long long int l3stats_max_msec OVS_GUARDED_BY(l3stats_mutex);
+
+/* Updates the L3 statistics rules of the single interface of 'req'. */
+static int
+netdev_sim_l3stats_update_one(const struct l3stats_request *req)
 {
-    char cmd[256];
-    int rc = 0;
-    if (!strcmp(chain, "FORWARD")) {
-        snprintf(cmd, sizeof(cmd), "%s %s -C %s -i %s -m pkttype --pkt-type %s -w",
-                SWNS_EXEC, xtables_cmd, chain, if_name, pkttype);
-        rc = system(cmd);
-        if (rc != 0) {
-            return false;
-        }
-        snprintf(cmd, sizeof(cmd), "%s %s -C %s -o %s -m pkttype --pkt-type %s -w",
-                SWNS_EXEC, xtables_cmd, chain, if_name, pkttype);
-        rc = system(cmd);
-        if (rc != 0) {
-            return false;
+    struct svec ifs, none;
+    int error;
+
+    svec_init(&ifs);
+    svec_init(&none);
+    svec_add(&ifs, req->name);
+    error = (req->enable
+             ? sim_firewall()->l3stats_update(&ifs, &none)
+             : sim_firewall()->l3stats_update(&none, &ifs));
+    svec_destroy(&ifs);
+    svec_destroy(&none);
+    return error;
+}
+
+/* Updates the rules of every interface taken from 'l3stats_pending' in one
+ * firewall transaction.  If that transaction fails, the interfaces are
+ * updated one at a time, so that only the ones whose own update fails are
+ * left as they were.  Returns the number of such interfaces. */
+static int
+netdev_sim_l3stats_work(void *batch_)
+{
+    struct l3stats_batch *batch = batch_;
+    struct l3stats_request *req;
+    struct svec add_ifs, del_ifs;
+    size_t n_updated = 0;
+    int n_dropped = 0;
+    long long int now;
+    int error = 0;
+
+    ovs_mutex_lock(&l3stats_mutex);
+    hmap_swap(&batch->requests, &l3stats_pending);
+    l3stats_job_queued = false;
+    ovs_mutex_unlock(&l3stats_mutex);
+
+    svec_init(&add_ifs);
+    svec_init(&del_ifs);
+    HMAP_FOR_EACH (req, hmap_node, &batch->requests) {
+        struct netdev_sim *dev = req->dev;
+        bool enabled;
+
+        /* Only the jobs under L3STATS_EXEC_KEY, which run one at a time,
+         * change 'l3_stats_enabled'. */
+        atomic_read_relaxed(&dev->sb.l3_stats_enabled, &enabled);
+        if (req->enable != enabled) {
+            svec_add(req->enable ? &add_ifs : &del_ifs, req->name);
         }
-        return true;
     }
 
-    char filter = !strcmp(chain, "INPUT") ? 'i' : 'o';
-    snprintf(cmd, sizeof(cmd), "%s %s -C %s -%c %s -m pkttype --pkt-type %s -w",
-            SWNS_EXEC, xtables_cmd, chain, filter, if_name, pkttype);
-    rc = system(cmd);
-    if (rc != 0) {
-        return false;
+    if (add_ifs.n || del_ifs.n) {
+        error = sim_firewall()->l3stats_update(&add_ifs, &del_ifs);
     }
-    return true;
-}
 
-static int
-netdev_sim_l3stats_add_rule(const char *if_name, const char *xtables_cmd,
-                            const char *chain, const char *pkttype)
-{
-    char cmd[256];
-    int rc = 0;
+    now = time_msec();
+    HMAP_FOR_EACH (req, hmap_node, &batch->requests) {
+        struct netdev_sim *dev = req->dev;
+        bool enabled;
 
-    if (!strcmp(chain, "FORWARD")) {
-        if (!netdev_sim_l3stats_xtables_rule_installed(if_name,
-                                                       xtables_cmd, chain,
-                                                       pkttype)) {
-            snprintf(cmd, sizeof(cmd), "%s %s -A %s -i %s -m pkttype --pkt-type %s -w",
-                    SWNS_EXEC, xtables_cmd, chain, if_name, pkttype);
-            rc = system(cmd);
-            if (rc != 0) {
-                VLOG_DBG("Failed to execute - %s (rc=%d)", cmd, rc);
+        atomic_read_relaxed(&dev->sb.l3_stats_enabled, &enabled);
+        if (req->enable != enabled) {
+            req->error = error;
+            if (error && add_ifs.n + del_ifs.n > 1) {
+                req->error = netdev_sim_l3stats_update_one(req);
             }
-            snprintf(cmd, sizeof(cmd), "%s %s -A %s -o %s -m pkttype --pkt-type %s -w",
-                    SWNS_EXEC, xtables_cmd, chain, if_name, pkttype);
-            rc = system(cmd);
-            if (rc != 0) {
-                VLOG_DBG("Failed to execute - %s (rc=%d)", cmd, rc);
+            if (req->error) {
+                n_dropped++;
+            } else {
+                atomic_store_relaxed(&dev->sb.l3_stats_enabled, req->enable);
+                n_updated++;
             }
         }
-        return rc;
-    }
 
-    char filter = !strcmp(chain, "INPUT") ? 'i' : 'o';
+        ovs_mutex_lock(&l3stats_mutex);
+        l3stats_n_taken++;
+        l3stats_total_msec += now - req->requested;
+        l3stats_max_msec = MAX(l3stats_max_msec, now - req->requested);
+        ovs_mutex_unlock(&l3stats_mutex);
+    }
 
-    /* Add rule if it does not exist */
-    if (!netdev_sim_l3stats_xtables_rule_installed(if_name,
-                                                   xtables_cmd, chain,
-                                                   pkttype)) {
-        snprintf(cmd, sizeof(cmd), "%s %s -A %s -%c %s -m pkttype --pkt-type %s -w",
-                SWNS_EXEC, xtables_cmd, chain, filter, if_name, pkttype);
-        rc = system(cmd);
-        if (rc != 0) {
-            VLOG_DBG("Failed to execute - %s (rc=%d)", cmd, rc);
-        }
+    ovs_mutex_lock(&l3stats_mutex);
+    l3stats_n_batches++;
+    if (error) {
+        l3stats_n_failed++;
     }
-    return rc;
+    l3stats_n_updated += n_updated;
+    l3stats_n_dropped += n_dropped;
+    ovs_mutex_unlock(&l3stats_mutex);
+
+    svec_destroy(&add_ifs);
+    svec_destroy(&del_ifs);
+    return n_dropped;
 }
 
-static int
-netdev_sim_l3stats_delete_rule(const char *if_name, const char *xtables_cmd,
-                               const char *chain, const char *pkttype)
+/* Logs the interfaces of 'batch' whose rules could not be updated and drops
+ * the references that its requests hold. */
+static void
+netdev_sim_l3stats_done(int n_dropped OVS_UNUSED, void *batch_)
 {
-    char cmd[256];
-    int rc = 0;
-
-    if (!strcmp(chain, "FORWARD")) {
-        if (netdev_sim_l3stats_xtables_rule_installed(if_name,
-                                                      xtables_cmd,
-                                                      chain, pkttype)) {
-            snprintf(cmd, sizeof(cmd), "%s %s -D %s -i %s -m pkttype --pkt-type %s -w",
-                    SWNS_EXEC, xtables_cmd, chain, if_name, pkttype);
-            rc = system(cmd);
-            if (rc != 0) {
-                VLOG_DBG("Failed to execute - %s (rc=%d)", cmd, rc);
-            }
-            snprintf(cmd, sizeof(cmd), "%s %s -D %s -o %s -m pkttype --pkt-type %s -w",
-                    SWNS_EXEC, xtables_cmd, chain, if_name, pkttype);
-            rc = system(cmd);
-            if (rc != 0) {
-                VLOG_DBG("Failed to execute - %s (rc=%d)", cmd, rc);
-            }
-        }
-        return rc;
-    }
-    char filter = !strcmp(chain, "INPUT") ? 'i' : 'o';
-
-    /* Delete rule if it exists */
-    if (netdev_sim_l3stats_xtables_rule_installed(if_name, xtables_cmd,
-                                                  chain, pkttype)) {
-        snprintf(cmd, sizeof(cmd), "%s %s -D %s -%c %s -m pkttype --pkt-type %s -w",
-                SWNS_EXEC, xtables_cmd, chain, filter, if_name, pkttype);
-        rc = system(cmd);
-        if (rc != 0) {
-            VLOG_DBG("Failed to execute - %s (rc=%d)", cmd, rc);
+    struct l3stats_batch *batch = batch_;
+    struct l3stats_request *req, *next;
+
+    HMAP_FOR_EACH_SAFE (req, next, hmap_node, &batch->requests) {
+        if (req->error) {
+            VLOG_WARN("Failed to %s the L3 statistics rules of %s. %s",
+                      req->enable ? "create" : "delete",
+                      req->name, ovs_strerror(req->error));
         }
+        hmap_remove(&batch->requests, &req->hmap_node);
+        netdev_close(&req->dev->up);
+        free(req);
     }
-    return rc;
+    hmap_destroy(&batch->requests);
+    free(batch);
 }
 
+/* Queues an update of the L3 statistics rules of 'netdev'.  Its name is
+ * copied now, under its mutex, since the job runs on an executor thread. */
 static void
-*netdev_sim_xtables_rule_create_(void *netdev)
+netdev_sim_l3stats_request(struct netdev *netdev, bool enable)
 {
-    struct netdev_sim *dev = netdev_sim_cast((struct netdev*)netdev);
+    struct netdev_sim *dev = netdev_sim_cast(netdev);
+    struct l3stats_request *req;
+    char name[IFNAMSIZ];
+    bool submit = false;
 
-    ovs_mutex_lock(&dev->l3_stats_mutex);
+    ovs_mutex_lock(&dev->mutex);
+    ovs_strlcpy(name, dev->linux_intf_name, sizeof name);
+    ovs_mutex_unlock(&dev->mutex);
 
-    if (dev->l3_stats_enabled) {
-        return NULL;
+    ovs_mutex_lock(&l3stats_mutex);
+    l3stats_n_requests++;
+    HMAP_FOR_EACH_WITH_HASH (req, hmap_node, hash_pointer(dev, 0),
+                             &l3stats_pending) {
+        if (req->dev == dev) {
+            break;
+        }
     }
+    if (req) {
+        l3stats_n_coalesced++;
+    } else {
+        req = xmalloc(sizeof *req);
+        req->dev = dev;
+        req->requested = time_msec();
+        req->error = 0;
+        netdev_ref(netdev);
+        hmap_insert(&l3stats_pending, &req->hmap_node, hash_pointer(dev, 0));
+    }
+    ovs_strlcpy(req->name, name, sizeof req->name);
+    req->enable = enable;
+    if (!l3stats_job_queued) {
+        l3stats_job_queued = true;
+        submit = true;
+    }
+    ovs_mutex_unlock(&l3stats_mutex);
 
-    netdev_sim_l3stats_add_rule(dev->linux_intf_name, "iptables", "INPUT", "unicast");
-    netdev_sim_l3stats_add_rule(dev->linux_intf_name, "iptables", "INPUT", "multicast");
-    netdev_sim_l3stats_add_rule(dev->linux_intf_name, "ip6tables", "INPUT", "unicast");
-    netdev_sim_l3stats_add_rule(dev->linux_intf_name, "ip6tables", "INPUT", "multicast");
-    netdev_sim_l3stats_add_rule(dev->linux_intf_name, "iptables", "OUTPUT", "unicast");
-    netdev_sim_l3stats_add_rule(dev->linux_intf_name, "iptables", "OUTPUT", "multicast");
-    netdev_sim_l3stats_add_rule(dev->linux_intf_name, "ip6tables", "OUTPUT", "unicast");
-    netdev_sim_l3stats_add_rule(dev->linux_intf_name, "ip6tables", "OUTPUT", "multicast");
-
-    netdev_sim_l3stats_add_rule(dev->linux_intf_name, "iptables", "FORWARD", "unicast");
-    netdev_sim_l3stats_add_rule(dev->linux_intf_name, "iptables", "FORWARD", "multicast");
-    netdev_sim_l3stats_add_rule(dev->linux_intf_name, "ip6tables", "FORWARD", "unicast");
-    netdev_sim_l3stats_add_rule(dev->linux_intf_name, "ip6tables", "FORWARD", "multicast");
-
-    dev->l3_stats_enabled = true;
+    if (submit) {
+        struct l3stats_batch *batch = xmalloc(sizeof *batch);
 
-    ovs_mutex_unlock(&dev->l3_stats_mutex);
+        hmap_init(&batch->requests);
+        sim_exec_submit(L3STATS_EXEC_KEY, netdev_sim_l3stats_work,
+                        netdev_sim_l3stats_done, batch);
+    }
 }
 
-
 void
 netdev_sim_l3stats_xtables_rules_create(struct netdev *netdev)
 {
-    struct netdev_sim *dev = netdev_sim_cast(netdev);
-    pthread_t iptables_install_thread;
-    pthread_attr_t attr;
+    netdev_sim_l3stats_request(netdev, true);
+}
 
-    pthread_attr_init(&attr);
-    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
-    pthread_create(&iptables_install_thread,
-                   &attr, netdev_sim_xtables_rule_create_, netdev);
+void
+netdev_sim_l3stats_xtables_rules_delete(struct netdev *netdev)
+{
+    netdev_sim_l3stats_request(netdev, false);
 }
 
 static void
-*netdev_sim_xtables_rule_delete_(void *netdev)
+netdev_sim_unixctl_l3stats_queue(struct unixctl_conn *conn,
+                                 int argc OVS_UNUSED,
+                                 const char *argv[] OVS_UNUSED,
+                                 void *aux OVS_UNUSED)
 {
-    struct netdev_sim *dev = netdev_sim_cast((struct netdev*)netdev);
+    struct ds ds = DS_EMPTY_INITIALIZER;
+
+    ovs_mutex_lock(&l3stats_mutex);
+    ds_put_format(&ds, "pending interfaces: %"PRIuSIZE"\n",
+                  hmap_count(&l3stats_pending));
+    ds_put_format(&ds, "requests: %llu (%llu coalesced)\n",
+                  l3stats_n_requests, l3stats_n_coalesced);
+    ds_put_format(&ds, "batches: %llu (%llu retried per interface)\n",
+                  l3stats_n_batches, l3stats_n_failed);
+    ds_put_format(&ds, "interfaces updated: %llu (%llu failed)\n",
+                  l3stats_n_updated, l3stats_n_dropped);
+    ds_put_format(&ds, "latency: avg %lld msec, max %lld msec\n",
+                  (l3stats_n_taken
+                   ? l3stats_total_msec / (long long int) l3stats_n_taken
+                   : 0),
+                  l3stats_max_msec);
+    ovs_mutex_unlock(&l3stats_mutex);
+
+    unixctl_command_reply(conn, ds_cstr(&ds));
+    ds_destroy(&ds);
+}
 
-    ovs_mutex_lock(&dev->l3_stats_mutex);
+/* Link statistics of every interface in the switch namespace, indexed by
+ * ifindex.  The stats collector refreshes them once per pass by a single dump
+ * of all the interfaces, so that the statistics of all the interfaces cost
+ * one round trip to the kernel.
+ *
+ * The counters are 64-bit.  They come from RTM_GETSTATS, restricted to
+ * IFLA_STATS_LINK_64, where the kernel supports it, otherwise from the
+ * IFLA_STATS64 attribute of an RTM_GETLINK dump.  If the kernel reports only
+ * the 32-bit IFLA_STATS, the counters are extended to 64 bits by adding the
+ * difference, modulo 2**32, from the previous dump. */
+struct kernel_link_stats {
+    struct hmap_node hmap_node;     /* In 'kernel_stats_cache', by ifindex. */
+    int ifindex;
+    unsigned int dump_seq;          /* Last dump that reported the link. */
+    struct rtnl_link_stats64 stats;
+
+    /* Last 32-bit counters, if the kernel reports only those. */
+    bool has_stats32;
+    struct rtnl_link_stats stats32;
+};
+
+static struct ovs_mutex kernel_stats_mutex = OVS_MUTEX_INITIALIZER;
+static struct hmap kernel_stats_cache OVS_GUARDED_BY(kernel_stats_mutex)
+    = HMAP_INITIALIZER(&kernel_stats_cache);
+static unsigned int kernel_stats_dump_seq OVS_GUARDED_BY(kernel_stats_mutex);
+static bool kernel_stats_valid OVS_GUARDED_BY(kernel_stats_mutex);
+static bool kernel_queue_stats_valid OVS_GUARDED_BY(kernel_stats_mutex);
+static bool kernel_stats_no_getstats;   /* RTM_GETSTATS is not supported. */
+
+static struct kernel_link_stats *
+kernel_link_stats_lookup(int ifindex)
+    OVS_REQUIRES(kernel_stats_mutex)
+{
+    struct kernel_link_stats *link;
 
-    if (!dev->l3_stats_enabled) {
-        return NULL;
+    HMAP_FOR_EACH_WITH_HASH (link, hmap_node, hash_int(ifindex, 0),
+                             &kernel_stats_cache) {
+        if (link->ifindex == ifindex) {
+            return link;
+        }
     }
+    return NULL;
+}
 
-    netdev_sim_l3stats_delete_rule(dev->linux_intf_name, "iptables", "INPUT", "unicast");
-    netdev_sim_l3stats_delete_rule(dev->linux_intf_name, "iptables", "INPUT", "multicast");
-    netdev_sim_l3stats_delete_rule(dev->linux_intf_name, "ip6tables", "INPUT", "unicast");
-    netdev_sim_l3stats_delete_rule(dev->linux_intf_name, "ip6tables", "INPUT", "multicast");
-    netdev_sim_l3stats_delete_rule(dev->linux_intf_name, "iptables", "OUTPUT", "unicast");
-    netdev_sim_l3stats_delete_rule(dev->linux_intf_name, "iptables", "OUTPUT", "multicast");
-    netdev_sim_l3stats_delete_rule(dev->linux_intf_name, "ip6tables", "OUTPUT", "unicast");
-    netdev_sim_l3stats_delete_rule(dev->linux_intf_name, "ip6tables", "OUTPUT", "multicast");
+static struct kernel_link_stats *
+kernel_link_stats_get(int ifindex)
+    OVS_REQUIRES(kernel_stats_mutex)
+{
+    struct kernel_link_stats *link = kernel_link_stats_lookup(ifindex);
 
-    netdev_sim_l3stats_delete_rule(dev->linux_intf_name, "iptables", "FORWARD", "unicast");
-    netdev_sim_l3stats_delete_rule(dev->linux_intf_name, "iptables", "FORWARD", "multicast");
-    netdev_sim_l3stats_delete_rule(dev->linux_intf_name, "ip6tables", "FORWARD", "unicast");
-    netdev_sim_l3stats_delete_rule(dev->linux_intf_name, "ip6tables", "FORWARD", "multicast");
+    if (!link) {
+        link = xzalloc(sizeof *link);
+        link->ifindex = ifindex;
+        hmap_insert(&kernel_stats_cache, &link->hmap_node,
+                    hash_int(ifindex, 0));
+    }
+    link->dump_seq = kernel_stats_dump_seq;
+    return link;
+}
 
-    dev->l3_stats_enabled = false;
+static void
+kernel_link_stats_update64(int ifindex, const struct rtattr *attribute)
+    OVS_REQUIRES(kernel_stats_mutex)
+{
+    struct kernel_link_stats *link = kernel_link_stats_get(ifindex);
 
-    ovs_mutex_unlock(&dev->l3_stats_mutex);
+    /* Netlink attributes are only 4-byte aligned. */
+    memcpy(&link->stats, RTA_DATA(attribute),
+           MIN(sizeof link->stats, RTA_PAYLOAD(attribute)));
+    link->has_stats32 = false;
 }
 
-void
-netdev_sim_l3stats_xtables_rules_delete(struct netdev *netdev)
+/* Returns 'prev64' advanced by the increase of a 32-bit counter from
+ * 'prev32' to 'cur32', allowing for one wrap in between. */
+static uint64_t
+kernel_stats_extend32(uint64_t prev64, uint32_t prev32, uint32_t cur32)
 {
-    struct netdev_sim *dev = netdev_sim_cast(netdev);
-    pthread_t iptables_uninstall_thread;
-    pthread_attr_t attr;
+    return prev64 + (uint32_t) (cur32 - prev32);
+}
 
-    pthread_attr_init(&attr);
-    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
-    pthread_create(&iptables_uninstall_thread,
-                   &attr, netdev_sim_xtables_rule_delete_, netdev);
+static void
+kernel_link_stats_update32(int ifindex, const struct rtattr *attribute)
+    OVS_REQUIRES(kernel_stats_mutex)
+{
+    struct kernel_link_stats *link = kernel_link_stats_get(ifindex);
+    struct rtnl_link_stats64 *acc = &link->stats;
+    const struct rtnl_link_stats *old = &link->stats32;
+    struct rtnl_link_stats s;
+
+    memset(&s, 0, sizeof s);
+    memcpy(&s, RTA_DATA(attribute), MIN(sizeof s, RTA_PAYLOAD(attribute)));
+
+    if (!link->has_stats32) {
+        memset(acc, 0, sizeof *acc);
+        acc->rx_packets = s.rx_packets;
+        acc->tx_packets = s.tx_packets;
+        acc->rx_bytes = s.rx_bytes;
+        acc->tx_bytes = s.tx_bytes;
+        acc->rx_errors = s.rx_errors;
+        acc->tx_errors = s.tx_errors;
+        acc->rx_dropped = s.rx_dropped;
+        acc->tx_dropped = s.tx_dropped;
+        acc->multicast = s.multicast;
+        acc->collisions = s.collisions;
+        acc->rx_crc_errors = s.rx_crc_errors;
+    } else {
+#define EXTEND32(FIELD) \
+        acc->FIELD = kernel_stats_extend32(acc->FIELD, old->FIELD, s.FIELD)
+        EXTEND32(rx_packets);
+        EXTEND32(tx_packets);
+        EXTEND32(rx_bytes);
+        EXTEND32(tx_bytes);
+        EXTEND32(rx_errors);
+        EXTEND32(tx_errors);
+        EXTEND32(rx_dropped);
+        EXTEND32(tx_dropped);
+        EXTEND32(multicast);
+        EXTEND32(collisions);
+        EXTEND32(rx_crc_errors);
+#undef EXTEND32
+    }
+    link->stats32 = s;
+    link->has_stats32 = true;
 }
 
+/* Updates the cache from an RTM_NEWLINK message. */
 static void
-netdev_parse_netlink_msg(struct nlmsghdr *h, struct netdev_stats *stats)
+netdev_parse_link_msg(struct nlmsghdr *h)
+    OVS_REQUIRES(kernel_stats_mutex)
 {
+    const struct rtattr *stats64 = NULL, *stats32 = NULL;
     struct ifinfomsg *iface;
     struct rtattr *attribute;
-    struct rtnl_link_stats *s;
     int len;
 
     iface = NLMSG_DATA(h);
@@ -1121,261 +2412,522 @@ netdev_parse_netlink_msg(struct nlmsghdr *h, struct netdev_stats *stats)
     for (attribute = IFLA_RTA(iface); RTA_OK(attribute, len);
          attribute = RTA_NEXT(attribute, len)) {
         switch(attribute->rta_type) {
+        case IFLA_STATS64:
+            stats64 = attribute;
+            break;
         case IFLA_STATS:
-            s = (struct rtnl_link_stats *) RTA_DATA(attribute);
-            stats->rx_packets = s->rx_packets;
-            stats->tx_packets = s->tx_packets;
-            stats->rx_bytes = s->rx_bytes;
-            stats->tx_bytes = s->tx_bytes;
-            stats->rx_errors = s->rx_errors;
-            stats->tx_errors = s->tx_errors;
-            stats->rx_dropped = s->rx_dropped;
-            stats->tx_dropped = s->tx_dropped;
-            stats->multicast = s->multicast;
-            stats->collisions = s->collisions;
-            stats->rx_crc_errors = s->rx_crc_errors;
+            stats32 = attribute;
             break;
         default:
             break;
         }
     }
+
+    if (stats64) {
+        kernel_link_stats_update64(iface->ifi_index, stats64);
+    } else if (stats32) {
+        kernel_link_stats_update32(iface->ifi_index, stats32);
+    }
+}
+
+#ifdef RTM_GETSTATS
+/* Updates the cache from an RTM_NEWSTATS message. */
+static void
+netdev_parse_stats_msg(struct nlmsghdr *h)
+    OVS_REQUIRES(kernel_stats_mutex)
+{
+    struct if_stats_msg *ifsm = NLMSG_DATA(h);
+    struct rtattr *attribute;
+    int len;
+
+    attribute = (struct rtattr *) ((char *) ifsm
+                                   + NLMSG_ALIGN(sizeof *ifsm));
+    len = h->nlmsg_len - NLMSG_LENGTH(sizeof *ifsm);
+    for (; RTA_OK(attribute, len); attribute = RTA_NEXT(attribute, len)) {
+        if (attribute->rta_type == IFLA_STATS_LINK_64) {
+            kernel_link_stats_update64(ifsm->ifindex, attribute);
+        }
+    }
 }
+#endif
 
+/* Sends a dump request of 'type' with 'payload' on the swns rtnetlink
+ * socket and passes every reply message of that type to 'parse'.  Returns 0
+ * if successful, otherwise a positive errno value. */
 static int
-netdev_get_kernel_stats(const char *if_name, struct netdev_stats *stats)
+netdev_rtnl_dump(uint16_t type, const void *payload, size_t payload_len,
+                 uint16_t reply_type, void (*parse)(struct nlmsghdr *))
+    OVS_REQUIRES(kernel_stats_mutex)
 {
-    int sock;
-    struct sockaddr_nl s_addr;
+    static char buffer[32768];
+    int sock = sim_swns_rtnl_sock();
     struct {
         struct nlmsghdr hdr;
-        struct ifinfomsg iface;
+        char payload[64];
     } req;
     struct sockaddr_nl kernel;
-    struct msghdr rtnl_msg;
-    struct iovec io;
+    unsigned int seq;
 
-    memset (&req, 0, sizeof(req));
-    memset (&kernel, 0, sizeof(kernel));
-    memset (&rtnl_msg, 0, sizeof(rtnl_msg));
+    if (sock < 0) {
+        return EBADF;
+    }
+
+    ovs_assert(payload_len <= sizeof req.payload);
+    memset(&req, 0, sizeof(req));
+    memset(&kernel, 0, sizeof(kernel));
     kernel.nl_family = AF_NETLINK;
 
-    req.hdr.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifinfomsg));
-    req.hdr.nlmsg_flags = NLM_F_REQUEST;
-    req.hdr.nlmsg_type = RTM_GETLINK;
+    seq = sim_swns_rtnl_next_seq();
+    req.hdr.nlmsg_len = NLMSG_LENGTH(payload_len);
+    req.hdr.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    req.hdr.nlmsg_type = type;
+    req.hdr.nlmsg_seq = seq;
+    memcpy(req.payload, payload, payload_len);
+
+    if (sendto(sock, &req, req.hdr.nlmsg_len, 0,
+               (struct sockaddr *) &kernel, sizeof kernel) < 0) {
+        VLOG_ERR("Sendmsg failed during netlink request for statistics (%s)",
+                 ovs_strerror(errno));
+        return errno;
+    }
 
-    req.iface.ifi_family = AF_UNSPEC;
-    req.iface.ifi_type = IFLA_UNSPEC;
-    req.iface.ifi_flags = 0;
-    req.iface.ifi_change = 0xffffffff;
-    req.iface.ifi_index = if_nametoindex(if_name);
+    /* Read the reply, which spans several messages, up to NLMSG_DONE. */
+    for (;;) {
+        struct nlmsghdr *nlh;
+        ssize_t ret;
 
-    sock = socket(AF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
+        ret = recv(sock, buffer, sizeof buffer, 0);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            VLOG_ERR("Reply error during netlink request for statistics (%s)",
+                     ovs_strerror(errno));
+            return errno;
+        }
 
-    if (sock < 0) {
-        VLOG_ERR("Netlink socket creation failed during netlink \
-                request for statistics (%s)",strerror(errno));
-        return -1;
-    }
+        for (nlh = (struct nlmsghdr *) buffer;
+             NLMSG_OK(nlh, ret);
+             nlh = NLMSG_NEXT(nlh, ret)) {
+            if (nlh->nlmsg_seq != seq) {
+                /* Left over from an earlier request. */
+                continue;
+            }
 
-    memset((void *) &s_addr, 0, sizeof(s_addr));
-    s_addr.nl_family = AF_NETLINK;
-    s_addr.nl_pid = getpid();
-    s_addr.nl_groups = 0;
+            if (nlh->nlmsg_type == reply_type) {
+                parse(nlh);
+            } else if (nlh->nlmsg_type == NLMSG_DONE) {
+                return 0;
+            } else if (nlh->nlmsg_type == NLMSG_ERROR) {
+                const struct nlmsgerr *err = NLMSG_DATA(nlh);
 
-    if (bind(sock, (struct sockaddr *) &s_addr, sizeof(s_addr)) < 0) {
-        VLOG_ERR("Socket bind failed during netlink \
-                request for statistics");
-        close(sock);
-        return -1;
+                return err->error ? -err->error : EPROTO;
+            }
+        }
     }
+}
 
-    io.iov_base = &req;
-    io.iov_len = req.hdr.nlmsg_len;
-    rtnl_msg.msg_name = &kernel;
-    rtnl_msg.msg_namelen = sizeof(kernel);
-    rtnl_msg.msg_iov = &io;
-    rtnl_msg.msg_iovlen = 1;
-
-    if (sendmsg(sock, (struct msghdr *) &rtnl_msg, 0) == -1) {
-        VLOG_ERR("Sendmsg failed during netlink \
-                request for statistics");
-        close(sock);
-        return -1;
+/* Refreshes 'kernel_stats_cache'.  Runs on the swns thread, over its
+ * persistent rtnetlink socket, while the caller holds kernel_stats_mutex. */
+static int
+netdev_dump_kernel_stats__(void *aux OVS_UNUSED)
+    OVS_NO_THREAD_SAFETY_ANALYSIS
+{
+    struct kernel_link_stats *link, *next;
+    struct rtgenmsg gen;
+    int error;
+
+    kernel_stats_dump_seq++;
+
+#ifdef RTM_GETSTATS
+    if (!kernel_stats_no_getstats) {
+        struct if_stats_msg ifsm;
+
+        memset(&ifsm, 0, sizeof ifsm);
+        ifsm.family = AF_UNSPEC;
+        ifsm.filter_mask = IFLA_STATS_FILTER_BIT(IFLA_STATS_LINK_64);
+        error = netdev_rtnl_dump(RTM_GETSTATS, &ifsm, sizeof ifsm,
+                                 RTM_NEWSTATS, netdev_parse_stats_msg);
+        if (error != EINVAL && error != EOPNOTSUPP) {
+            goto out;
+        }
+        VLOG_INFO("RTM_GETSTATS is not supported, "
+                  "reading link statistics with RTM_GETLINK");
+        kernel_stats_no_getstats = true;
     }
+#endif
+
+    memset(&gen, 0, sizeof gen);
+    gen.rtgen_family = AF_UNSPEC;
+    error = netdev_rtnl_dump(RTM_GETLINK, &gen, sizeof gen,
+                             RTM_NEWLINK, netdev_parse_link_msg);
+
+#ifdef RTM_GETSTATS
+out:
+#endif
+    if (!error) {
+        /* Forget the links that are gone. */
+        HMAP_FOR_EACH_SAFE (link, next, hmap_node, &kernel_stats_cache) {
+            if (link->dump_seq != kernel_stats_dump_seq) {
+                hmap_remove(&kernel_stats_cache, &link->hmap_node);
+                free(link);
+            }
+        }
+    }
+    return error;
+}
 
-    /* Prepare for reply from the kernel */
-    bool multipart_msg_end = false;
-
-    while (!multipart_msg_end) {
-        struct sockaddr_nl nladdr;
-        struct msghdr msg;
-        struct iovec iov;
-        struct nlmsghdr *nlh;
-        char buffer[4096];
-        int ret;
+/* Transmit statistics of the queues of every interface in the switch
+ * namespace, indexed by ifindex, refreshed along with the link statistics by
+ * a single RTM_GETQDISC dump.
+ *
+ * Each enabled "system" interface gets a "prio" qdisc with handle
+ * QDISC_PRIO_HANDLE and NUM_QUEUES bands, at the root or below the shaper
+ * (see sim-link.c).  Band 0 is served first, so queue 'q', for local
+ * priority 'q', is band NUM_QUEUES - 1 - q, and its counters are those of the
+ * child qdisc of that band, whose parent is the class
+ * QDISC_PRIO_HANDLE:band+1.  The child qdiscs are only reported when the dump
+ * asks for them with TCA_DUMP_INVISIBLE on recent kernels.
+ *
+ * The drops of the root qdisc, which include those of its children, are the
+ * packets dropped by the queues and the shaper, which the link statistics do
+ * not count. */
+#define QDISC_PRIO_HANDLE 0x10000   /* "1:" */
+
+struct kernel_queue_stats {
+    struct hmap_node hmap_node;     /* In 'kernel_queue_cache', by ifindex. */
+    int ifindex;
+    unsigned int dump_seq;          /* Last dump that reported a qdisc. */
+    bool has_queues;                /* Some band was reported. */
+    struct netdev_queue_stats queues[NUM_QUEUES];
+    uint64_t qdisc_drops;           /* Drops of the root qdisc. */
+};
 
-        iov.iov_base = (void *)buffer;
-        iov.iov_len = sizeof(buffer);
-        msg.msg_name = (void *)&(nladdr);
-        msg.msg_namelen = sizeof(nladdr);
-        msg.msg_iov = &iov;
-        msg.msg_iovlen = 1;
+static struct hmap kernel_queue_cache OVS_GUARDED_BY(kernel_stats_mutex)
+    = HMAP_INITIALIZER(&kernel_queue_cache);
 
-        ret = recvmsg(sock, &msg, 0);
+static struct kernel_queue_stats *
+kernel_queue_stats_lookup(int ifindex)
+    OVS_REQUIRES(kernel_stats_mutex)
+{
+    struct kernel_queue_stats *kq;
 
-        if (ret < 0) {
-            VLOG_ERR("Reply error during netlink \
-                     request for statistics\n");
-            close(sock);
-            return -1;
+    HMAP_FOR_EACH_WITH_HASH (kq, hmap_node, hash_int(ifindex, 0),
+                             &kernel_queue_cache) {
+        if (kq->ifindex == ifindex) {
+            return kq;
         }
+    }
+    return NULL;
+}
 
-        nlh = (struct nlmsghdr*) buffer;
-
-        for (nlh = (struct nlmsghdr *) buffer;
-             NLMSG_OK(nlh, ret);
-             nlh = NLMSG_NEXT(nlh, ret)) {
-            switch(nlh->nlmsg_type) {
-            case RTM_NEWLINK:
-                netdev_parse_netlink_msg(nlh, stats);
-                break;
+/* Updates the cache from an RTM_NEWQDISC message. */
+static void
+netdev_parse_qdisc_msg(struct nlmsghdr *h)
+    OVS_REQUIRES(kernel_stats_mutex)
+{
+    const struct gnet_stats_basic *basic = NULL;
+    const struct gnet_stats_queue *queue = NULL;
+    const struct rtattr *pkt64 = NULL;
+    struct netdev_queue_stats *qs;
+    struct kernel_queue_stats *kq;
+    struct tcmsg *tcm = NLMSG_DATA(h);
+    struct rtattr *attribute;
+    unsigned int band;
+    int len;
 
-            case NLMSG_DONE:
-                multipart_msg_end = true;
-                break;
+    if (tcm->tcm_parent == TC_H_ROOT) {
+        band = NUM_QUEUES;
+    } else if (TC_H_MAJ(tcm->tcm_parent) == QDISC_PRIO_HANDLE) {
+        band = TC_H_MIN(tcm->tcm_parent) - 1;
+        if (band >= NUM_QUEUES) {
+            return;
+        }
+    } else {
+        return;
+    }
 
-            default:
-                break;
+    len = h->nlmsg_len - NLMSG_LENGTH(sizeof *tcm);
+    for (attribute = TCA_RTA(tcm); RTA_OK(attribute, len);
+         attribute = RTA_NEXT(attribute, len)) {
+        if (attribute->rta_type == TCA_STATS2) {
+            struct rtattr *nested = RTA_DATA(attribute);
+            int nested_len = RTA_PAYLOAD(attribute);
+
+            for (; RTA_OK(nested, nested_len);
+                 nested = RTA_NEXT(nested, nested_len)) {
+                if (nested->rta_type == TCA_STATS_BASIC
+                    && RTA_PAYLOAD(nested) >= sizeof *basic) {
+                    basic = RTA_DATA(nested);
+                } else if (nested->rta_type == TCA_STATS_QUEUE
+                           && RTA_PAYLOAD(nested) >= sizeof *queue) {
+                    queue = RTA_DATA(nested);
+#ifdef TCA_STATS_PKT64
+                } else if (nested->rta_type == TCA_STATS_PKT64
+                           && RTA_PAYLOAD(nested) >= sizeof(uint64_t)) {
+                    pkt64 = nested;
+#endif
+                }
             }
+        }
+    }
+    if (!basic) {
+        return;
+    }
 
-            if (!(nlh->nlmsg_flags & NLM_F_MULTI)) {
-                multipart_msg_end = true;
-            }
+    kq = kernel_queue_stats_lookup(tcm->tcm_ifindex);
+    if (!kq) {
+        int q;
+
+        kq = xzalloc(sizeof *kq);
+        kq->ifindex = tcm->tcm_ifindex;
+        for (q = 0; q < NUM_QUEUES; q++) {
+            kq->queues[q].created = LLONG_MIN;
         }
+        hmap_insert(&kernel_queue_cache, &kq->hmap_node,
+                    hash_int(kq->ifindex, 0));
     }
-    close(sock);
+    kq->dump_seq = kernel_stats_dump_seq;
 
-    return 0;
+    if (band == NUM_QUEUES) {
+        kq->qdisc_drops = queue ? queue->drops : 0;
+        return;
+    }
+    kq->has_queues = true;
+
+    /* Netlink attributes are only 4-byte aligned. */
+    qs = &kq->queues[NUM_QUEUES - 1 - band];
+    memcpy(&qs->tx_bytes, &basic->bytes, sizeof qs->tx_bytes);
+    if (pkt64) {
+        memcpy(&qs->tx_packets, RTA_DATA(pkt64), sizeof qs->tx_packets);
+    } else {
+        qs->tx_packets = basic->packets;
+    }
+    qs->tx_errors = queue ? queue->drops : 0;
 }
 
+/* Refreshes 'kernel_queue_cache'.  Runs on the swns thread, after
+ * netdev_dump_kernel_stats__(), while the caller holds kernel_stats_mutex. */
 static int
-netdev_sim_parse_iptables_stats_line(FILE *fp, const char *if_name,
-                                     uint64_t *packets, uint64_t *bytes)
+netdev_dump_queue_stats__(void *aux OVS_UNUSED)
+    OVS_NO_THREAD_SAFETY_ANALYSIS
 {
-    char stats_str[64];
-    *packets = 0;
-    *bytes = 0;
-    if (fgets(stats_str, sizeof(stats_str)-1, fp)) {
-        if (sscanf(stats_str, "%"PRIu64"%"PRIu64, packets, bytes) < 2) {
-            VLOG_DBG("Failed to parse from iptables command for L3 interface %s", if_name);
-            *packets = 0;
-            *bytes = 0;
-            return -1;
+    struct kernel_queue_stats *kq, *next;
+    struct {
+        struct tcmsg tcm;
+        struct rtattr invisible;
+    } req;
+    size_t req_len = sizeof req.tcm;
+    int error;
+
+    memset(&req, 0, sizeof req);
+    req.tcm.tcm_family = AF_UNSPEC;
+#ifdef TCA_DUMP_INVISIBLE
+    req.invisible.rta_len = RTA_LENGTH(0);
+    req.invisible.rta_type = TCA_DUMP_INVISIBLE;
+    req_len = NLMSG_ALIGN(sizeof req.tcm) + RTA_LENGTH(0);
+#endif
+    error = netdev_rtnl_dump(RTM_GETQDISC, &req, req_len, RTM_NEWQDISC,
+                             netdev_parse_qdisc_msg);
+    if (!error) {
+        /* Forget the interfaces whose queues are gone. */
+        HMAP_FOR_EACH_SAFE (kq, next, hmap_node, &kernel_queue_cache) {
+            if (kq->dump_seq != kernel_stats_dump_seq) {
+                hmap_remove(&kernel_queue_cache, &kq->hmap_node);
+                free(kq);
+            }
         }
     }
-    return 0;
+    return error;
 }
 
-static int
-netdev_sim_parse_xtables_l3_stats(const char *if_name,
-                                  struct kernel_l3_stats *kernel_stats,
-                                  bool is_v6,
-                                  bool is_ingress)
-{
-    FILE *fp;
-    char cmd[256];
-    uint64_t packets = 0;
-    uint64_t bytes = 0;
-
-    if (is_ingress) {
-        /* Get L3 RX stats */
-        snprintf(cmd, sizeof(cmd), "%s %s -S -v -w | awk '$3 == \"-i\" && $4 == \"%s\" && $6 == \"pkttype\"{print $10,$11}'",
-                 SWNS_EXEC, is_v6 ? "ip6tables" : "iptables" , if_name);
-    } else {
-        /* Get L3 TX stats */
-        snprintf(cmd, sizeof(cmd), "%s %s -S -v -w | awk '$3 == \"-o\" && $4 == \"%s\" && $6 == \"pkttype\"{print $10,$11}'",
-                 SWNS_EXEC, is_v6 ? "ip6tables" : "iptables" , if_name);
+/* Copies the queue statistics of 'dev' into 'queues' and the drops of its
+ * qdiscs into '*qdisc_drops'.  Returns false if it has no queues in the
+ * kernel. */
+static bool
+netdev_get_kernel_queue_stats(struct netdev_sim *dev,
+                              struct netdev_queue_stats queues[NUM_QUEUES],
+                              uint64_t *qdisc_drops)
+{
+    const struct kernel_queue_stats *kq = NULL;
+    bool has_queues = false;
+
+    *qdisc_drops = 0;
+    ovs_mutex_lock(&kernel_stats_mutex);
+    if (kernel_queue_stats_valid && dev->ifindex > 0) {
+        kq = kernel_queue_stats_lookup(dev->ifindex);
+        if (kq) {
+            memcpy(queues, kq->queues, sizeof kq->queues);
+            *qdisc_drops = kq->qdisc_drops;
+            has_queues = kq->has_queues;
+        }
     }
+    ovs_mutex_unlock(&kernel_stats_mutex);
 
-    /* Open the command for reading. */
-    fp = popen(cmd, "r");
-    if (fp == NULL) {
-        VLOG_DBG("Failed to open pipe for command %s", cmd);
-        return -1;
+    return has_queues;
+}
+
+/* Interfaces that the last collector pass could not find in
+ * 'kernel_ifindexes', or whose index is stale.  'kernel_ifindex_tried' holds
+ * the ones that kernel_ifindex_resolve() last looked up, when
+ * 'kernel_link_events' was 'kernel_ifindex_tried_events'.  Only used by the
+ * stats collector. */
+static struct simap kernel_ifindex_missing
+    = SIMAP_INITIALIZER(&kernel_ifindex_missing);
+static struct simap kernel_ifindex_tried
+    = SIMAP_INITIALIZER(&kernel_ifindex_tried);
+static unsigned int kernel_ifindex_tried_events;
+
+/* Looks up the index of every interface in 'missing', a simap, in the switch
+ * namespace.  Runs on the swns thread. */
+static int
+kernel_ifindex_resolve__(void *missing_)
+{
+    struct simap *missing = missing_;
+    struct simap_node *node;
+
+    SIMAP_FOR_EACH (node, missing) {
+        node->data = if_nametoindex(node->name);
     }
+    return 0;
+}
 
-    /* Read the output lines and parse the statistics */
-    netdev_sim_parse_iptables_stats_line(fp, if_name, &packets, &bytes);
-    kernel_stats->uc_packets = packets;
-    kernel_stats->uc_bytes = bytes;
+/* Resolves the interfaces that the previous collector pass could not find,
+ * e.g. those that existed before the link notification socket was opened.
+ * Called by the collector before it takes 'sim_list_mutex', so that nothing
+ * waits for the swns thread.  Interfaces that could not be resolved are only
+ * tried again once a link notification has arrived. */
+static void
+kernel_ifindex_resolve(void)
+{
+    unsigned int events = atomic_count_get(&kernel_link_events);
+    struct simap_node *node;
+    bool retry = events != kernel_ifindex_tried_events;
 
-    netdev_sim_parse_iptables_stats_line(fp, if_name, &packets, &bytes);
-    kernel_stats->mc_packets = packets;
-    kernel_stats->mc_bytes = bytes;
+    SIMAP_FOR_EACH (node, &kernel_ifindex_missing) {
+        if (retry) {
+            break;
+        }
+        retry = !simap_contains(&kernel_ifindex_tried, node->name);
+    }
 
-    /* Adding packets and bytes for forwarded traffic */
-    netdev_sim_parse_iptables_stats_line(fp, if_name, &packets, &bytes);
-    kernel_stats->uc_packets += packets;
-    kernel_stats->uc_bytes += bytes;
+    if (retry && !simap_is_empty(&kernel_ifindex_missing)
+        && !sim_swns_call(kernel_ifindex_resolve__,
+                          &kernel_ifindex_missing)) {
+        ovs_mutex_lock(&kernel_ifindex_mutex);
+        SIMAP_FOR_EACH (node, &kernel_ifindex_missing) {
+            if (node->data) {
+                simap_put(&kernel_ifindexes, node->name, node->data);
+            }
+        }
+        ovs_mutex_unlock(&kernel_ifindex_mutex);
 
-    netdev_sim_parse_iptables_stats_line(fp, if_name, &packets, &bytes);
-    kernel_stats->mc_packets += packets;
-    kernel_stats->mc_bytes += bytes;
+        simap_swap(&kernel_ifindex_tried, &kernel_ifindex_missing);
+        kernel_ifindex_tried_events = events;
+    }
+    simap_clear(&kernel_ifindex_missing);
+}
 
-    pclose(fp);
-    return 0;
+/* Refreshes the kernel link and queue statistics of all the interfaces. */
+static void
+kernel_stats_refresh(void)
+{
+    ovs_mutex_lock(&kernel_stats_mutex);
+    kernel_stats_valid = !sim_swns_call(netdev_dump_kernel_stats__, NULL);
+    kernel_queue_stats_valid = !sim_swns_call(netdev_dump_queue_stats__,
+                                              NULL);
+    ovs_mutex_unlock(&kernel_stats_mutex);
 }
 
+/* Copies the kernel statistics of 'dev', whose kernel interface is 'name',
+ * into 'stats'. */
 static int
-netdev_sim_get_kernel_l3_stats(const char *if_name, struct netdev_stats *stats)
+netdev_get_kernel_stats(struct netdev_sim *dev, const char *name,
+                        struct netdev_stats *stats)
 {
+    const struct kernel_link_stats *link = NULL;
+    int ifindex;
     int rc = 0;
-    struct kernel_l3_stats kernel_stats;
 
-    memset(&kernel_stats, 0, sizeof(kernel_stats));
+    ovs_mutex_lock(&kernel_ifindex_mutex);
+    ifindex = simap_get(&kernel_ifindexes, name);
+    ovs_mutex_unlock(&kernel_ifindex_mutex);
 
-    /* IPV4 stats */
-    rc = netdev_sim_parse_xtables_l3_stats(if_name, &kernel_stats, false, true);
-    if (rc < 0) {
-        return rc;
+    ovs_mutex_lock(&kernel_stats_mutex);
+    dev->ifindex = ifindex;
+    if (kernel_stats_valid) {
+        if (ifindex > 0) {
+            link = kernel_link_stats_lookup(ifindex);
+        }
+        if (!link) {
+            /* Not known yet, or the interface has been recreated. */
+            simap_put(&kernel_ifindex_missing, name, 0);
+        }
     }
-    stats->ipv4_uc_rx_packets = kernel_stats.uc_packets;
-    stats->ipv4_mc_rx_packets = kernel_stats.mc_packets;
-    stats->ipv4_uc_rx_bytes = kernel_stats.uc_bytes;
-    stats->ipv4_mc_rx_bytes = kernel_stats.mc_bytes;
 
-
-    rc = netdev_sim_parse_xtables_l3_stats(if_name, &kernel_stats, false, false);
-    if (rc < 0) {
-        return rc;
+    if (link) {
+        const struct rtnl_link_stats64 *s = &link->stats;
+
+        stats->rx_packets = s->rx_packets;
+        stats->tx_packets = s->tx_packets;
+        stats->rx_bytes = s->rx_bytes;
+        stats->tx_bytes = s->tx_bytes;
+        stats->rx_errors = s->rx_errors;
+        stats->tx_errors = s->tx_errors;
+        stats->rx_dropped = s->rx_dropped;
+        stats->tx_dropped = s->tx_dropped;
+        stats->multicast = s->multicast;
+        stats->collisions = s->collisions;
+        stats->rx_crc_errors = s->rx_crc_errors;
+    } else {
+        rc = -1;
     }
-    stats->ipv4_uc_tx_packets = kernel_stats.uc_packets;
-    stats->ipv4_mc_tx_packets = kernel_stats.mc_packets;
-    stats->ipv4_uc_tx_bytes = kernel_stats.uc_bytes;
-    stats->ipv4_mc_tx_bytes = kernel_stats.mc_bytes;
+    ovs_mutex_unlock(&kernel_stats_mutex);
 
+    return rc;
+}
 
-    /* IPV6 stats */
+static int
+netdev_sim_get_kernel_l3_stats(const char *if_name, struct netdev_stats *stats)
+{
+    static const struct sim_firewall_l3_stats no_stats;
+    const struct sim_firewall_l3_stats *v4_rx, *v4_tx, *v6_rx, *v6_tx;
+    const struct sim_firewall_if_stats *ifs;
 
-    rc = netdev_sim_parse_xtables_l3_stats(if_name, &kernel_stats, true, true);
-    if (rc < 0) {
-        return rc;
+    ifs = firewall_stats_lock(if_name);
+    if (!firewall_stats_valid) {
+        ovs_mutex_unlock(&firewall_stats_mutex);
+        return -1;
     }
-    stats->ipv6_uc_rx_packets = kernel_stats.uc_packets;
-    stats->ipv6_mc_rx_packets = kernel_stats.mc_packets;
-    stats->ipv6_uc_rx_bytes = kernel_stats.uc_bytes;
-    stats->ipv6_mc_rx_bytes = kernel_stats.mc_bytes;
 
+    /* An interface without rules yet counts nothing. */
+    v4_rx = ifs ? &ifs->l3[false][true] : &no_stats;
+    v4_tx = ifs ? &ifs->l3[false][false] : &no_stats;
+    v6_rx = ifs ? &ifs->l3[true][true] : &no_stats;
+    v6_tx = ifs ? &ifs->l3[true][false] : &no_stats;
 
-    rc = netdev_sim_parse_xtables_l3_stats(if_name, &kernel_stats, true, false);
-    if (rc < 0) {
-        return rc;
-    }
-    stats->ipv6_uc_tx_packets = kernel_stats.uc_packets;
-    stats->ipv6_mc_tx_packets = kernel_stats.mc_packets;
-    stats->ipv6_uc_tx_bytes = kernel_stats.uc_bytes;
-    stats->ipv6_mc_tx_bytes = kernel_stats.mc_bytes;
+    /* IPV4 stats */
+    stats->ipv4_uc_rx_packets = v4_rx->uc_packets;
+    stats->ipv4_mc_rx_packets = v4_rx->mc_packets;
+    stats->ipv4_uc_rx_bytes = v4_rx->uc_bytes;
+    stats->ipv4_mc_rx_bytes = v4_rx->mc_bytes;
+
+    stats->ipv4_uc_tx_packets = v4_tx->uc_packets;
+    stats->ipv4_mc_tx_packets = v4_tx->mc_packets;
+    stats->ipv4_uc_tx_bytes = v4_tx->uc_bytes;
+    stats->ipv4_mc_tx_bytes = v4_tx->mc_bytes;
+
+    /* IPV6 stats */
+    stats->ipv6_uc_rx_packets = v6_rx->uc_packets;
+    stats->ipv6_mc_rx_packets = v6_rx->mc_packets;
+    stats->ipv6_uc_rx_bytes = v6_rx->uc_bytes;
+    stats->ipv6_mc_rx_bytes = v6_rx->mc_bytes;
 
+    stats->ipv6_uc_tx_packets = v6_tx->uc_packets;
+    stats->ipv6_mc_tx_packets = v6_tx->mc_packets;
+    stats->ipv6_uc_tx_bytes = v6_tx->uc_bytes;
+    stats->ipv6_mc_tx_bytes = v6_tx->mc_bytes;
+    ovs_mutex_unlock(&firewall_stats_mutex);
 
     /* Global L3 stats */
     stats->l3_uc_tx_packets = stats->ipv4_uc_tx_packets + stats->ipv6_uc_tx_packets;
@@ -1388,7 +2940,7 @@ netdev_sim_get_kernel_l3_stats(const char *if_name, struct netdev_stats *stats)
     stats->l3_uc_rx_bytes = stats->ipv4_uc_rx_bytes + stats->ipv6_uc_rx_bytes;
     stats->l3_mc_rx_bytes = stats->ipv4_mc_rx_bytes + stats->ipv6_mc_rx_bytes;
 
-    return rc;
+    return 0;
 }
 
 /* Update iptable reconfiguration events so that netdev sflow statistics
@@ -1402,16 +2954,14 @@ void
 netdev_sflow_reset(struct netdev *netdev_)
 {
     struct netdev_sim *netdev = netdev_sim_cast(netdev_);
-    ovs_mutex_lock(&netdev->mutex);
-    netdev->sflow_resets++;
-    ovs_mutex_unlock(&netdev->mutex);
+
+    atomic_count_inc(&netdev->sb.sflow_resets);
 }
 
 void
 netdev_sflow_stats_enable(struct netdev *netdev_, bool enabled)
 {
     struct netdev_sim *netdev = netdev_sim_cast(netdev_);
-    ovs_mutex_lock(&netdev->mutex);
-    netdev->sflow_stats_enabled = enabled;
-    ovs_mutex_unlock(&netdev->mutex);
+
+    atomic_store_relaxed(&netdev->sb.sflow_stats_enabled, enabled);
 }
@@ -17,6 +17,7 @@
  */
 
 #include <errno.h>
+#include <limits.h>
 #include <unistd.h>
 #include <net/if.h>
 #include <string.h>
@@ -31,6 +32,9 @@
 #include "coverage.h"
 #include "netdev.h"
 #include "timer.h"
+#include "poll-loop.h"
+#include "dynamic-string.h"
+#include "unixctl.h"
 #include "seq.h"
 #include "unaligned.h"
 #include "vlan-bitmap.h"
@@ -40,13 +44,15 @@
 #include "vswitch-idl.h"
 #include "eventlog.h"
 #include "ops-classifier-sim.h"
+#include "sim-executor.h"
+#include "sim-firewall.h"
+#include "sim-spawn.h"
+#include "svec.h"
 
 VLOG_DEFINE_THIS_MODULE(ofproto_provider_sim);
 
 static struct plugin_extension_interface qos_extension;
 
-#define MIRROR_OUTPUT_PORT_CMD_MIN_LEN 56
-
 /* This struct needs to move to ofproto.h after Dill */
 struct ofproto_mirror_bundle {
     struct ofproto *ofproto;
@@ -65,12 +71,193 @@ sim_provider_ofport_cast(const struct ofport *ofport)
 static struct hmap all_sim_provider_nodes =
 HMAP_INITIALIZER(&all_sim_provider_nodes);
 
+static const char *
+port_vlan_mode_to_asic(enum port_vlan_mode vlan_mode)
+{
+    switch (vlan_mode) {
+    case PORT_VLAN_ACCESS:
+        return "access";
+    case PORT_VLAN_TRUNK:
+        return "trunk";
+    case PORT_VLAN_NATIVE_UNTAGGED:
+        return "native-untagged";
+    case PORT_VLAN_NATIVE_TAGGED:
+        return "native-tagged";
+    default:
+        return NULL;
+    }
+}
+
+/* Appends the VLANs set in 'vlans' to 'ds' as a list of ranges. */
+static void
+format_vlan_bitmap(struct ds *ds, const unsigned long *vlans)
+{
+    int vid, first = -1;
+    bool need_comma = false;
+
+    if (!vlans) {
+        ds_put_cstr(ds, "none");
+        return;
+    }
+
+    for (vid = 0; vid <= VLAN_BITMAP_SIZE; vid++) {
+        bool set = vid < VLAN_BITMAP_SIZE && bitmap_is_set(vlans, vid);
+
+        if (set && first < 0) {
+            first = vid;
+        } else if (!set && first >= 0) {
+            ds_put_format(ds, need_comma ? ",%d" : "%d", first);
+            if (vid - 1 > first) {
+                ds_put_format(ds, "-%d", vid - 1);
+            }
+            need_comma = true;
+            first = -1;
+        }
+    }
+    if (!need_comma) {
+        ds_put_cstr(ds, "none");
+    }
+}
+
+/* Returns true if 'member' of the bond 'bundle' still has a port of its own
+ * in 'asic_ports', the ports read back from the ASIC OVS, which keeps the
+ * bonding driver from working. */
+static bool
+bundle_member_has_asic_port(const struct ofbundle *bundle, const char *member,
+                            const struct shash *asic_ports)
+{
+    return (sset_count(&bundle->applied.members) > 1
+            && strcmp(member, bundle->name)
+            && shash_find(asic_ports, member));
+}
+
+/* Compares the applied state of 'bundle' with 'asic_ports', the ports as read
+ * back from the ASIC OVS, and returns true if they agree. */
+static bool
+bundle_asic_state_matches(const struct ofbundle *bundle,
+                          const struct shash *asic_ports)
+{
+    const struct ofbundle_asic_state *applied = &bundle->applied;
+    const char *vlan_mode = port_vlan_mode_to_asic(applied->vlan_mode);
+    const struct asic_port_info *info;
+    const char *member;
+
+    info = shash_find_data(asic_ports, bundle->name);
+    if (!bundle->is_added_to_sim_ovs || !info) {
+        return !bundle->is_added_to_sim_ovs && !info;
+    }
+    SSET_FOR_EACH (member, &applied->members) {
+        if (bundle_member_has_asic_port(bundle, member, asic_ports)) {
+            return false;
+        }
+    }
+    return (applied->synced
+            && !strcmp(vlan_mode ? vlan_mode : "",
+                       info->vlan_mode ? info->vlan_mode : "")
+            && applied->tag == info->tag
+            && vlan_bitmap_equal(applied->trunks, info->trunks));
+}
+
+/* "container/show-asic-port-cache [bridge]": dumps what the provider believes
+ * it has written to the ASIC OVS for each bundle, and flags every bundle for
+ * which the ASIC OVSDB says otherwise. */
+static void
+sim_provider_unixctl_asic_port_cache(struct unixctl_conn *conn, int argc,
+                                     const char *argv[],
+                                     void *aux OVS_UNUSED)
+{
+    struct ds ds = DS_EMPTY_INITIALIZER;
+    struct sim_provider_node *ofproto;
+    struct shash asic_ports;
+    int n_mismatches = 0;
+    int error;
+
+    shash_init(&asic_ports);
+    error = asic_ovsdb_read_ports(&asic_ports);
+    if (error) {
+        ds_put_format(&ds, "failed to read ASIC OVS ports (%s)",
+                      ovs_strerror(error));
+        unixctl_command_reply_error(conn, ds_cstr(&ds));
+        asic_ovsdb_port_infos_destroy(&asic_ports);
+        ds_destroy(&ds);
+        return;
+    }
+
+    HMAP_FOR_EACH (ofproto, all_sim_provider_node, &all_sim_provider_nodes) {
+        struct ofbundle *bundle;
+
+        if (ofproto->vrf || (argc > 1 && strcmp(argv[1], ofproto->up.name))) {
+            continue;
+        }
+
+        ds_put_format(&ds, "%s:\n", ofproto->up.name);
+        HMAP_FOR_EACH (bundle, hmap_node, &ofproto->bundles) {
+            const struct ofbundle_asic_state *applied = &bundle->applied;
+            const struct asic_port_info *info;
+            const char *member;
+            bool first = true;
+
+            if (bundle->is_bridge_bundle || bundle->is_vlan_routing_enabled) {
+                continue;
+            }
+
+            info = shash_find_data(&asic_ports, bundle->name);
+            ds_put_format(&ds, "  %s:", bundle->name);
+            if (bundle->is_added_to_sim_ovs) {
+                const char *vlan_mode;
+
+                vlan_mode = port_vlan_mode_to_asic(applied->vlan_mode);
+                ds_put_format(&ds, " vlan_mode=%s tag=%d trunks=",
+                              vlan_mode ? vlan_mode : "none", applied->tag);
+                format_vlan_bitmap(&ds, applied->trunks);
+                ds_put_cstr(&ds, " members=");
+                SSET_FOR_EACH (member, &applied->members) {
+                    ds_put_format(&ds, "%s%s", first ? "" : ",", member);
+                    first = false;
+                }
+            } else {
+                ds_put_cstr(&ds, " not in ASIC OVS");
+            }
+
+            if (bundle_asic_state_matches(bundle, &asic_ports)) {
+                ds_put_cstr(&ds, "\n");
+                continue;
+            }
+
+            n_mismatches++;
+            ds_put_cstr(&ds, "\n    MISMATCH, ASIC OVS has:");
+            if (info) {
+                ds_put_format(&ds, " vlan_mode=%s tag=%d trunks=",
+                              info->vlan_mode ? info->vlan_mode : "none",
+                              info->tag);
+                format_vlan_bitmap(&ds, info->trunks);
+            } else {
+                ds_put_cstr(&ds, " no port");
+            }
+            SSET_FOR_EACH (member, &applied->members) {
+                if (bundle_member_has_asic_port(bundle, member,
+                                                &asic_ports)) {
+                    ds_put_format(&ds, " member port %s", member);
+                }
+            }
+            ds_put_cstr(&ds, "\n");
+        }
+    }
+    ds_put_format(&ds, "%d mismatches\n", n_mismatches);
+
+    unixctl_command_reply(conn, ds_cstr(&ds));
+    asic_ovsdb_port_infos_destroy(&asic_ports);
+    ds_destroy(&ds);
+}
+
 /* Factory functions. */
 
 static void
 init(const struct shash *iface_hints)
 {
-    return;
+    unixctl_command_register("container/show-asic-port-cache", "[bridge]",
+                             0, 1, sim_provider_unixctl_asic_port_cache,
+                             NULL);
 }
 
 static void
@@ -185,42 +372,114 @@ dealloc(struct ofproto *ofproto_)
     free(ofproto);
 }
 
+/* Returns the transaction that stages the ASIC OVS changes made to 'ofproto'
+ * until the next run(). */
+static struct asic_ovsdb_txn *
+sim_provider_asic_txn(struct sim_provider_node *ofproto)
+{
+    if (!ofproto->asic_txn) {
+        ofproto->asic_txn = asic_ovsdb_txn_create();
+    }
+    return ofproto->asic_txn;
+}
+
+/* Marks the mirrors of 'ofproto' staged in the transaction that was just
+ * committed as applied, if 'error' is 0.  Otherwise, a modified mirror stays
+ * unsynced, so that the next request applies it again, and a mirror whose
+ * creation failed is forgotten, so that the next reconfiguration creates it
+ * again. */
+static void
+sim_provider_mirrors_committed(struct sim_provider_node *ofproto, int error)
+{
+    struct mbridge *mbridge = ofproto->mbridge;
+    int i;
+
+    for (i = 0; mbridge && i < MAX_MIRRORS; i++) {
+        struct mirror *mirror = mbridge->mirrors[i];
+
+        if (!mirror || !mirror->staged) {
+            continue;
+        }
+        mirror->staged = false;
+        if (!error) {
+            mirror->synced = true;
+            mirror->created = true;
+        } else {
+            VLOG_ERR("Failed to %s mirror %s. %s",
+                     mirror->created ? "modify" : "create", mirror->name,
+                     ovs_strerror(error));
+            if (!mirror->created) {
+                mirror_destroy(mbridge, mirror->aux);
+            }
+        }
+    }
+}
+
+/* Commits the ASIC OVS changes staged for 'ofproto', if any.  The transaction
+ * is atomic, so if it fails, none of the bundles and mirrors it touched
+ * changed, and they are marked to be written again.  Returns 0 on success,
+ * otherwise a positive errno value. */
+static int
+sim_provider_asic_commit(struct sim_provider_node *ofproto)
+{
+    struct ofbundle *bundle;
+    bool has_sflow;
+    int error;
+
+    if (!ofproto->asic_txn) {
+        return 0;
+    }
+
+    has_sflow = ofproto->asic_txn_has_sflow;
+    error = asic_ovsdb_txn_commit(ofproto->asic_txn, false);
+    ofproto->asic_txn = NULL;
+    ofproto->asic_txn_has_sflow = false;
+
+    sim_provider_mirrors_committed(ofproto, error);
+    if (error == 0) {
+        return 0;
+    }
+
+    VLOG_ERR("Failed to apply configuration of %s to ASIC OVS, rc=%s",
+             ofproto->up.name, ovs_strerror(error));
+    if (has_sflow) {
+        log_event("SFLOW_SIM_CFG_FAILURE",
+                  EV_KV("operation", "%s", "set"),
+                  EV_KV("bridge", "%s", ofproto->up.name),
+                  EV_KV("error", "%s", ovs_strerror(error)));
+    }
+    HMAP_FOR_EACH (bundle, hmap_node, &ofproto->bundles) {
+        bundle->is_added_to_sim_ovs = asic_ovsdb_port_exists(bundle->name);
+        bundle->applied.synced = false;
+    }
+    return error;
+}
+
 static int
 construct(struct ofproto *ofproto_)
 {
     struct sim_provider_node *ofproto = sim_provider_node_cast(ofproto_);
     int error = 0;
-    char cmd_str[MAX_CMD_LEN];
 
     /* If the ofproto is of type BRIDGE, then create a bridge with the same
      * name in ASIC OVS. In ASIC OVS creating a bridge also creates a bundle &
      * port with the same name. The port will be 'internal' type. */
     if (strcmp(ofproto_->type, "system") == 0) {
 
-        snprintf(cmd_str, MAX_CMD_LEN, "%s --may-exist add-br %s -- set bridge %s datapath_type=netdev",
-                 OVS_VSCTL, ofproto->up.name, ofproto->up.name);
-        if (system(cmd_str) != 0) {
-            VLOG_ERR("Failed to add bridge in ASIC OVS. cmd=%s, rc=%s",
-                     cmd_str, strerror(errno));
-            error = 1;
-        }
+        struct asic_ovsdb_txn *txn = asic_ovsdb_txn_create();
 
-        snprintf(cmd_str, MAX_CMD_LEN, "%s set port %s trunks=0",
-                 OVS_VSCTL, ofproto->up.name);
-        if (system(cmd_str) != 0) {
-            VLOG_ERR
-                ("Failed to set trunks in the bridge bundle. cmd=%s, rc=%s",
-                 cmd_str, strerror(errno));
+        /* Wait for ovs-vswitchd-sim to create the internal interface before
+         * bringing it up below. */
+        asic_ovsdb_add_bridge(txn, ofproto->up.name);
+        if (asic_ovsdb_txn_commit(txn, true) != 0) {
+            VLOG_ERR("Failed to add bridge %s in ASIC OVS",
+                     ofproto->up.name);
             error = 1;
         }
 
-        snprintf(cmd_str, MAX_CMD_LEN, "%s /sbin/ip link set dev %s up",
-                 SWNS_EXEC, ofproto->up.name);
-        if (system(cmd_str) != 0) {
-            VLOG_ERR("Failed to set link state. cmd=%s, rc=%s", cmd_str,
-                     strerror(errno));
-            error = 1;
-        }
+        sim_exec_swns_spawn(ofproto->up.name, (const char *[]) {
+                                "/sbin/ip", "link", "set", "dev",
+                                ofproto->up.name, "up", NULL });
         ofproto->vrf = false;
 
     } else {
@@ -266,16 +525,13 @@ static void
 destruct(struct ofproto *ofproto_ OVS_UNUSED)
 {
     struct sim_provider_node *ofproto = sim_provider_node_cast(ofproto_);
-    char ovs_delbr[80];
 
+    /* Flush whatever is still staged, together with the bridge deletion. */
     if (ofproto->vrf == false) {
-
-        snprintf(ovs_delbr, sizeof(ovs_delbr), "%s del-br %s", OVS_VSCTL, ofproto->up.name);
-        if (system(ovs_delbr) != 0) {
-            VLOG_ERR("Failed to delete the bridge. cmd=%s, rc=%s",
-                     ovs_delbr, strerror(errno));
-        }
+        asic_ovsdb_del_bridge(sim_provider_asic_txn(ofproto),
+                              ofproto->up.name);
     }
+    sim_provider_asic_commit(ofproto);
 
     hmap_remove(&all_sim_provider_nodes, &ofproto->all_sim_provider_node);
 
@@ -296,15 +552,24 @@ destruct(struct ofproto *ofproto_ OVS_UNUSED)
 }
 
 static int
-run(struct ofproto *ofproto_ OVS_UNUSED)
+run(struct ofproto *ofproto_)
 {
+    struct sim_provider_node *ofproto = sim_provider_node_cast(ofproto_);
+
+    /* Everything bridge_reconfigure() changed since the last run reaches the
+     * ASIC OVS as a single transaction. */
+    sim_provider_asic_commit(ofproto);
     return 0;
 }
 
 static void
-wait(struct ofproto *ofproto_ OVS_UNUSED)
+wait(struct ofproto *ofproto_)
 {
-    return;
+    struct sim_provider_node *ofproto = sim_provider_node_cast(ofproto_);
+
+    if (ofproto->asic_txn) {
+        poll_immediate_wake();
+    }
 }
 
 static void
@@ -383,52 +648,48 @@ bundle_lookup(const struct sim_provider_node *ofproto, void *aux)
     return NULL;
 }
 
+static int
+enable_port_in_iptables_work(void *port_name)
+{
+    return sim_firewall()->l2_port_set(port_name, false);
+}
+
+static void
+enable_port_in_iptables_done(int status, void *port_name)
+{
+    if (status != 0) {
+        VLOG_ERR("Failed to remove DROP rules for %s", (char *) port_name);
+    }
+    free(port_name);
+}
+
 static void
 enable_port_in_iptables(const char *port_name)
 {
-    char cmd[MAX_CMD_LEN];
+    sim_exec_submit(port_name, enable_port_in_iptables_work,
+                    enable_port_in_iptables_done, xstrdup(port_name));
+}
 
-    snprintf(cmd, MAX_CMD_LEN, "%s iptables -D INPUT -i %s -j DROP -w",
-             SWNS_EXEC, port_name);
-    if (system(cmd) != 0) {
-        VLOG_ERR("Failed to delete DROP rule. cmd=%s rc=%s", cmd,
-                 strerror(errno));
-    }
+static int
+disable_port_in_iptables_work(void *port_name)
+{
+    return sim_firewall()->l2_port_set(port_name, true);
+}
 
-    snprintf(cmd, MAX_CMD_LEN, "%s iptables -D FORWARD -i %s -j DROP -w",
-             SWNS_EXEC, port_name);
-    if (system(cmd) != 0) {
-        VLOG_ERR("Failed to delete DROP rule. cmd=%s rc=%s", cmd,
-                 strerror(errno));
+static void
+disable_port_in_iptables_done(int status, void *port_name)
+{
+    if (status != 0) {
+        VLOG_ERR("Failed to add DROP rules for %s", (char *) port_name);
     }
+    free(port_name);
 }
 
 static void
 disable_port_in_iptables(const char *port_name)
 {
-    int rc = 0;
-    char cmd[MAX_CMD_LEN];
-
-    /* Do not add drop rules if the "Check" command returns success. */
-    snprintf(cmd, MAX_CMD_LEN, "%s iptables -C INPUT -i %s -j DROP -w",
-             SWNS_EXEC, port_name);
-    rc = system(cmd);
-    if (rc != 0) {
-
-        snprintf(cmd, MAX_CMD_LEN, "%s iptables -A INPUT -i %s -j DROP -w",
-                 SWNS_EXEC, port_name);
-        if (system(cmd) != 0) {
-            VLOG_ERR("Failed to add DROP rules: cmd=%s rc=%s", cmd,
-                     strerror(errno));
-        }
-
-        snprintf(cmd, MAX_CMD_LEN, "%s iptables -A FORWARD -i %s -j DROP -w",
-                 SWNS_EXEC, port_name);
-        if (system(cmd) != 0) {
-            VLOG_ERR("Failed to add DROP rules: cmd=%s rc=%s", cmd,
-                     strerror(errno));
-        }
-    }
+    sim_exec_submit(port_name, disable_port_in_iptables_work,
+                    disable_port_in_iptables_done, xstrdup(port_name));
 }
 
 static void
@@ -480,10 +741,6 @@ static void
 sim_bridge_vlan_routing_update(struct sim_provider_node *ofproto, int vlan,
                                bool add)
 {
-    int i = 0, n = 0;
-    int vlan_count = 0;
-    char cmd_str[MAX_CMD_LEN];
-
     if (add) {
 
         /* If the vlan is already added to the list. */
@@ -505,32 +762,8 @@ sim_bridge_vlan_routing_update(struct sim_provider_node *ofproto, int vlan,
         bitmap_set0(ofproto->vlan_intf_bmp, vlan);
     }
 
-    n = snprintf(cmd_str, MAX_CMD_LEN, "%s set port %s ", OVS_VSCTL,
-                 ofproto->up.name);
-
-    for (i = 1; i < 4095; i++) {
-
-        if (bitmap_is_set(ofproto->vlan_intf_bmp, i)) {
-
-            if (vlan_count == 0) {
-                n += snprintf(&cmd_str[n], (MAX_CMD_LEN - n), " trunks=%d", i);
-            } else {
-                n += snprintf(&cmd_str[n], (MAX_CMD_LEN - n), ",%d", i);
-            }
-            ovs_assert(n <= MAX_CMD_LEN);
-
-            vlan_count += 1;
-        }
-    }
-
-    if (vlan_count == 0) {
-        snprintf(&cmd_str[n], (MAX_CMD_LEN - n), " trunks=0");
-    }
-
-    if (system(cmd_str) != 0) {
-        VLOG_ERR("Failed to modify bridge interface trunks: cmd=%s, rc=%s",
-                 cmd_str, strerror(errno));
-    }
+    asic_ovsdb_set_port_trunks(sim_provider_asic_txn(ofproto),
+                               ofproto->up.name, ofproto->vlan_intf_bmp);
 }
 
 /* Freeing up bundle and its members on heap */
@@ -540,7 +773,6 @@ bundle_destroy(struct ofbundle *bundle)
     struct sim_provider_node *ofproto = NULL;
     struct sim_provider_ofport *port = NULL, *next_port = NULL;
     const char *type = NULL;
-    char cmd_str[MAX_CMD_LEN];
 
     if (!bundle) {
         return;
@@ -550,12 +782,7 @@ bundle_destroy(struct ofbundle *bundle)
     mbridge_unregister_bundle(ofproto->mbridge, bundle);
 
     if (bundle->is_added_to_sim_ovs == true) {
-        snprintf(cmd_str, MAX_CMD_LEN, "%s del-port %s", OVS_VSCTL,
-                 bundle->name);
-        if (system(cmd_str) != 0) {
-            VLOG_ERR("Failed to delete the existing port. cmd=%s, rc=%s",
-                     cmd_str, strerror(errno));
-        }
+        asic_ovsdb_del_port(sim_provider_asic_txn(ofproto), bundle->name);
         bundle->is_added_to_sim_ovs = false;
     }
 
@@ -580,69 +807,115 @@ bundle_destroy(struct ofbundle *bundle)
     if (bundle->trunks) {
         free(bundle->trunks);
     }
+    free(bundle->applied.trunks);
+    sset_destroy(&bundle->applied.members);
 
     free(bundle);
 }
 
+/* Brings the port of 'bundle' in the ASIC OVS in line with 'cfg', or removes
+ * it if 'cfg' is NULL, writing only what differs from 'bundle->applied'. */
 static void
-bundle_configure(struct ofbundle *bundle)
+bundle_asic_update(struct ofbundle *bundle, const struct asic_port_cfg *cfg)
 {
     struct sim_provider_node *ofproto = bundle->ofproto;
-    struct sim_provider_ofport *port = NULL, *next_port = NULL;
-    char cmd_str[MAX_CMD_LEN];
-    int i = 0, n = 0, n_ports = 0;
-    uint32_t vlan_count = 0;
+    struct ofbundle_asic_state *applied = &bundle->applied;
+    struct asic_ovsdb_txn *txn = sim_provider_asic_txn(ofproto);
+    struct sim_provider_ofport *port = NULL;
+    struct sset members = SSET_INITIALIZER(&members);
+    unsigned int columns = 0;
+
+    LIST_FOR_EACH (port, bundle_node, &bundle->ports) {
+        sset_add(&members, netdev_get_name(port->up.netdev));
+    }
+
+    /* The bonding driver only works once the members of a bond no longer
+     * have ports of their own in the ASIC OVS.  They are removed whenever
+     * the member list changes, taking into account the ports that this pass
+     * has already added or deleted. */
+    if (!ofproto->vrf && sset_count(&members) > 1
+        && (!applied->synced || !sset_equals(&members, &applied->members))) {
+        const char *member;
+
+        SSET_FOR_EACH (member, &members) {
+            if (asic_ovsdb_txn_port_exists(txn, member)) {
+                asic_ovsdb_del_port(txn, member);
+            }
+        }
+    }
+    sset_swap(&members, &applied->members);
+    sset_destroy(&members);
 
-    /* If this bundle is already added in the ASIC simulator OVS then delete
-     * it. We are going to re-create it with new config again. */
-    if (bundle->is_added_to_sim_ovs == true) {
-        snprintf(cmd_str, MAX_CMD_LEN, "%s del-port %s", OVS_VSCTL,
-                 bundle->name);
-        if (system(cmd_str) != 0) {
-            VLOG_ERR("Failed to delete the existing port. cmd=%s, rc=%s",
-                     cmd_str, strerror(errno));
+    if (!cfg) {
+        if (bundle->is_added_to_sim_ovs == true) {
+            asic_ovsdb_del_port(txn, bundle->name);
+            bundle->is_added_to_sim_ovs = false;
         }
-        bundle->is_added_to_sim_ovs = false;
+        applied->synced = false;
+        return;
+    }
+
+    if (bundle->is_added_to_sim_ovs == false) {
+        asic_ovsdb_add_port(txn, ofproto->up.name, bundle->name, cfg);
+        bundle->is_added_to_sim_ovs = true;
+    } else {
+        if (!applied->synced || applied->vlan_mode != bundle->vlan_mode) {
+            columns |= ASIC_PORT_VLAN_MODE;
+        }
+        if (!applied->synced || applied->tag != cfg->tag) {
+            columns |= ASIC_PORT_TAG;
+        }
+        if (!applied->synced
+            || !vlan_bitmap_equal(applied->trunks, cfg->trunks)) {
+            columns |= ASIC_PORT_TRUNKS;
+        }
+        asic_ovsdb_update_port(txn, bundle->name, cfg, columns);
+    }
+
+    applied->synced = true;
+    applied->vlan_mode = bundle->vlan_mode;
+    applied->tag = cfg->tag;
+    if (!vlan_bitmap_equal(applied->trunks, cfg->trunks)) {
+        free(applied->trunks);
+        applied->trunks = vlan_bitmap_clone(cfg->trunks);
     }
+}
+
+static void
+bundle_configure(struct ofbundle *bundle)
+{
+    struct sim_provider_node *ofproto = bundle->ofproto;
+    struct sim_provider_ofport *port = NULL, *next_port = NULL;
+    struct asic_port_cfg cfg;
+    bool add = false;
+    unsigned long *trunks = NULL;
+    int i = 0, n_ports = 0;
+    uint32_t vlan_count = 0;
 
     /* If this bundle is attached to VRF, there is no need to do any special
      * handling. Kernel will take care of routing. */
     if (ofproto->vrf) {
-        return;
+        goto out;
     }
 
     n_ports = list_size(&bundle->ports);
 
     /* If there is one or more slaves, then create a regular port. The Linux
      * bonding driver will take care of managing the bond if the number of
-     * slaves is greater than 1. */
-    if (n_ports >= 1) {
-        /* If there is more than one slave, then we need to delete the
-         * existent ports that are part of the bond, otherwise the bonding
-         * driver does not work properly */
-        if (n_ports > 1) {
-            LIST_FOR_EACH_SAFE(port, next_port, bundle_node, &bundle->ports) {
-                snprintf(cmd_str, MAX_CMD_LEN, "%s del-port %s", OVS_VSCTL,
-                         netdev_get_name(port->up.netdev));
-                if (system(cmd_str) != 0) {
-                    VLOG_DBG("Failed to delete port. cmd=%s, rc=%s",
-                             cmd_str, strerror(errno));
-                }
-            }
-        }
-        n = snprintf(cmd_str, MAX_CMD_LEN, "%s --may-exist add-port %s %s",
-                     OVS_VSCTL, ofproto->up.name, bundle->name);
-    } else {
+     * slaves is greater than 1, once bundle_asic_update() has deleted the
+     * ports of the slaves. */
+    if (n_ports < 1) {
         VLOG_INFO("Not enough ports to create a bundle, so skipping it.");
-        return;
+        goto out;
     }
 
+    memset(&cfg, 0, sizeof cfg);
+    cfg.tag = -1;
+
     if (bundle->vlan_mode != PORT_VLAN_TRUNK) {
         if ((bundle->vlan > 0)
             && (bitmap_is_set(ofproto->vlans_bmp, bundle->vlan))) {
-            n += snprintf(&cmd_str[n], (MAX_CMD_LEN - n), " tag=%d",
-                          bundle->vlan);
-            ovs_assert(n <= MAX_CMD_LEN);
+            cfg.tag = bundle->vlan;
         } else {
             goto done;
         }
@@ -658,19 +931,11 @@ bundle_configure(struct ofbundle *bundle)
      * in the Internal "ASIC" OVS */
 
     if (bundle->vlan_mode != PORT_VLAN_ACCESS) {
+        trunks = bitmap_allocate(VLAN_BITMAP_SIZE);
         for (i = 1; i < 4095; i++) {
             if (bitmap_is_set(ofproto->vlans_bmp, i)) {
                 if (!(bundle->trunks) || bitmap_is_set(bundle->trunks, i)) {
-
-                    if (vlan_count == 0) {
-                        n += snprintf(&cmd_str[n], (MAX_CMD_LEN - n),
-                                      " trunks=%d", i);
-                    } else {
-                        n += snprintf(&cmd_str[n], (MAX_CMD_LEN - n), ",%d",
-                                      i);
-                    }
-
-                    ovs_assert(n <= MAX_CMD_LEN);
+                    bitmap_set1(trunks, i);
                     vlan_count += 1;
                 }
             }
@@ -679,34 +944,11 @@ bundle_configure(struct ofbundle *bundle)
         if (vlan_count == 0) {
             goto done;
         }
+        cfg.trunks = trunks;
     }
 
-    if (bundle->vlan_mode == PORT_VLAN_ACCESS) {
-        n += snprintf(&cmd_str[n], (MAX_CMD_LEN - n), " vlan_mode=access");
-        ovs_assert(n <= MAX_CMD_LEN);
-
-    } else if (bundle->vlan_mode == PORT_VLAN_TRUNK) {
-        n += snprintf(&cmd_str[n], (MAX_CMD_LEN - n), " vlan_mode=trunk");
-        ovs_assert(n <= MAX_CMD_LEN);
-
-    } else if (bundle->vlan_mode == PORT_VLAN_NATIVE_UNTAGGED) {
-        n += snprintf(&cmd_str[n], (MAX_CMD_LEN - n),
-                      " vlan_mode=native-untagged");
-        ovs_assert(n <= MAX_CMD_LEN);
-
-    } else if (bundle->vlan_mode == PORT_VLAN_NATIVE_TAGGED) {
-        n += snprintf(&cmd_str[n], (MAX_CMD_LEN - n),
-                      " vlan_mode=native-tagged");
-        ovs_assert(n <= MAX_CMD_LEN);
-    }
-
-    VLOG_DBG(cmd_str);
-
-    if (system(cmd_str) != 0) {
-        VLOG_ERR("Failed to create bundle. %s, %s", cmd_str, strerror(errno));
-    } else {
-        bundle->is_added_to_sim_ovs = true;
-    }
+    cfg.vlan_mode = port_vlan_mode_to_asic(bundle->vlan_mode);
+    add = true;
 
 done:
     /* Install IP table rules to prevent the traffic going to kernel IP stack.
@@ -719,6 +961,12 @@ done:
             port->iptable_rules_added = true;
         }
     }
+
+out:
+    /* Only the differences from what the ASIC OVS already has are written,
+     * so an unchanged bundle costs nothing and traffic keeps flowing. */
+    bundle_asic_update(bundle, add ? &cfg : NULL);
+    free(trunks);
 }
 
 /* Bundles. */
@@ -729,7 +977,6 @@ bundle_set(struct ofproto *ofproto_, void *aux,
     struct sim_provider_node *ofproto = sim_provider_node_cast(ofproto_);
     bool ok = false;
     int i = 0, n = 0;
-    char cmd_str[MAX_CMD_LEN];
     struct ofbundle *bundle;
     unsigned long *trunks = NULL;
 
@@ -755,6 +1002,8 @@ bundle_set(struct ofproto *ofproto_, void *aux,
         bundle->trunks = NULL;
         bundle->bond = NULL;
         bundle->is_added_to_sim_ovs = false;
+        memset(&bundle->applied, 0, sizeof bundle->applied);
+        sset_init(&bundle->applied.members);
         bundle->is_vlan_routing_enabled = false;
         bundle->is_bridge_bundle = false;
         bundle->is_sflow_enabled = true;
@@ -919,8 +1168,68 @@ bundle_get(struct ofproto *ofproto_, void *aux, int *bundle_handle)
     return 0;
 }
 
+/* Returns true if 'bundle' trunks at least one VLAN that is enabled in the
+ * VLAN table. */
+static bool
+bundle_has_trunk_vlans(const struct ofbundle *bundle)
+{
+    const unsigned long *vlans = bundle->ofproto->vlans_bmp;
+    size_t i;
+
+    for (i = 0; i < bitmap_n_longs(VLAN_BITMAP_SIZE); i++) {
+        if (vlans[i] & (bundle->trunks ? bundle->trunks[i] : ULONG_MAX)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Updates 'bundle' in the ASIC OVS after VLAN 'vid' was added to or removed
+ * from the VLAN table.  Bundles whose tag and trunk set do not include 'vid'
+ * are left alone.  A trunk port that stays in the ASIC OVS only has 'vid'
+ * inserted into or removed from its trunks. */
+static void
+bundle_vlan_update(struct ofbundle *bundle, int vid, bool add)
+{
+    struct sim_provider_node *ofproto = bundle->ofproto;
+
+    /* The port only exists while its access or native VLAN is enabled. */
+    if (bundle->vlan_mode != PORT_VLAN_TRUNK) {
+        if (bundle->vlan == vid) {
+            bundle_configure(bundle);
+            return;
+        }
+        if (bundle->vlan_mode == PORT_VLAN_ACCESS
+            || bundle->vlan <= 0
+            || !bitmap_is_set(ofproto->vlans_bmp, bundle->vlan)) {
+            return;
+        }
+    }
+
+    if (bundle->trunks && !bitmap_is_set(bundle->trunks, vid)) {
+        return;
+    }
+
+    if (bundle->is_added_to_sim_ovs && bundle->applied.synced
+        && bundle->applied.trunks && bundle_has_trunk_vlans(bundle)) {
+        if (add) {
+            asic_ovsdb_add_port_trunk(sim_provider_asic_txn(ofproto),
+                                      bundle->name, vid);
+            bitmap_set1(bundle->applied.trunks, vid);
+        } else {
+            asic_ovsdb_del_port_trunk(sim_provider_asic_txn(ofproto),
+                                      bundle->name, vid);
+            bitmap_set0(bundle->applied.trunks, vid);
+        }
+    } else {
+        /* The first trunked VLAN creates the port and the last one deletes
+         * it. */
+        bundle_configure(bundle);
+    }
+}
+
 static int
-bundle_set_reconfigure(struct ofproto *ofproto_, int vid)
+bundle_set_reconfigure(struct ofproto *ofproto_, int vid, bool add)
 {
     struct sim_provider_node *ofproto = sim_provider_node_cast(ofproto_);
     struct ofbundle *bundle;
@@ -935,9 +1244,9 @@ bundle_set_reconfigure(struct ofproto *ofproto_, int vid)
             continue;
         }
 
-        /* Reconfiguring bundle with original configuration when VLAN is added
-         * and deleting the bundle when corresponding VLAN gets deleted */
-        bundle_configure(bundle);
+        /* Updating the bundles that carry the VLAN when it is added, and
+         * deleting the bundle when its last VLAN gets deleted */
+        bundle_vlan_update(bundle, vid, add);
     }
     return 0;
 }
@@ -986,7 +1295,7 @@ set_vlan(struct ofproto *ofproto_, int vid, bool add)
     }
 
     if (ofproto->vrf == false) {
-        bundle_set_reconfigure(ofproto_, vid);
+        bundle_set_reconfigure(ofproto_, vid, add);
     }
 
     return 0;
@@ -999,8 +1308,10 @@ mirror_set(struct ofproto *ofproto_, void *aux,
 {
     struct mbundle *out;
     struct sim_provider_node *ofproto = sim_provider_node_cast(ofproto_);
-    char cmd_str[MAX_CMD_LEN];
-    int i = 0, n = 0, retval = 0;
+    struct asic_ovsdb_txn *txn;
+    const char **src_names, **dst_names;
+    size_t n_src_names = 0, n_dst_names = 0;
+    int i = 0;
     struct mirror *mirror;
     struct mbridge *mbridge;
     struct ofproto_mirror_bundle *srcs, *dsts;
@@ -1114,7 +1425,8 @@ mirror_set(struct ofproto *ofproto_, void *aux,
             mbundle_lookup_multiple(mbridge, bndlDsts, s->n_dsts, &dsts_map);
         }
 
-        if (hmapx_equals(&srcs_map, &mirror->srcs)
+        if (mirror->synced
+                && hmapx_equals(&srcs_map, &mirror->srcs)
                 && hmapx_equals(&dsts_map, &mirror->dsts)
                 && mirror->out == out) {
             /* If the configuration has not changed, do nothing. */
@@ -1143,114 +1455,35 @@ mirror_set(struct ofproto *ofproto_, void *aux,
 
         /* TODO: vLANs aren't supported yet */
 
-        /************************************************************/
-        /* delete the mirror in openvswitch before creating new one */
-        /************************************************************/
+        /* A modified mirror is deleted and re-created in the same ASIC OVS
+         * transaction, which run() commits along with the rest of the pass.
+         * sim_provider_mirrors_committed() then handles the outcome. */
+        mirror->synced = false;
+        mirror->staged = true;
+        txn = sim_provider_asic_txn(ofproto);
         if (mirrorModify == true) {
-            n = snprintf(cmd_str, MAX_CMD_LEN,
-                         "%s -- --id=@m get mirror %s -- remove bridge bridge_normal mirrors @m",
-                         OVS_VSCTL, mirror->name);
-
-            VLOG_DBG("%s:Constructed cmd:'%s'", __FUNCTION__, cmd_str);
-
-            if (system(cmd_str) != 0) {
-                VLOG_ERR("Failed to delete mirror %s for modify: %s", mirror->name,
-                        strerror(errno));
-                retval = errno;
-            }
+            asic_ovsdb_del_mirror(txn, ofproto_->name, mirror->name);
         }
-        /************************************************************/
-        /* Build the command to construct the mirror in openvswitch */
-        /************************************************************/
-        n = snprintf(cmd_str, MAX_CMD_LEN,
-                     "%s -- --id=@m create mirror name=%s -- add bridge bridge_normal mirrors @m",
-                     OVS_VSCTL, s->name);
-
-        /***********************************/
-        /* Add the ingress ports           */
-        if (s->n_srcs > 0) {
-            for (i = 0; i < s->n_srcs; i++) {
-                n += snprintf(&cmd_str[n], MAX_CMD_LEN - n,
-                    " -- --id=@srx%s get port %s", bndlSrcs[i]->name,
-                    bndlSrcs[i]->name);
-            }
 
-            n += snprintf(&cmd_str[n], MAX_CMD_LEN - n,
-                " -- set mirror %s select-src-port=", s->name);
-
-            for (i = 0; i < s->n_srcs; i++) {
-                if (i > 0 && (MAX_CMD_LEN - n > 0)) {
-                    /* Add the comma required to list multiple ports */
-                    cmd_str[n] = ',';
-                    n++;
-                }
-                n += snprintf(&cmd_str[n], MAX_CMD_LEN - n,
-                    "@srx%s", bndlSrcs[i]->name);
+        src_names = xmalloc((s->n_srcs + 1) * sizeof *src_names);
+        for (i = 0; i < s->n_srcs; i++) {
+            if (bndlSrcs[i]) {
+                src_names[n_src_names++] = bndlSrcs[i]->name;
             }
         }
-        /***********************************/
-        /* Add the egress ports            */
-        if (s->n_dsts > 0) {
-            for (i = 0; i < s->n_dsts; i++) {
-                n += snprintf(&cmd_str[n], MAX_CMD_LEN - n,
-                    " -- --id=@stx%s get port %s", bndlDsts[i]->name,
-                    bndlDsts[i]->name);
-            }
-
-            n += snprintf(&cmd_str[n], MAX_CMD_LEN - n,
-                " -- set mirror %s select-dst-port=", s->name);
-
-            for (i = 0; i < s->n_dsts; i++) {
-                if (i > 0 && (MAX_CMD_LEN - n > 0)) {
-                    /* Add the comma required to list multiple ports */
-                    cmd_str[n] = ',';
-                    n++;
-                }
-                n += snprintf(&cmd_str[n], MAX_CMD_LEN - n,
-                    "@stx%s", bndlDsts[i]->name);
+        dst_names = xmalloc((s->n_dsts + 1) * sizeof *dst_names);
+        for (i = 0; i < s->n_dsts; i++) {
+            if (bndlDsts[i]) {
+                dst_names[n_dst_names++] = bndlDsts[i]->name;
             }
         }
-        /* Check if the buffer has enough space for the remaining command
-         * buffer to be added */
-        if ((MAX_CMD_LEN - n)
-                < (MIRROR_OUTPUT_PORT_CMD_MIN_LEN +
-                        NULL == out_bundle ? 0 : strlen(out_bundle->name)
-                        + strlen(s->name))) {
-            VLOG_ERR(
-                    "Failed to create mirror '%s'. Command length would exceed buffer size %d",
-                    s->name, MAX_CMD_LEN);
-            mirror_destroy(mbridge, mirror->aux);
-
-            retval = EMSGSIZE;
-        } else {
-            /***********************************/
-            /* Set the output port             */
-            if (out_bundle) {
-                /* strings in here are 55 chars without the variable parameters
-                 * This is captured in MIRROR_OUTPUT_PORT_CMD_MIN_LEN which accounts for
-                 * this size NULL.
-                 * If you update the command strings below, update the size of
-                 * MIROR_OUTPUT_PORT_CMD_MIN_LEN
-                 */
-                n += snprintf(&cmd_str[n], MAX_CMD_LEN - n,
-                " -- --id=@out get port %s", out_bundle->name);
-                n += snprintf(&cmd_str[n], MAX_CMD_LEN - n,
-                " -- set mirror %s output-port=@out ", s->name);
-            }
-
-            VLOG_DBG("%s:Constructed cmd (len %d):'%s'", __FUNCTION__, n, cmd_str);
 
-            if (system(cmd_str) != 0) {
-                VLOG_ERR("Failed to create mirror %s. %s", s->name,
-                strerror(errno));
-                mirror_destroy(mbridge, mirror->aux);
-                retval = errno;
-            }
-            else {
-                /* regardless of what errors we had before, if the create succeeds we'll go with it */
-                retval = 0;
-            }
-        }
+        asic_ovsdb_add_mirror(txn, ofproto_->name, s->name,
+                              src_names, n_src_names,
+                              dst_names, n_dst_names,
+                              out_bundle ? out_bundle->name : NULL);
+        free(src_names);
+        free(dst_names);
 
     } else {
         /* This is a mirror delete */
@@ -1259,20 +1492,8 @@ mirror_set(struct ofproto *ofproto_, void *aux,
             VLOG_ERR("No mirror to delete");
             return 0;
         }
-        /************************************************************/
-        /* Build the command to delete the mirror in openvswitch */
-        /************************************************************/
-        n = snprintf(cmd_str, MAX_CMD_LEN,
-                     "%s -- --id=@m get mirror %s -- remove bridge bridge_normal mirrors @m",
-                     OVS_VSCTL, mirror->name);
-
-        VLOG_DBG("%s:Constructed cmd (len %d):'%s'", __FUNCTION__, n, cmd_str);
-
-        if (system(cmd_str) != 0) {
-            VLOG_ERR("Failed to delete mirror %s. %s", mirror->name,
-                    strerror(errno));
-            retval = errno;
-        }
+        asic_ovsdb_del_mirror(sim_provider_asic_txn(ofproto), ofproto_->name,
+                              mirror->name);
 
         /* Now we can delete our copy of the mirror config */
         mirror_destroy(mbridge, aux);
@@ -1286,7 +1507,7 @@ mirror_set(struct ofproto *ofproto_, void *aux,
         free(bndlDsts);
     }
 
-    return retval;
+    return 0;
 }
 
 static struct mirror *
@@ -1458,6 +1679,55 @@ port_del(struct ofproto *ofproto_, ofp_port_t ofp_port)
     return error;
 }
 
+/* Reports the ports of 'ofproto_' whose carrier, flags or MTU changed, as
+ * the link notifications of netdev-sim tell, so that ofproto updates them
+ * right away. */
+static int
+port_poll(const struct ofproto *ofproto_, char **devnamep)
+{
+    struct sim_provider_node *ofproto = sim_provider_node_cast(ofproto_);
+
+    if (sset_is_empty(&ofproto->port_poll_set)) {
+        struct sset changed;
+        const char *name;
+
+        sset_init(&changed);
+        if (netdev_sim_link_poll(&ofproto->change_seq, &changed) == ENOBUFS) {
+            struct shash_node *node;
+
+            /* Too many changes to tell which; check every port. */
+            SHASH_FOR_EACH (node, &ofproto->up.port_by_name) {
+                sset_add(&ofproto->port_poll_set, node->name);
+            }
+        } else {
+            SSET_FOR_EACH (name, &changed) {
+                if (shash_find(&ofproto->up.port_by_name, name)) {
+                    sset_add(&ofproto->port_poll_set, name);
+                }
+            }
+        }
+        sset_destroy(&changed);
+    }
+
+    if (sset_is_empty(&ofproto->port_poll_set)) {
+        return EAGAIN;
+    }
+    *devnamep = sset_pop(&ofproto->port_poll_set);
+    return 0;
+}
+
+static void
+port_poll_wait(const struct ofproto *ofproto_)
+{
+    struct sim_provider_node *ofproto = sim_provider_node_cast(ofproto_);
+
+    if (!sset_is_empty(&ofproto->port_poll_set)) {
+        poll_immediate_wake();
+    } else {
+        netdev_sim_link_poll_wait(ofproto->change_seq);
+    }
+}
+
 static int
 port_get_stats(const struct ofport *ofport_, struct netdev_stats *stats)
 {
@@ -1730,39 +2000,65 @@ sflow_cfg_clear(struct sim_sflow_cfg *sim_cfg)
     }
 }
 
+static int
+sflow_iptable_del_all_work(void *aux OVS_UNUSED)
+{
+    return sim_firewall()->sflow_del_all();
+}
+
 static void
-sflow_iptable_del_all(void)
+sflow_iptable_del_all_done(int status, void *aux OVS_UNUSED)
 {
-    /* delete all sflow related iptable rules in the system */
-    if ((system("iptables -S -w | sed \"/SFLOW/s/-A/iptables -w -D/e\"")) != 0) {
-        VLOG_ERR("Failed to delete all iptable rules, rc=%s", strerror(errno));
+    if (status != 0) {
+        VLOG_ERR("Failed to delete all iptable rules, rc=%d", status);
         log_event("SFLOW_IPTABLES_DEL_ALL_FAILURE",
-                  EV_KV("error", "%s", strerror(errno)));
+                  EV_KV("error", "%d", status));
     }
 }
 
 static void
-sflow_ovs_delete(struct sim_provider_node *ofproto)
+sflow_iptable_del_all(void)
 {
-    char cmd_str[MAX_CMD_LEN];
+    sim_exec_submit(SFLOW_EXEC_KEY, sflow_iptable_del_all_work,
+                    sflow_iptable_del_all_done, NULL);
+}
 
-    /* remove the sflow config from bridge */
-    snprintf(cmd_str, MAX_CMD_LEN,
-                        "%s list bridge %s | grep sflow | "
-                        "awk -F ': ' '{print $2}' "
-                        "| xargs %s remove bridge %s sflow",
-                        OVS_VSCTL, ofproto->up.name,
-                        OVS_VSCTL, ofproto->up.name);
-    if (system(cmd_str) != 0) {
-        VLOG_ERR("Failed to remove sflow config from bridge %s. cmd='%s', rc=%s",
-                  ofproto->up.name, cmd_str, strerror(errno));
-        log_event("SFLOW_SIM_CFG_FAILURE",
-                  EV_KV("operation", "%s", "remove"),
-                  EV_KV("bridge", "%s", ofproto->up.name),
-                  EV_KV("error", "%s", strerror(errno)));
+static int
+sflow_hostsflow_agent_work(void *operation)
+{
+    return sim_spawn((const char *[]) { "systemctl", operation,
+                                        "host-sflow", NULL }, NULL);
+}
+
+static void
+sflow_hostsflow_agent_done(int status, void *operation)
+{
+    if (status != 0) {
+        VLOG_ERR("Failed to %s host sflow agent, rc=%d",
+                 (const char *) operation, status);
+        log_event("SFLOW_HSFLOWD_FAILURE",
+                  EV_KV("operation", "%s", (const char *) operation),
+                  EV_KV("error", "%d", status));
     }
 }
 
+/* Runs "systemctl 'operation' host-sflow" after the pending sFlow iptables
+ * updates.  'operation' must be a string literal. */
+static void
+sflow_hostsflow_agent_control(const char *operation)
+{
+    sim_exec_submit(SFLOW_EXEC_KEY, sflow_hostsflow_agent_work,
+                    sflow_hostsflow_agent_done, CONST_CAST(char *, operation));
+}
+
+static void
+sflow_ovs_delete(struct sim_provider_node *ofproto)
+{
+    /* remove the sflow config from bridge */
+    asic_ovsdb_clear_sflow(sim_provider_asic_txn(ofproto), ofproto->up.name);
+    ofproto->asic_txn_has_sflow = true;
+}
+
 static void
 sflow_disable(struct sim_provider_node *ofproto,
               struct sim_sflow_cfg *sim_cfg)
@@ -1778,12 +2074,7 @@ sflow_disable(struct sim_provider_node *ofproto,
     if (ofproto->vrf) {
         sflow_iptable_del_all();
         /* stop host sflow agent */
-        if ((system("systemctl stop host-sflow")) != 0) {
-            VLOG_ERR("Failed to stop host sflow agent, rc=%s", strerror(errno));
-            log_event("SFLOW_HSFLOWD_FAILURE",
-                      EV_KV("operation", "%s", "stop"),
-                      EV_KV("error", "%s", strerror(errno)));
-        }
+        sflow_hostsflow_agent_control("stop");
     } else {
         sflow_ovs_delete(ofproto);
     }
@@ -1835,123 +2126,45 @@ sflow_cfg_set(struct ofproto_sflow_options *ofproto_cfg,
     sim_cfg->set = true;
 }
 
-/* add iptable rules to collect packets using the nflog facility in Linux */
+/* The sFlow iptables updates of one reconfiguration, run on the executor as
+ * one batch. */
+struct sflow_iptable_job {
+    struct svec add_ports;      /* Ports to start sampling. */
+    struct svec del_ports;      /* Ports to stop sampling. */
+    unsigned int sampling_rate;
+};
+
 static int
-sflow_iptable_add(struct sim_sflow_cfg *sim_cfg, const char *port)
+sflow_iptable_work(void *job_)
 {
-    char cmd_str[MAX_CMD_LEN];
-    snprintf(cmd_str, MAX_CMD_LEN,
-            "%s iptables -I INPUT -i %s -m statistic --mode random --probability %0.12f -j NFLOG "
-            "--nflog-prefix SFLOW --nflog-group %d -w",
-            SWNS_EXEC, port, 1/(double)sim_cfg->sampling_rate, HOSTSFLOW_NFLOG_GRP);
-    if (system(cmd_str) != 0) {
-        VLOG_ERR("Failed to add INPUT rule (%s). rc=%s", cmd_str, strerror(errno));
-        log_event("SFLOW_IPTABLES_FAILURE",
-                  EV_KV("operation", "%s", "add"),
-                  EV_KV("chain", "%s", "INPUT"),
-                  EV_KV("port", "%s", port),
-                  EV_KV("error", "%s", strerror(errno)));
-        return 1;
-    }
-    snprintf(cmd_str, MAX_CMD_LEN,
-            "%s iptables -I OUTPUT -o %s -m statistic --mode random --probability %0.12f -j NFLOG "
-            "--nflog-prefix SFLOW --nflog-group %d -w",
-            SWNS_EXEC, port, 1/(double)sim_cfg->sampling_rate, HOSTSFLOW_NFLOG_GRP);
-    if (system(cmd_str) != 0) {
-        VLOG_ERR("Failed to add OUTPUT rule (%s). rc=%s", cmd_str, strerror(errno));
-        log_event("SFLOW_IPTABLES_FAILURE",
-                  EV_KV("operation", "%s", "add"),
-                  EV_KV("chain", "%s", "OUTPUT"),
-                  EV_KV("port", "%s", port),
-                  EV_KV("error", "%s", strerror(errno)));
-        return 1;
-    }
-    snprintf(cmd_str, MAX_CMD_LEN,
-            "%s iptables -I FORWARD -i %s -m statistic --mode random --probability %0.12f -j NFLOG "
-            "--nflog-prefix SFLOW --nflog-group %d -w",
-            SWNS_EXEC, port, 1/(double)sim_cfg->sampling_rate, HOSTSFLOW_NFLOG_GRP);
-    if (system(cmd_str) != 0) {
-        VLOG_ERR("Failed to add FORWARD rule (%s). rc=%s", cmd_str, strerror(errno));
-        log_event("SFLOW_IPTABLES_FAILURE",
-                  EV_KV("operation", "%s", "add"),
-                  EV_KV("chain", "%s", "FORWARD"),
-                  EV_KV("port", "%s", port),
-                  EV_KV("error", "%s", strerror(errno)));
-        return 1;
-    }
-    snprintf(cmd_str, MAX_CMD_LEN,
-            "%s iptables -I FORWARD -o %s -m statistic --mode random --probability %0.12f -j NFLOG "
-            "--nflog-prefix SFLOW --nflog-group %d -w",
-            SWNS_EXEC, port, 1/(double)sim_cfg->sampling_rate, HOSTSFLOW_NFLOG_GRP);
-    if (system(cmd_str) != 0) {
-        VLOG_ERR("Failed to add FORWARD rule (%s). rc=%s", cmd_str, strerror(errno));
-        log_event("SFLOW_IPTABLES_FAILURE",
-                  EV_KV("operation", "%s", "add"),
-                  EV_KV("chain", "%s", "FORWARD"),
-                  EV_KV("port", "%s", port),
-                  EV_KV("error", "%s", strerror(errno)));
-        return 1;
-    }
-    return 0;
+    struct sflow_iptable_job *job = job_;
+
+    return sim_firewall()->sflow_update(&job->add_ports, &job->del_ports,
+                                        job->sampling_rate,
+                                        HOSTSFLOW_NFLOG_GRP);
 }
 
-static int
-sflow_iptable_del(struct sim_sflow_cfg *sim_cfg, const char *port)
+static void
+sflow_iptable_done(int status, void *job_)
 {
-    char cmd_str[MAX_CMD_LEN];
-    snprintf(cmd_str, MAX_CMD_LEN,
-            "%s iptables -D INPUT -i %s -m statistic --mode random --probability %0.12f -j NFLOG "
-            "--nflog-prefix SFLOW --nflog-group %d -w",
-            SWNS_EXEC, port, 1/(double)sim_cfg->sampling_rate, HOSTSFLOW_NFLOG_GRP);
-    if (system(cmd_str) != 0) {
-        VLOG_ERR("Failed to del INPUT rule (%s). rc=%s", cmd_str, strerror(errno));
-        log_event("SFLOW_IPTABLES_FAILURE",
-                  EV_KV("operation", "%s", "delete"),
-                  EV_KV("chain", "%s", "INPUT"),
-                  EV_KV("port", "%s", port),
-                  EV_KV("error", "%s", strerror(errno)));
-        return 1;
-    }
-    snprintf(cmd_str, MAX_CMD_LEN,
-            "%s iptables -D OUTPUT -o %s -m statistic --mode random --probability %0.12f -j NFLOG "
-            "--nflog-prefix SFLOW --nflog-group %d -w",
-            SWNS_EXEC, port, 1/(double)sim_cfg->sampling_rate, HOSTSFLOW_NFLOG_GRP);
-    if (system(cmd_str) != 0) {
-        VLOG_ERR("Failed to del OUTPUT rule (%s). rc=%s", cmd_str, strerror(errno));
-        log_event("SFLOW_IPTABLES_FAILURE",
-                  EV_KV("operation", "%s", "delete"),
-                  EV_KV("chain", "%s", "OUTPUT"),
-                  EV_KV("port", "%s", port),
-                  EV_KV("error", "%s", strerror(errno)));
-        return 1;
-    }
-    snprintf(cmd_str, MAX_CMD_LEN,
-            "%s iptables -D FORWARD -i %s -m statistic --mode random --probability %0.12f -j NFLOG "
-            "--nflog-prefix SFLOW --nflog-group %d -w",
-            SWNS_EXEC, port, 1/(double)sim_cfg->sampling_rate, HOSTSFLOW_NFLOG_GRP);
-    if (system(cmd_str) != 0) {
-        VLOG_ERR("Failed to del FORWARD rule (%s). rc=%s", cmd_str, strerror(errno));
-        log_event("SFLOW_IPTABLES_FAILURE",
-                  EV_KV("operation", "%s", "delete"),
-                  EV_KV("chain", "%s", "FORWARD"),
-                  EV_KV("port", "%s", port),
-                  EV_KV("error", "%s", strerror(errno)));
-        return 1;
-    }
-    snprintf(cmd_str, MAX_CMD_LEN,
-            "%s iptables -D FORWARD -o %s -m statistic --mode random --probability %0.12f -j NFLOG "
-            "--nflog-prefix SFLOW --nflog-group %d -w",
-            SWNS_EXEC, port, 1/(double)sim_cfg->sampling_rate, HOSTSFLOW_NFLOG_GRP);
-    if (system(cmd_str) != 0) {
-        VLOG_ERR("Failed to del FORWARD rule (%s). rc=%s", cmd_str, strerror(errno));
+    struct sflow_iptable_job *job = job_;
+
+    if (status != 0) {
+        char *add = svec_join(&job->add_ports, " ", "");
+        char *del = svec_join(&job->del_ports, " ", "");
+
+        VLOG_ERR("Failed to update sflow rules (add: %s; del: %s). rc=%d",
+                 add, del, status);
         log_event("SFLOW_IPTABLES_FAILURE",
-                  EV_KV("operation", "%s", "delete"),
-                  EV_KV("chain", "%s", "FORWARD"),
-                  EV_KV("port", "%s", port),
-                  EV_KV("error", "%s", strerror(errno)));
-        return 1;
+                  EV_KV("operation", "%s", "update"),
+                  EV_KV("port", "%s %s", add, del),
+                  EV_KV("error", "%d", status));
+        free(add);
+        free(del);
     }
-    return 0;
+    svec_destroy(&job->add_ports);
+    svec_destroy(&job->del_ports);
+    free(job);
 }
 
 /* indicate to netdev that sflow is being reset on this bundle */
@@ -1979,10 +2192,15 @@ static void
 sflow_iptables_reconfigure(struct sim_provider_node *ofproto,
                            struct sim_sflow_cfg *sim_cfg)
 {
+    struct sflow_iptable_job *job = xzalloc(sizeof *job);
     struct ofbundle *bundle;
     const char *port_name = NULL;
     bool port_found = false;
 
+    svec_init(&job->add_ports);
+    svec_init(&job->del_ports);
+    job->sampling_rate = sim_cfg->sampling_rate;
+
     /* Adding iptable rules for port by default if enabled on global level OR
      * if sflow is explicitly enabled for the port in port configuration */
     HMAP_FOR_EACH(bundle, hmap_node, &ofproto->bundles) {
@@ -1992,7 +2210,7 @@ sflow_iptables_reconfigure(struct sim_provider_node *ofproto,
                          bundle->name);
                 sflow_port_reset(bundle);
                 sflow_port_stats_enable(bundle, true);
-                sflow_iptable_add(sim_cfg, bundle->name);
+                svec_add(&job->add_ports, bundle->name);
             }
         }
     }
@@ -2012,10 +2230,20 @@ sflow_iptables_reconfigure(struct sim_provider_node *ofproto,
             VLOG_DBG("deleting sflow iptables rule for port = '%s'\n",
                      port_name);
             sflow_port_stats_enable(bundle, false);
-            sflow_iptable_del(sim_cfg, port_name);
+            svec_add(&job->del_ports, port_name);
         }
     }
 
+    /* Apply the rule changes of all the ports at once. */
+    if (job->add_ports.n || job->del_ports.n) {
+        sim_exec_submit(SFLOW_EXEC_KEY, sflow_iptable_work, sflow_iptable_done,
+                        job);
+    } else {
+        svec_destroy(&job->add_ports);
+        svec_destroy(&job->del_ports);
+        free(job);
+    }
+
     /* Deleting and adding again only the ports for which sflow is enabled
      * (by default or explicitly) to the local structure */
     sset_destroy(&sim_cfg->ports);
@@ -2033,51 +2261,30 @@ static void
 sflow_ovs_configure(struct sim_provider_node *ofproto,
                     struct ofproto_sflow_options *ofproto_cfg)
 {
-    int cmd_len = 0;
     const char *target_name;
     char tmp_ip[MAX_CMD_LEN];
-    char cmd_str[MAX_CMD_LEN];
     char *ip = NULL, *port = NULL;
+    struct sset targets;
 
-    cmd_len += snprintf(cmd_str + cmd_len, MAX_CMD_LEN - cmd_len,
-                        "%s -- --id=@sflow create sflow ",
-                        OVS_VSCTL);
-    if (ofproto_cfg->agent_device) {
-        cmd_len += snprintf(cmd_str + cmd_len, MAX_CMD_LEN - cmd_len,
-                            "agent=%s ", ofproto_cfg->agent_device);
-    }
-    if (sset_count(&ofproto_cfg->targets) > 0) {
-        cmd_len += snprintf(cmd_str + cmd_len, MAX_CMD_LEN - cmd_len,
-                            "target=");
-        SSET_FOR_EACH(target_name, &ofproto_cfg->targets) {
-            strncpy(tmp_ip, target_name, MAX_CMD_LEN);
-            ip = strtok(tmp_ip, "/");
-            port = strtok(NULL, "/");
-            if (ip && port) {
-                cmd_len += snprintf(cmd_str + cmd_len, MAX_CMD_LEN - cmd_len,
-                                    "\\\"%s:%s\\\",", ip, port);
-            } else if (ip) {
-                cmd_len += snprintf(cmd_str + cmd_len, MAX_CMD_LEN - cmd_len,
-                                    "\\\"%s\\\",", ip);
-            }
+    sset_init(&targets);
+    SSET_FOR_EACH(target_name, &ofproto_cfg->targets) {
+        ovs_strlcpy(tmp_ip, target_name, sizeof tmp_ip);
+        ip = strtok(tmp_ip, "/");
+        port = strtok(NULL, "/");
+        if (ip && port) {
+            sset_add_and_free(&targets, xasprintf("%s:%s", ip, port));
+        } else if (ip) {
+            sset_add(&targets, ip);
         }
-        cmd_len--; /* to remove the last , */
-    }
-    snprintf(cmd_str + cmd_len, MAX_CMD_LEN - cmd_len,
-                        " header=%d sampling=%d polling=%d "
-                        "-- set bridge %s sflow=@sflow",
-                        ofproto_cfg->header_len,
-                        ofproto_cfg->sampling_rate,
-                        ofproto_cfg->polling_interval,
-                        ofproto->up.name);
-    if (system(cmd_str) != 0) {
-        VLOG_ERR("Failed to set sflow on bridge '%s'. cmd='%s', rc=%s",
-                 ofproto->up.name, cmd_str, strerror(errno));
-        log_event("SFLOW_SIM_CFG_FAILURE",
-                  EV_KV("operation", "%s", "set"),
-                  EV_KV("bridge", "%s", ofproto->up.name),
-                  EV_KV("error", "%s", strerror(errno)));
     }
+
+    asic_ovsdb_set_sflow(sim_provider_asic_txn(ofproto), ofproto->up.name,
+                         ofproto_cfg->agent_device, &targets,
+                         ofproto_cfg->header_len,
+                         ofproto_cfg->sampling_rate,
+                         ofproto_cfg->polling_interval);
+    ofproto->asic_txn_has_sflow = true;
+    sset_destroy(&targets);
 }
 
 /* configure host sflow agent and restart it */
@@ -2147,13 +2354,7 @@ sflow_hostsflow_agent_configure(struct ofproto_sflow_options *ofproto_cfg)
     fclose(fp);
 
     /* restart host sflow agent */
-    if ((system("systemctl restart host-sflow")) != 0) {
-        VLOG_ERR("Failed to restart host sflow agent, rc=%s", strerror(errno));
-        log_event("SFLOW_HSFLOWD_FAILURE",
-                  EV_KV("operation", "%s", "restart"),
-                  EV_KV("error", "%s", strerror(errno)));
-        return;
-    }
+    sflow_hostsflow_agent_control("restart");
 }
 
 /* sflow config handling modelled after dpif-sflow implementation in OpenvSwitch */
@@ -2380,8 +2581,8 @@ const struct ofproto_class ofproto_sim_provider_class = {
     port_dump_start,
     port_dump_next,
     port_dump_done,
-    NULL,                       /* may implement port_poll */
-    NULL,                       /* may implement port_poll_wait */
+    port_poll,
+    port_poll_wait,
     NULL,                       /* may implement port_is_lacp_current */
     NULL,                       /* may implement port_get_lacp_stats */
     NULL,                       /* rule_choose_table */
@@ -0,0 +1,1253 @@
+/*
+ * (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <config.h>
+
+#include "sim-asic-ovsdb.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bitmap.h"
+#include "dynamic-string.h"
+#include "json.h"
+#include "jsonrpc.h"
+#include "shash.h"
+#include "socket-util.h"
+#include "stream.h"
+#include "timeval.h"
+#include "unixctl.h"
+#include "util.h"
+#include "uuid.h"
+#include "vlan-bitmap.h"
+#include "openvswitch/vlog.h"
+
+VLOG_DEFINE_THIS_MODULE(sim_asic_ovsdb);
+
+/* How long a committing client waits for ovs-vswitchd-sim to apply a
+ * transaction when asked to do so. */
+#define ASIC_OVSDB_WAIT_MSEC        5000
+#define ASIC_OVSDB_WAIT_POLL_USEC   10000
+
+enum asic_table {
+    /* Tables whose rows are tracked by name in 'asic_rows'. */
+    ASIC_TABLE_BRIDGE,
+    ASIC_TABLE_PORT,
+    ASIC_TABLE_MIRROR,
+    ASIC_N_TRACKED,
+
+    /* Tables that are only ever written. */
+    ASIC_TABLE_INTERFACE = ASIC_N_TRACKED,
+    ASIC_TABLE_SFLOW,
+    ASIC_TABLE_OPEN_VSWITCH,
+    ASIC_N_TABLES
+};
+
+static const char *asic_table_names[ASIC_N_TABLES] = {
+    "Bridge", "Port", "Mirror", "Interface", "sFlow", "Open_vSwitch"
+};
+
+/* Row name to 'struct uuid *' of every tracked row that is known to exist in
+ * the ASIC OVSDB.  ops-switchd is the only writer of the ASIC OVSDB, so this
+ * is seeded once per connection and then kept up to date from the results of
+ * our own transactions. */
+static struct shash asic_rows[ASIC_N_TRACKED];
+
+/* Connection to ovsdb-server-sim, NULL if not connected. */
+static struct jsonrpc *asic_rpc;
+
+/* Transaction statistics, reported by "container/asic-ovsdb-stats". */
+static unsigned long long int asic_n_txns;
+static unsigned long long int asic_n_ops;
+static unsigned long long int asic_n_errors;
+static unsigned long long int asic_n_reconnects;
+static long long int asic_total_usec;
+static long long int asic_max_usec;
+
+/* A row inserted into or removed from a tracked table by a transaction.  They
+ * are replayed into 'asic_rows' in order once the transaction commits. */
+struct asic_row_change {
+    enum asic_table table;
+    char *name;
+    size_t op_index;            /* Index of the "insert" result, or SIZE_MAX
+                                 * if the row was deleted. */
+};
+
+struct asic_ovsdb_txn {
+    struct json *params;        /* Database name followed by operations. */
+
+    /* Rows inserted by this transaction: row name -> "uuid-name". */
+    struct shash inserted[ASIC_N_TRACKED];
+    /* Names of rows deleted by this transaction. */
+    struct sset deleted[ASIC_N_TRACKED];
+
+    struct asic_row_change *changes;
+    size_t n_changes;
+    size_t allocated_changes;
+
+    unsigned int n_named;       /* For generating unique "uuid-name"s. */
+    bool needs_resync;          /* Reread 'asic_rows' after committing. */
+};
+
+static int asic_ovsdb_connect(void);
+static int asic_ovsdb_resync(void);
+static void asic_ovsdb_disconnect(void);
+static int asic_ovsdb_transact(const struct json *params,
+                               struct json **resultp);
+
+/* JSON helpers. */
+
+static struct json *
+asic_json_uuid(const struct uuid *uuid)
+{
+    return json_array_create_2(json_string_create("uuid"),
+                               json_string_create_nocopy(
+                                   xasprintf(UUID_FMT, UUID_ARGS(uuid))));
+}
+
+static struct json *
+asic_json_named_uuid(const char *uuid_name)
+{
+    return json_array_create_2(json_string_create("named-uuid"),
+                               json_string_create(uuid_name));
+}
+
+static struct json *
+asic_json_set(struct json *elems)
+{
+    return json_array_create_2(json_string_create("set"), elems);
+}
+
+static struct json *
+asic_json_map_1(const char *key, const char *value)
+{
+    return json_array_create_2(json_string_create("map"),
+                               json_array_create_1(
+                                   json_array_create_2(
+                                       json_string_create(key),
+                                       json_string_create(value))));
+}
+
+/* Returns a "where" clause that matches the row whose "name" is 'name', or
+ * every row if 'name' is NULL. */
+static struct json *
+asic_json_where_name(const char *name)
+{
+    if (!name) {
+        return json_array_create_empty();
+    }
+    return json_array_create_1(
+        json_array_create_3(json_string_create("name"),
+                            json_string_create("=="),
+                            json_string_create(name)));
+}
+
+/* Returns an OVSDB set of integers holding the VLANs set in 'vlans'.  If no
+ * VLAN is set, the set holds only VLAN 0, so that a trunk port carries no
+ * tagged traffic at all. */
+static struct json *
+asic_json_vlan_set(const unsigned long *vlans)
+{
+    struct json *elems = json_array_create_empty();
+    int vid;
+
+    if (vlans) {
+        BITMAP_FOR_EACH_1 (vid, VLAN_BITMAP_SIZE, vlans) {
+            if (vid > 0 && vid < 4095) {
+                json_array_add(elems, json_integer_create(vid));
+            }
+        }
+    }
+    if (!json_array(elems)->n) {
+        json_array_add(elems, json_integer_create(0));
+    }
+
+    return asic_json_set(elems);
+}
+
+static struct json *
+asic_op_create(const char *op, enum asic_table table)
+{
+    struct json *json = json_object_create();
+
+    json_object_put_string(json, "op", op);
+    json_object_put_string(json, "table", asic_table_names[table]);
+    return json;
+}
+
+/* Transactions. */
+
+struct asic_ovsdb_txn *
+asic_ovsdb_txn_create(void)
+{
+    struct asic_ovsdb_txn *txn = xzalloc(sizeof *txn);
+    int i;
+
+    txn->params = json_array_create_1(json_string_create(ASIC_OVSDB_DB_NAME));
+    for (i = 0; i < ASIC_N_TRACKED; i++) {
+        shash_init(&txn->inserted[i]);
+        sset_init(&txn->deleted[i]);
+    }
+    return txn;
+}
+
+bool
+asic_ovsdb_txn_is_empty(const struct asic_ovsdb_txn *txn)
+{
+    return json_array(txn->params)->n <= 1;
+}
+
+void
+asic_ovsdb_txn_abort(struct asic_ovsdb_txn *txn)
+{
+    size_t i;
+
+    if (!txn) {
+        return;
+    }
+
+    json_destroy(txn->params);
+    for (i = 0; i < ASIC_N_TRACKED; i++) {
+        shash_destroy_free_data(&txn->inserted[i]);
+        sset_destroy(&txn->deleted[i]);
+    }
+    for (i = 0; i < txn->n_changes; i++) {
+        free(txn->changes[i].name);
+    }
+    free(txn->changes);
+    free(txn);
+}
+
+static void
+asic_txn_add_op(struct asic_ovsdb_txn *txn, struct json *op)
+{
+    json_array_add(txn->params, op);
+}
+
+static void
+asic_txn_record_change(struct asic_ovsdb_txn *txn, enum asic_table table,
+                       const char *name, size_t op_index)
+{
+    struct asic_row_change *change;
+
+    if (txn->n_changes >= txn->allocated_changes) {
+        txn->changes = x2nrealloc(txn->changes, &txn->allocated_changes,
+                                  sizeof *txn->changes);
+    }
+    change = &txn->changes[txn->n_changes++];
+    change->table = table;
+    change->name = xstrdup(name);
+    change->op_index = op_index;
+}
+
+/* Returns true if a row named 'name' in 'table' will exist once 'txn'
+ * commits. */
+static bool
+asic_txn_row_exists(const struct asic_ovsdb_txn *txn, enum asic_table table,
+                    const char *name)
+{
+    if (shash_find(&txn->inserted[table], name)) {
+        return true;
+    }
+    if (sset_contains(&txn->deleted[table], name)) {
+        return false;
+    }
+    return shash_find(&asic_rows[table], name) != NULL;
+}
+
+/* Returns a reference to the row named 'name' in 'table' that may be used
+ * within 'txn', or NULL if there is no such row. */
+static struct json *
+asic_txn_row_ref(const struct asic_ovsdb_txn *txn, enum asic_table table,
+                 const char *name)
+{
+    const char *uuid_name;
+    const struct uuid *uuid;
+
+    uuid_name = shash_find_data(&txn->inserted[table], name);
+    if (uuid_name) {
+        return asic_json_named_uuid(uuid_name);
+    }
+    if (sset_contains(&txn->deleted[table], name)) {
+        return NULL;
+    }
+    uuid = shash_find_data(&asic_rows[table], name);
+    return uuid ? asic_json_uuid(uuid) : NULL;
+}
+
+/* Adds an "insert" of 'row' into 'table' to 'txn' and returns a reference to
+ * the new row.  Rows of tracked tables must be given a 'name'. */
+static struct json *
+asic_txn_insert(struct asic_ovsdb_txn *txn, enum asic_table table,
+                const char *name, struct json *row)
+{
+    char *uuid_name = xasprintf("row%u", txn->n_named++);
+    struct json *op = asic_op_create("insert", table);
+    struct json *ref;
+
+    json_object_put(op, "row", row);
+    json_object_put_string(op, "uuid-name", uuid_name);
+    asic_txn_add_op(txn, op);
+
+    if (table < ASIC_N_TRACKED) {
+        free(shash_replace(&txn->inserted[table], name, xstrdup(uuid_name)));
+        sset_find_and_delete(&txn->deleted[table], name);
+        asic_txn_record_change(txn, table, name,
+                               json_array(txn->params)->n - 2);
+    }
+
+    ref = asic_json_named_uuid(uuid_name);
+    free(uuid_name);
+    return ref;
+}
+
+/* Records in 'txn' that the row named 'name' in tracked 'table' goes away
+ * when 'txn' commits. */
+static void
+asic_txn_forget(struct asic_ovsdb_txn *txn, enum asic_table table,
+                const char *name)
+{
+    struct shash_node *node = shash_find(&txn->inserted[table], name);
+
+    if (node) {
+        free(node->data);
+        shash_delete(&txn->inserted[table], node);
+    }
+    sset_add(&txn->deleted[table], name);
+    asic_txn_record_change(txn, table, name, SIZE_MAX);
+}
+
+static void
+asic_txn_update(struct asic_ovsdb_txn *txn, enum asic_table table,
+                const char *name, struct json *row)
+{
+    struct json *op = asic_op_create("update", table);
+
+    json_object_put(op, "where", asic_json_where_name(name));
+    json_object_put(op, "row", row);
+    asic_txn_add_op(txn, op);
+}
+
+static void
+asic_txn_mutate(struct asic_ovsdb_txn *txn, enum asic_table table,
+                const char *name, const char *column, const char *mutator,
+                struct json *value)
+{
+    struct json *op = asic_op_create("mutate", table);
+
+    json_object_put(op, "where", asic_json_where_name(name));
+    json_object_put(op, "mutations",
+                    json_array_create_1(
+                        json_array_create_3(json_string_create(column),
+                                            json_string_create(mutator),
+                                            value)));
+    asic_txn_add_op(txn, op);
+}
+
+/* Applies the row changes of the committed 'txn', whose per-operation
+ * results are in 'result', to 'asic_rows'. */
+static void
+asic_txn_apply_changes(const struct asic_ovsdb_txn *txn,
+                       const struct json *result)
+{
+    size_t i;
+
+    for (i = 0; i < txn->n_changes; i++) {
+        const struct asic_row_change *change = &txn->changes[i];
+        struct shash *rows = &asic_rows[change->table];
+        const struct json *op_result, *uuid_json;
+        struct uuid *uuid;
+
+        if (change->op_index == SIZE_MAX) {
+            free(shash_find_and_delete(rows, change->name));
+            continue;
+        }
+
+        op_result = json_array(result)->elems[change->op_index];
+        uuid_json = (op_result->type == JSON_OBJECT
+                     ? shash_find_data(json_object(op_result), "uuid")
+                     : NULL);
+        if (!uuid_json || uuid_json->type != JSON_ARRAY
+            || json_array(uuid_json)->n != 2
+            || json_array(uuid_json)->elems[1]->type != JSON_STRING) {
+            VLOG_WARN("no UUID returned for %s row %s",
+                      asic_table_names[change->table], change->name);
+            continue;
+        }
+
+        uuid = xmalloc(sizeof *uuid);
+        if (!uuid_from_string(uuid,
+                              json_string(json_array(uuid_json)->elems[1]))) {
+            free(uuid);
+            continue;
+        }
+        free(shash_replace(rows, change->name, uuid));
+    }
+}
+
+/* Checks the per-operation results of a "transact" reply.  Returns 0 if every
+ * operation succeeded, otherwise logs the first error and returns EPROTO. */
+static int
+asic_check_result(const struct json *result)
+{
+    size_t i;
+
+    if (!result || result->type != JSON_ARRAY) {
+        VLOG_WARN("ASIC OVSDB transaction returned a malformed reply");
+        return EPROTO;
+    }
+
+    for (i = 0; i < json_array(result)->n; i++) {
+        const struct json *op_result = json_array(result)->elems[i];
+        const struct json *error, *details;
+
+        if (op_result->type != JSON_OBJECT) {
+            continue;
+        }
+        error = shash_find_data(json_object(op_result), "error");
+        if (error) {
+            char *s = json_to_string(error, 0);
+
+            details = shash_find_data(json_object(op_result), "details");
+            if (details && details->type == JSON_STRING) {
+                VLOG_WARN("ASIC OVSDB operation %"PRIuSIZE" failed: %s (%s)",
+                          i, s, json_string(details));
+            } else {
+                VLOG_WARN("ASIC OVSDB operation %"PRIuSIZE" failed: %s",
+                          i, s);
+            }
+            free(s);
+            return EPROTO;
+        }
+    }
+    return 0;
+}
+
+/* Extracts integer 'column' from the first row of a "select" result. */
+static bool
+asic_select_integer(const struct json *op_result, const char *column,
+                    long long int *value)
+{
+    const struct json *rows, *row, *json;
+
+    if (!op_result || op_result->type != JSON_OBJECT) {
+        return false;
+    }
+    rows = shash_find_data(json_object(op_result), "rows");
+    if (!rows || rows->type != JSON_ARRAY || !json_array(rows)->n) {
+        return false;
+    }
+    row = json_array(rows)->elems[0];
+    json = (row->type == JSON_OBJECT
+            ? shash_find_data(json_object(row), column) : NULL);
+    if (!json || json->type != JSON_INTEGER) {
+        return false;
+    }
+    *value = json_integer(json);
+    return true;
+}
+
+/* Waits until ovs-vswitchd-sim reports that it has applied configuration
+ * 'next_cfg', for at most ASIC_OVSDB_WAIT_MSEC. */
+static void
+asic_ovsdb_wait_for_cfg(long long int next_cfg)
+{
+    long long int deadline = time_msec() + ASIC_OVSDB_WAIT_MSEC;
+    struct json *params, *op;
+
+    params = json_array_create_1(json_string_create(ASIC_OVSDB_DB_NAME));
+    op = asic_op_create("select", ASIC_TABLE_OPEN_VSWITCH);
+    json_object_put(op, "where", json_array_create_empty());
+    json_object_put(op, "columns",
+                    json_array_create_1(json_string_create("cur_cfg")));
+    json_array_add(params, op);
+
+    for (;;) {
+        struct json *result;
+        long long int cur_cfg;
+        bool done = false;
+
+        if (asic_ovsdb_transact(params, &result)) {
+            break;
+        }
+        if (asic_select_integer(json_array(result)->elems[0], "cur_cfg",
+                                &cur_cfg)) {
+            done = cur_cfg >= next_cfg;
+        }
+        json_destroy(result);
+
+        if (done) {
+            break;
+        } else if (time_msec() >= deadline) {
+            VLOG_WARN("timed out waiting for ASIC OVS to apply "
+                      "configuration %lld", next_cfg);
+            break;
+        }
+        usleep(ASIC_OVSDB_WAIT_POLL_USEC);
+    }
+
+    json_destroy(params);
+}
+
+/* Commits 'txn' to the ASIC OVSDB and destroys it.  If 'wait' is true, also
+ * waits until ovs-vswitchd-sim has applied the change, like ovs-vsctl does by
+ * default.  Returns 0 if successful, otherwise a positive errno value. */
+int
+asic_ovsdb_txn_commit(struct asic_ovsdb_txn *txn, bool wait)
+{
+    struct json *result = NULL;
+    long long int start, elapsed;
+    size_t n_ops;
+    int error;
+
+    if (asic_ovsdb_txn_is_empty(txn)) {
+        asic_ovsdb_txn_abort(txn);
+        return 0;
+    }
+
+    if (wait) {
+        struct json *op;
+
+        asic_txn_mutate(txn, ASIC_TABLE_OPEN_VSWITCH, NULL, "next_cfg", "+=",
+                        json_integer_create(1));
+        op = asic_op_create("select", ASIC_TABLE_OPEN_VSWITCH);
+        json_object_put(op, "where", json_array_create_empty());
+        json_object_put(op, "columns",
+                        json_array_create_1(json_string_create("next_cfg")));
+        asic_txn_add_op(txn, op);
+    }
+    n_ops = json_array(txn->params)->n - 1;
+
+    start = time_usec();
+    error = asic_ovsdb_transact(txn->params, &result);
+    if (!error) {
+        error = asic_check_result(result);
+    }
+    elapsed = time_usec() - start;
+
+    asic_n_txns++;
+    asic_n_ops += n_ops;
+    asic_total_usec += elapsed;
+    asic_max_usec = MAX(asic_max_usec, elapsed);
+
+    if (error) {
+        asic_n_errors++;
+    } else {
+        long long int next_cfg;
+
+        asic_txn_apply_changes(txn, result);
+        if (txn->needs_resync) {
+            asic_ovsdb_resync();
+        }
+        if (wait && asic_select_integer(
+                json_array(result)->elems[json_array(result)->n - 1],
+                "next_cfg", &next_cfg)) {
+            asic_ovsdb_wait_for_cfg(next_cfg);
+        }
+    }
+
+    json_destroy(result);
+    asic_ovsdb_txn_abort(txn);
+    return error;
+}
+
+/* Connection management. */
+
+/* Reads the names and UUIDs of all tracked rows into 'asic_rows'. */
+static int
+asic_ovsdb_resync(void)
+{
+    struct json *params, *result;
+    int error;
+    int i;
+
+    params = json_array_create_1(json_string_create(ASIC_OVSDB_DB_NAME));
+    for (i = 0; i < ASIC_N_TRACKED; i++) {
+        struct json *op = asic_op_create("select", i);
+
+        json_object_put(op, "where", json_array_create_empty());
+        json_object_put(op, "columns",
+                        json_array_create_2(json_string_create("name"),
+                                            json_string_create("_uuid")));
+        json_array_add(params, op);
+    }
+
+    error = asic_ovsdb_transact(params, &result);
+    json_destroy(params);
+    if (!error) {
+        error = asic_check_result(result);
+    }
+    if (error) {
+        json_destroy(result);
+        return error;
+    }
+
+    for (i = 0; i < ASIC_N_TRACKED; i++) {
+        const struct json *rows;
+        size_t j;
+
+        shash_clear_free_data(&asic_rows[i]);
+
+        rows = shash_find_data(json_object(json_array(result)->elems[i]),
+                               "rows");
+        if (!rows || rows->type != JSON_ARRAY) {
+            continue;
+        }
+        for (j = 0; j < json_array(rows)->n; j++) {
+            const struct json *row = json_array(rows)->elems[j];
+            const struct json *name, *uuid_json;
+            struct uuid *uuid;
+
+            name = shash_find_data(json_object(row), "name");
+            uuid_json = shash_find_data(json_object(row), "_uuid");
+            if (!name || name->type != JSON_STRING || !uuid_json
+                || uuid_json->type != JSON_ARRAY
+                || json_array(uuid_json)->n != 2) {
+                continue;
+            }
+
+            uuid = xmalloc(sizeof *uuid);
+            if (uuid_from_string(uuid, json_string(
+                                     json_array(uuid_json)->elems[1]))) {
+                free(shash_replace(&asic_rows[i], json_string(name), uuid));
+            } else {
+                free(uuid);
+            }
+        }
+    }
+
+    json_destroy(result);
+    return 0;
+}
+
+static int
+asic_ovsdb_connect(void)
+{
+    struct stream *stream;
+    int error;
+
+    if (asic_rpc) {
+        return 0;
+    }
+
+    error = stream_open_block(jsonrpc_stream_open(ASIC_OVSDB_SOCKET, &stream,
+                                                  DSCP_DEFAULT), &stream);
+    if (error) {
+        static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(1, 5);
+
+        VLOG_WARN_RL(&rl, "%s: connection failed (%s)", ASIC_OVSDB_SOCKET,
+                     ovs_strerror(error));
+        return error;
+    }
+
+    asic_rpc = jsonrpc_open(stream);
+    asic_n_reconnects++;
+    VLOG_INFO("%s: connected", ASIC_OVSDB_SOCKET);
+
+    error = asic_ovsdb_resync();
+    if (error) {
+        asic_ovsdb_disconnect();
+    }
+    return error;
+}
+
+static void
+asic_ovsdb_disconnect(void)
+{
+    if (asic_rpc) {
+        jsonrpc_close(asic_rpc);
+        asic_rpc = NULL;
+    }
+}
+
+/* Sends a "transact" request with 'params' and waits for the reply.  On
+ * success, stores the result in '*resultp', which the caller must free.
+ *
+ * The request is sent again on a new connection only if connecting or
+ * sending failed, since then the server cannot have received all of it.  If
+ * the reply is lost, the transaction may or may not have been applied, so it
+ * is not resent, which could for example insert a row twice: the connection
+ * is dropped instead, so that the next transaction reconnects and re-reads
+ * the row cache, and the error is returned. */
+static int
+asic_ovsdb_transact(const struct json *params, struct json **resultp)
+{
+    struct jsonrpc_msg *request, *reply;
+    struct json *id;
+    int attempt;
+    int error = 0;
+
+    *resultp = NULL;
+    for (attempt = 0; attempt < 2; attempt++) {
+        error = asic_ovsdb_connect();
+        if (error) {
+            continue;
+        }
+
+        request = jsonrpc_create_request("transact", json_clone(params),
+                                         &id);
+        error = jsonrpc_send_block(asic_rpc, request);
+        if (error) {
+            VLOG_WARN("%s: failed to send transaction (%s)",
+                      ASIC_OVSDB_SOCKET, ovs_retval_to_string(error));
+            json_destroy(id);
+            asic_ovsdb_disconnect();
+            continue;
+        }
+        break;
+    }
+    if (error) {
+        return error;
+    }
+
+    for (;;) {
+        error = jsonrpc_recv_block(asic_rpc, &reply);
+        if (error) {
+            VLOG_WARN("%s: no reply to transaction (%s), resynchronizing",
+                      ASIC_OVSDB_SOCKET, ovs_retval_to_string(error));
+            json_destroy(id);
+            asic_ovsdb_disconnect();
+            return error;
+        }
+        if ((reply->type == JSONRPC_REPLY || reply->type == JSONRPC_ERROR)
+            && json_equal(id, reply->id)) {
+            break;
+        }
+        jsonrpc_msg_destroy(reply);
+    }
+    json_destroy(id);
+
+    if (reply->type == JSONRPC_ERROR) {
+        char *s = json_to_string(reply->error, 0);
+
+        VLOG_WARN("%s: transaction error: %s", ASIC_OVSDB_SOCKET, s);
+        free(s);
+        error = EPROTO;
+    } else {
+        *resultp = reply->result;
+        reply->result = NULL;
+    }
+    jsonrpc_msg_destroy(reply);
+    return error;
+}
+
+/* Returns true if a port named 'port' exists in the ASIC OVS. */
+bool
+asic_ovsdb_port_exists(const char *port)
+{
+    return shash_find(&asic_rows[ASIC_TABLE_PORT], port) != NULL;
+}
+
+/* Returns true if a port named 'port' will exist in the ASIC OVS once 'txn'
+ * commits, taking into account the ports that 'txn' adds and deletes. */
+bool
+asic_ovsdb_txn_port_exists(const struct asic_ovsdb_txn *txn, const char *port)
+{
+    return asic_txn_row_exists(txn, ASIC_TABLE_PORT, port);
+}
+
+/* Returns true if 'json' is an OVSDB set in ["set", [...]] form.  A set with
+ * exactly one element is sent as that bare element instead. */
+static bool
+asic_json_is_set(const struct json *json)
+{
+    return (json->type == JSON_ARRAY && json_array(json)->n == 2
+            && json_array(json)->elems[0]->type == JSON_STRING
+            && !strcmp(json_string(json_array(json)->elems[0]), "set")
+            && json_array(json)->elems[1]->type == JSON_ARRAY);
+}
+
+static size_t
+asic_json_set_count(const struct json *json)
+{
+    return asic_json_is_set(json) ? json_array(json_array(json)->elems[1])->n
+                                  : 1;
+}
+
+static const struct json *
+asic_json_set_nth(const struct json *json, size_t i)
+{
+    return (asic_json_is_set(json)
+            ? json_array(json_array(json)->elems[1])->elems[i]
+            : json);
+}
+
+/* Reads the VLAN configuration of every port from the ASIC OVSDB into
+ * 'ports', which maps port names to "struct asic_port_info"s.  This asks the
+ * server rather than the local cache, for verifying that both agree.
+ * Returns 0 if successful, otherwise a positive errno value. */
+int
+asic_ovsdb_read_ports(struct shash *ports)
+{
+    struct json *params, *op, *columns, *result, *rows;
+    int error;
+    size_t i;
+
+    columns = json_array_create_empty();
+    json_array_add(columns, json_string_create("name"));
+    json_array_add(columns, json_string_create("vlan_mode"));
+    json_array_add(columns, json_string_create("tag"));
+    json_array_add(columns, json_string_create("trunks"));
+
+    params = json_array_create_1(json_string_create(ASIC_OVSDB_DB_NAME));
+    op = asic_op_create("select", ASIC_TABLE_PORT);
+    json_object_put(op, "where", json_array_create_empty());
+    json_object_put(op, "columns", columns);
+    json_array_add(params, op);
+
+    error = asic_ovsdb_transact(params, &result);
+    json_destroy(params);
+    if (!error) {
+        error = asic_check_result(result);
+    }
+    if (error) {
+        json_destroy(result);
+        return error;
+    }
+
+    rows = shash_find_data(json_object(json_array(result)->elems[0]), "rows");
+    for (i = 0; rows && i < json_array(rows)->n; i++) {
+        const struct shash *row = json_object(json_array(rows)->elems[i]);
+        const struct json *name = shash_find_data(row, "name");
+        const struct json *column, *elem;
+        struct asic_port_info *info;
+        size_t j;
+
+        if (!name || name->type != JSON_STRING) {
+            continue;
+        }
+
+        info = xzalloc(sizeof *info);
+        info->tag = -1;
+
+        column = shash_find_data(row, "vlan_mode");
+        if (column && asic_json_set_count(column) == 1) {
+            elem = asic_json_set_nth(column, 0);
+            if (elem->type == JSON_STRING) {
+                info->vlan_mode = xstrdup(json_string(elem));
+            }
+        }
+
+        column = shash_find_data(row, "tag");
+        if (column && asic_json_set_count(column) == 1) {
+            elem = asic_json_set_nth(column, 0);
+            if (elem->type == JSON_INTEGER) {
+                info->tag = json_integer(elem);
+            }
+        }
+
+        column = shash_find_data(row, "trunks");
+        for (j = 0; column && j < asic_json_set_count(column); j++) {
+            long long int vid;
+
+            elem = asic_json_set_nth(column, j);
+            if (elem->type == JSON_INTEGER) {
+                vid = json_integer(elem);
+                if (vid >= 0 && vid < VLAN_BITMAP_SIZE) {
+                    if (!info->trunks) {
+                        info->trunks = bitmap_allocate(VLAN_BITMAP_SIZE);
+                    }
+                    bitmap_set1(info->trunks, vid);
+                }
+            }
+        }
+
+        /* Port names are unique in the ASIC OVSDB. */
+        shash_add(ports, json_string(name), info);
+    }
+
+    json_destroy(result);
+    return 0;
+}
+
+void
+asic_ovsdb_port_infos_destroy(struct shash *ports)
+{
+    struct shash_node *node;
+
+    SHASH_FOR_EACH (node, ports) {
+        struct asic_port_info *info = node->data;
+
+        free(info->vlan_mode);
+        free(info->trunks);
+        free(info);
+    }
+    shash_destroy(ports);
+}
+
+/* Bridges. */
+
+/* Creates 'bridge' with its internal port of the same name in the ASIC OVS
+ * using the netdev datapath, unless it already exists.  The bridge port
+ * starts out trunking no VLANs. */
+void
+asic_ovsdb_add_bridge(struct asic_ovsdb_txn *txn, const char *bridge)
+{
+    struct json *row, *iface, *port, *br;
+
+    if (asic_txn_row_exists(txn, ASIC_TABLE_BRIDGE, bridge)) {
+        row = json_object_create();
+        json_object_put_string(row, "datapath_type", "netdev");
+        asic_txn_update(txn, ASIC_TABLE_BRIDGE, bridge, row);
+        asic_ovsdb_set_port_trunks(txn, bridge, NULL);
+        return;
+    }
+
+    row = json_object_create();
+    json_object_put_string(row, "name", bridge);
+    json_object_put_string(row, "type", "internal");
+    iface = asic_txn_insert(txn, ASIC_TABLE_INTERFACE, NULL, row);
+
+    row = json_object_create();
+    json_object_put_string(row, "name", bridge);
+    json_object_put(row, "interfaces", iface);
+    json_object_put(row, "trunks", asic_json_vlan_set(NULL));
+    port = asic_txn_insert(txn, ASIC_TABLE_PORT, bridge, row);
+
+    row = json_object_create();
+    json_object_put_string(row, "name", bridge);
+    json_object_put(row, "ports", port);
+    json_object_put_string(row, "datapath_type", "netdev");
+    br = asic_txn_insert(txn, ASIC_TABLE_BRIDGE, bridge, row);
+
+    asic_txn_mutate(txn, ASIC_TABLE_OPEN_VSWITCH, NULL, "bridges", "insert",
+                    asic_json_set(json_array_create_1(br)));
+}
+
+/* Deletes 'bridge', if it exists, along with all of its ports and mirrors. */
+void
+asic_ovsdb_del_bridge(struct asic_ovsdb_txn *txn, const char *bridge)
+{
+    struct json *ref = asic_txn_row_ref(txn, ASIC_TABLE_BRIDGE, bridge);
+
+    if (!ref) {
+        return;
+    }
+
+    asic_txn_mutate(txn, ASIC_TABLE_OPEN_VSWITCH, NULL, "bridges", "delete",
+                    asic_json_set(json_array_create_1(ref)));
+    asic_txn_forget(txn, ASIC_TABLE_BRIDGE, bridge);
+
+    /* The bridge's ports and mirrors are garbage collected along with it.
+     * Reread what is left once this transaction is done. */
+    txn->needs_resync = true;
+}
+
+/* Ports. */
+
+static struct json *
+asic_port_cfg_to_row(const struct asic_port_cfg *cfg, unsigned int columns)
+{
+    struct json *row = json_object_create();
+
+    if (columns & ASIC_PORT_TAG) {
+        json_object_put(row, "tag",
+                        asic_json_set(cfg->tag > 0
+                                      ? json_array_create_1(
+                                          json_integer_create(cfg->tag))
+                                      : json_array_create_empty()));
+    }
+    if (columns & ASIC_PORT_TRUNKS) {
+        json_object_put(row, "trunks",
+                        cfg->trunks
+                        ? asic_json_vlan_set(cfg->trunks)
+                        : asic_json_set(json_array_create_empty()));
+    }
+    if (columns & ASIC_PORT_VLAN_MODE) {
+        json_object_put(row, "vlan_mode",
+                        asic_json_set(cfg->vlan_mode
+                                      ? json_array_create_1(
+                                          json_string_create(cfg->vlan_mode))
+                                      : json_array_create_empty()));
+    }
+    return row;
+}
+
+/* Adds 'port' with a system interface of the same name to 'bridge', or
+ * updates its VLAN configuration if it already exists. */
+void
+asic_ovsdb_add_port(struct asic_ovsdb_txn *txn, const char *bridge,
+                    const char *port, const struct asic_port_cfg *cfg)
+{
+    struct json *row, *iface, *ref;
+
+    if (asic_txn_row_exists(txn, ASIC_TABLE_PORT, port)) {
+        asic_ovsdb_update_port(txn, port, cfg, ASIC_PORT_ALL);
+        return;
+    }
+
+    row = asic_port_cfg_to_row(cfg, ASIC_PORT_ALL);
+    iface = json_object_create();
+    json_object_put_string(iface, "name", port);
+    json_object_put(row, "interfaces",
+                    asic_txn_insert(txn, ASIC_TABLE_INTERFACE, NULL, iface));
+    json_object_put_string(row, "name", port);
+    ref = asic_txn_insert(txn, ASIC_TABLE_PORT, port, row);
+
+    asic_txn_mutate(txn, ASIC_TABLE_BRIDGE, bridge, "ports", "insert",
+                    asic_json_set(json_array_create_1(ref)));
+}
+
+/* Rewrites only the VLAN configuration 'columns' of existing 'port'. */
+void
+asic_ovsdb_update_port(struct asic_ovsdb_txn *txn, const char *port,
+                       const struct asic_port_cfg *cfg, unsigned int columns)
+{
+    if (columns) {
+        asic_txn_update(txn, ASIC_TABLE_PORT, port,
+                        asic_port_cfg_to_row(cfg, columns));
+    }
+}
+
+/* Removes 'port' from whichever bridge it is on, if it exists. */
+void
+asic_ovsdb_del_port(struct asic_ovsdb_txn *txn, const char *port)
+{
+    struct json *ref = asic_txn_row_ref(txn, ASIC_TABLE_PORT, port);
+
+    if (!ref) {
+        return;
+    }
+
+    /* The Port row and its Interface are garbage collected once no bridge
+     * refers to them any longer. */
+    asic_txn_mutate(txn, ASIC_TABLE_BRIDGE, NULL, "ports", "delete",
+                    asic_json_set(json_array_create_1(ref)));
+    asic_txn_forget(txn, ASIC_TABLE_PORT, port);
+}
+
+/* Sets the VLANs trunked by 'port' to those in the 4096-bit bitmap 'trunks'.
+ * A NULL or empty bitmap trunks VLAN 0 only. */
+void
+asic_ovsdb_set_port_trunks(struct asic_ovsdb_txn *txn, const char *port,
+                           const unsigned long *trunks)
+{
+    struct json *row = json_object_create();
+
+    json_object_put(row, "trunks", asic_json_vlan_set(trunks));
+    asic_txn_update(txn, ASIC_TABLE_PORT, port, row);
+}
+
+/* Adds 'vid' to the VLANs trunked by 'port', leaving the others alone. */
+void
+asic_ovsdb_add_port_trunk(struct asic_ovsdb_txn *txn, const char *port,
+                          int vid)
+{
+    asic_txn_mutate(txn, ASIC_TABLE_PORT, port, "trunks", "insert",
+                    asic_json_set(json_array_create_1(
+                                      json_integer_create(vid))));
+}
+
+/* Removes 'vid' from the VLANs trunked by 'port', leaving the others alone.
+ * The caller must make sure that 'port' keeps trunking some VLAN, since an
+ * empty trunk set means that the port trunks every VLAN. */
+void
+asic_ovsdb_del_port_trunk(struct asic_ovsdb_txn *txn, const char *port,
+                          int vid)
+{
+    asic_txn_mutate(txn, ASIC_TABLE_PORT, port, "trunks", "delete",
+                    asic_json_set(json_array_create_1(
+                                      json_integer_create(vid))));
+}
+
+/* Mirrors. */
+
+static struct json *
+asic_port_refs(const struct asic_ovsdb_txn *txn, const char **ports,
+               size_t n_ports)
+{
+    struct json *elems = json_array_create_empty();
+    size_t i;
+
+    for (i = 0; i < n_ports; i++) {
+        struct json *ref = asic_txn_row_ref(txn, ASIC_TABLE_PORT, ports[i]);
+
+        if (ref) {
+            json_array_add(elems, ref);
+        } else {
+            VLOG_WARN("mirrored port %s does not exist in ASIC OVS",
+                      ports[i]);
+        }
+    }
+    return asic_json_set(elems);
+}
+
+/* Creates 'mirror' on 'bridge' that mirrors traffic received on 'srcs' and
+ * sent on 'dsts' to 'output', which may be NULL. */
+void
+asic_ovsdb_add_mirror(struct asic_ovsdb_txn *txn, const char *bridge,
+                      const char *mirror,
+                      const char **srcs, size_t n_srcs,
+                      const char **dsts, size_t n_dsts,
+                      const char *output)
+{
+    struct json *row, *ref;
+
+    row = json_object_create();
+    json_object_put_string(row, "name", mirror);
+    if (n_srcs) {
+        json_object_put(row, "select_src_port",
+                        asic_port_refs(txn, srcs, n_srcs));
+    }
+    if (n_dsts) {
+        json_object_put(row, "select_dst_port",
+                        asic_port_refs(txn, dsts, n_dsts));
+    }
+    if (output) {
+        json_object_put(row, "output_port",
+                        asic_port_refs(txn, &output, 1));
+    }
+    ref = asic_txn_insert(txn, ASIC_TABLE_MIRROR, mirror, row);
+
+    asic_txn_mutate(txn, ASIC_TABLE_BRIDGE, bridge, "mirrors", "insert",
+                    asic_json_set(json_array_create_1(ref)));
+}
+
+/* Removes 'mirror' from 'bridge', if it exists. */
+void
+asic_ovsdb_del_mirror(struct asic_ovsdb_txn *txn, const char *bridge,
+                      const char *mirror)
+{
+    struct json *ref = asic_txn_row_ref(txn, ASIC_TABLE_MIRROR, mirror);
+
+    if (!ref) {
+        return;
+    }
+
+    asic_txn_mutate(txn, ASIC_TABLE_BRIDGE, bridge, "mirrors", "delete",
+                    asic_json_set(json_array_create_1(ref)));
+    asic_txn_forget(txn, ASIC_TABLE_MIRROR, mirror);
+}
+
+/* sFlow. */
+
+/* Replaces the sFlow configuration of 'bridge'.  'targets' holds collectors
+ * in "ip[:port]" form. */
+void
+asic_ovsdb_set_sflow(struct asic_ovsdb_txn *txn, const char *bridge,
+                     const char *agent, const struct sset *targets,
+                     int header, int sampling, int polling)
+{
+    struct json *row, *elems, *ref;
+    const char *target;
+
+    elems = json_array_create_empty();
+    SSET_FOR_EACH (target, targets) {
+        json_array_add(elems, json_string_create(target));
+    }
+
+    row = json_object_create();
+    if (agent) {
+        json_object_put_string(row, "agent", agent);
+    }
+    json_object_put(row, "targets", asic_json_set(elems));
+    json_object_put(row, "header", json_integer_create(header));
+    json_object_put(row, "sampling", json_integer_create(sampling));
+    json_object_put(row, "polling", json_integer_create(polling));
+    ref = asic_txn_insert(txn, ASIC_TABLE_SFLOW, NULL, row);
+
+    /* The previous sFlow row, if any, is garbage collected. */
+    row = json_object_create();
+    json_object_put(row, "sflow", ref);
+    asic_txn_update(txn, ASIC_TABLE_BRIDGE, bridge, row);
+}
+
+void
+asic_ovsdb_clear_sflow(struct asic_ovsdb_txn *txn, const char *bridge)
+{
+    struct json *row = json_object_create();
+
+    json_object_put(row, "sflow", asic_json_set(json_array_create_empty()));
+    asic_txn_update(txn, ASIC_TABLE_BRIDGE, bridge, row);
+}
+
+/* Main loop integration. */
+
+void
+asic_ovsdb_run(void)
+{
+    struct jsonrpc_msg *msg;
+
+    if (!asic_rpc) {
+        return;
+    }
+
+    jsonrpc_run(asic_rpc);
+    while (asic_rpc && !jsonrpc_recv(asic_rpc, &msg)) {
+        if (msg->type == JSONRPC_REQUEST && !strcmp(msg->method, "echo")) {
+            jsonrpc_send(asic_rpc, jsonrpc_create_reply(
+                             json_clone(msg->params), msg->id));
+        }
+        jsonrpc_msg_destroy(msg);
+    }
+
+    if (asic_rpc && jsonrpc_get_status(asic_rpc)) {
+        VLOG_INFO("%s: connection closed", ASIC_OVSDB_SOCKET);
+        asic_ovsdb_disconnect();
+    }
+}
+
+void
+asic_ovsdb_wait(void)
+{
+    if (asic_rpc) {
+        jsonrpc_wait(asic_rpc);
+        jsonrpc_recv_wait(asic_rpc);
+    }
+}
+
+static void
+asic_ovsdb_unixctl_stats(struct unixctl_conn *conn, int argc OVS_UNUSED,
+                         const char *argv[] OVS_UNUSED, void *aux OVS_UNUSED)
+{
+    struct ds ds = DS_EMPTY_INITIALIZER;
+
+    ds_put_format(&ds, "connection: %s (%s)\n", ASIC_OVSDB_SOCKET,
+                  asic_rpc ? "connected" : "not connected");
+    ds_put_format(&ds, "connects: %llu\n", asic_n_reconnects);
+    ds_put_format(&ds, "transactions: %llu (%llu failed)\n",
+                  asic_n_txns, asic_n_errors);
+    ds_put_format(&ds, "operations: %llu\n", asic_n_ops);
+    ds_put_format(&ds, "latency: avg %lld usec, max %lld usec\n",
+                  asic_n_txns ? asic_total_usec / (long long) asic_n_txns : 0,
+                  asic_max_usec);
+    ds_put_format(&ds, "rows: %"PRIuSIZE" bridges, %"PRIuSIZE" ports, "
+                  "%"PRIuSIZE" mirrors\n",
+                  shash_count(&asic_rows[ASIC_TABLE_BRIDGE]),
+                  shash_count(&asic_rows[ASIC_TABLE_PORT]),
+                  shash_count(&asic_rows[ASIC_TABLE_MIRROR]));
+
+    unixctl_command_reply(conn, ds_cstr(&ds));
+    ds_destroy(&ds);
+}
+
+void
+asic_ovsdb_init(void)
+{
+    int i;
+
+    for (i = 0; i < ASIC_N_TRACKED; i++) {
+        shash_init(&asic_rows[i]);
+    }
+
+    unixctl_command_register("container/asic-ovsdb-stats", "", 0, 0,
+                             asic_ovsdb_unixctl_stats, NULL);
+
+    /* ovsdb-server-sim was just restarted, so this normally succeeds.  If it
+     * does not, the first transaction tries again. */
+    asic_ovsdb_connect();
+}
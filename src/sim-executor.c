@@ -0,0 +1,357 @@
+/*
+ * (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <config.h>
+
+#include "sim-executor.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "dynamic-string.h"
+#include "hash.h"
+#include "hmap.h"
+#include "list.h"
+#include "ovs-thread.h"
+#include "seq.h"
+#include "sim-spawn.h"
+#include "sim-swns.h"
+#include "svec.h"
+#include "timeval.h"
+#include "unixctl.h"
+#include "util.h"
+#include "openvswitch/vlog.h"
+
+VLOG_DEFINE_THIS_MODULE(sim_executor);
+
+struct sim_exec_queue;
+
+struct sim_exec_job {
+    struct ovs_list list_node;      /* In queue's 'jobs' or 'done_jobs'. */
+    struct sim_exec_queue *queue;   /* Queue of the job's key. */
+    sim_exec_work_func *work;
+    sim_exec_done_func *done;
+    void *aux;
+    int status;                     /* Return value of 'work'. */
+    long long int submitted;        /* Time of submission, in msec. */
+};
+
+/* The pending jobs for one key. */
+struct sim_exec_queue {
+    struct hmap_node hmap_node;     /* In 'exec_queues', by 'key'. */
+    struct ovs_list ready_node;     /* In 'ready_queues' while runnable. */
+    char *key;
+    struct ovs_list jobs;           /* Not yet started, oldest first. */
+    bool busy;                      /* A worker runs a job of this key. */
+};
+
+static struct ovs_mutex exec_mutex = OVS_MUTEX_INITIALIZER;
+
+/* Signaled when a queue becomes ready, and when 'exec_depth' drops. */
+static pthread_cond_t exec_ready_cond;
+static pthread_cond_t exec_space_cond;
+
+static struct hmap exec_queues OVS_GUARDED_BY(exec_mutex)
+    = HMAP_INITIALIZER(&exec_queues);
+
+/* Queues that have jobs and no running job, i.e. that a worker can pick up.
+ * A queue is in this list iff it is not busy and its 'jobs' is nonempty. */
+static struct ovs_list ready_queues OVS_GUARDED_BY(exec_mutex)
+    = OVS_LIST_INITIALIZER(&ready_queues);
+
+/* Jobs that have run, waiting for sim_executor_run() to complete them. */
+static struct ovs_list done_jobs OVS_GUARDED_BY(exec_mutex)
+    = OVS_LIST_INITIALIZER(&done_jobs);
+static struct seq *done_seq;
+static uint64_t done_seqno;
+
+/* Statistics, reported by "container/executor-stats". */
+static size_t exec_depth OVS_GUARDED_BY(exec_mutex);  /* Submitted, not run. */
+static size_t exec_max_depth OVS_GUARDED_BY(exec_mutex);
+static unsigned long long int exec_n_submitted OVS_GUARDED_BY(exec_mutex);
+static unsigned long long int exec_n_blocked OVS_GUARDED_BY(exec_mutex);
+static unsigned long long int exec_n_completed;
+static unsigned long long int exec_n_failed;
+static long long int exec_total_msec;
+static long long int exec_max_msec;
+
+static struct sim_exec_queue *
+sim_exec_queue_find(const char *key, uint32_t hash)
+    OVS_REQUIRES(exec_mutex)
+{
+    struct sim_exec_queue *queue;
+
+    HMAP_FOR_EACH_WITH_HASH (queue, hmap_node, hash, &exec_queues) {
+        if (!strcmp(queue->key, key)) {
+            return queue;
+        }
+    }
+    return NULL;
+}
+
+static void *
+sim_exec_worker(void *arg OVS_UNUSED)
+{
+    for (;;) {
+        struct sim_exec_queue *queue;
+        struct sim_exec_job *job;
+
+        ovs_mutex_lock(&exec_mutex);
+        while (list_is_empty(&ready_queues)) {
+            ovs_mutex_cond_wait(&exec_ready_cond, &exec_mutex);
+        }
+        queue = CONTAINER_OF(list_pop_front(&ready_queues),
+                             struct sim_exec_queue, ready_node);
+        job = CONTAINER_OF(list_pop_front(&queue->jobs),
+                           struct sim_exec_job, list_node);
+        queue->busy = true;
+        ovs_mutex_unlock(&exec_mutex);
+
+        job->status = job->work(job->aux);
+
+        ovs_mutex_lock(&exec_mutex);
+        queue->busy = false;
+        if (!list_is_empty(&queue->jobs)) {
+            list_push_back(&ready_queues, &queue->ready_node);
+            xpthread_cond_signal(&exec_ready_cond);
+        } else {
+            hmap_remove(&exec_queues, &queue->hmap_node);
+            free(queue->key);
+            free(queue);
+        }
+        job->queue = NULL;
+        list_push_back(&done_jobs, &job->list_node);
+
+        exec_depth--;
+        xpthread_cond_broadcast(&exec_space_cond);
+        ovs_mutex_unlock(&exec_mutex);
+
+        seq_change(done_seq);
+    }
+
+    return NULL;
+}
+
+/* Queues 'work' to run with 'aux' after every job previously submitted under
+ * 'key' has run.  'done', if nonnull, is then called with the status returned
+ * by 'work' and 'aux' from sim_executor_run(). */
+void
+sim_exec_submit(const char *key, sim_exec_work_func *work,
+                sim_exec_done_func *done, void *aux)
+{
+    uint32_t hash = hash_string(key, 0);
+    struct sim_exec_queue *queue;
+    struct sim_exec_job *job;
+
+    sim_executor_init();
+
+    job = xzalloc(sizeof *job);
+    job->work = work;
+    job->done = done;
+    job->aux = aux;
+    job->submitted = time_msec();
+
+    ovs_mutex_lock(&exec_mutex);
+    if (exec_depth >= SIM_EXEC_MAX_DEPTH) {
+        exec_n_blocked++;
+        while (exec_depth >= SIM_EXEC_MAX_DEPTH) {
+            ovs_mutex_cond_wait(&exec_space_cond, &exec_mutex);
+        }
+    }
+
+    queue = sim_exec_queue_find(key, hash);
+    if (!queue) {
+        queue = xzalloc(sizeof *queue);
+        queue->key = xstrdup(key);
+        list_init(&queue->jobs);
+        hmap_insert(&exec_queues, &queue->hmap_node, hash);
+    }
+    if (!queue->busy && list_is_empty(&queue->jobs)) {
+        list_push_back(&ready_queues, &queue->ready_node);
+        xpthread_cond_signal(&exec_ready_cond);
+    }
+    job->queue = queue;
+    list_push_back(&queue->jobs, &job->list_node);
+
+    exec_n_submitted++;
+    exec_depth++;
+    exec_max_depth = MAX(exec_max_depth, exec_depth);
+    ovs_mutex_unlock(&exec_mutex);
+}
+
+/* A command run by sim_exec_spawn() or sim_exec_swns_spawn(). */
+struct sim_exec_cmd {
+    struct svec argv;
+    bool swns;                  /* Run inside the switch namespace? */
+};
+
+static int
+sim_exec_spawn_work(void *cmd_)
+{
+    struct sim_exec_cmd *cmd = cmd_;
+    const char *const *argv = (const char *const *) cmd->argv.names;
+
+    return cmd->swns ? sim_swns_spawn(argv, NULL) : sim_spawn(argv, NULL);
+}
+
+static void
+sim_exec_spawn_done(int status, void *cmd_)
+{
+    struct sim_exec_cmd *cmd = cmd_;
+
+    if (status != 0) {
+        struct ds s = DS_EMPTY_INITIALIZER;
+
+        sim_spawn_format_argv((const char *const *) cmd->argv.names, &s);
+        VLOG_ERR("Failed to run the command: %s%s (status %d)",
+                 cmd->swns ? "(swns) " : "", ds_cstr(&s), status);
+        ds_destroy(&s);
+    }
+    svec_destroy(&cmd->argv);
+    free(cmd);
+}
+
+static void
+sim_exec_spawn__(const char *key, const char *const argv[], bool swns)
+{
+    struct sim_exec_cmd *cmd = xmalloc(sizeof *cmd);
+    size_t i;
+
+    svec_init(&cmd->argv);
+    for (i = 0; argv[i]; i++) {
+        svec_add(&cmd->argv, argv[i]);
+    }
+    svec_terminate(&cmd->argv);
+    cmd->swns = swns;
+
+    sim_exec_submit(key, sim_exec_spawn_work, sim_exec_spawn_done, cmd);
+}
+
+/* Runs the program with the null-terminated 'argv' through sim_spawn() after
+ * all the jobs previously submitted under 'key'.  'argv' is copied.  A
+ * failure is logged. */
+void
+sim_exec_spawn(const char *key, const char *const argv[])
+{
+    sim_exec_spawn__(key, argv, false);
+}
+
+/* Like sim_exec_spawn(), but runs the program inside the switch namespace
+ * through sim_swns_spawn(). */
+void
+sim_exec_swns_spawn(const char *key, const char *const argv[])
+{
+    sim_exec_spawn__(key, argv, true);
+}
+
+/* Calls the completion callbacks of the jobs that have run. */
+void
+sim_executor_run(void)
+{
+    struct sim_exec_job *job;
+    struct ovs_list done;
+
+    if (!done_seq) {
+        return;
+    }
+
+    done_seqno = seq_read(done_seq);
+
+    ovs_mutex_lock(&exec_mutex);
+    list_move(&done, &done_jobs);
+    list_init(&done_jobs);
+    ovs_mutex_unlock(&exec_mutex);
+
+    LIST_FOR_EACH_POP (job, list_node, &done) {
+        long long int elapsed = time_msec() - job->submitted;
+
+        exec_n_completed++;
+        if (job->status != 0) {
+            exec_n_failed++;
+        }
+        exec_total_msec += elapsed;
+        exec_max_msec = MAX(exec_max_msec, elapsed);
+
+        if (job->done) {
+            job->done(job->status, job->aux);
+        }
+        free(job);
+    }
+}
+
+void
+sim_executor_wait(void)
+{
+    if (done_seq) {
+        seq_wait(done_seq, done_seqno);
+    }
+}
+
+static void
+sim_executor_unixctl_stats(struct unixctl_conn *conn, int argc OVS_UNUSED,
+                           const char *argv[] OVS_UNUSED,
+                           void *aux OVS_UNUSED)
+{
+    struct ds ds = DS_EMPTY_INITIALIZER;
+
+    ovs_mutex_lock(&exec_mutex);
+    ds_put_format(&ds, "workers: %d\n", SIM_EXEC_N_WORKERS);
+    ds_put_format(&ds, "queue depth: %"PRIuSIZE" (max %"PRIuSIZE", "
+                  "limit %d)\n", exec_depth, exec_max_depth,
+                  SIM_EXEC_MAX_DEPTH);
+    ds_put_format(&ds, "active keys: %"PRIuSIZE"\n",
+                  hmap_count(&exec_queues));
+    ds_put_format(&ds, "submitted: %llu (%llu blocked on a full queue)\n",
+                  exec_n_submitted, exec_n_blocked);
+    ovs_mutex_unlock(&exec_mutex);
+
+    ds_put_format(&ds, "completed: %llu (%llu failed)\n",
+                  exec_n_completed, exec_n_failed);
+    ds_put_format(&ds, "latency: avg %lld msec, max %lld msec\n",
+                  (exec_n_completed
+                   ? exec_total_msec / (long long int) exec_n_completed
+                   : 0),
+                  exec_max_msec);
+
+    unixctl_command_reply(conn, ds_cstr(&ds));
+    ds_destroy(&ds);
+}
+
+/* Starts the worker threads.  It is safe to call this more than once. */
+void
+sim_executor_init(void)
+{
+    static struct ovsthread_once once = OVSTHREAD_ONCE_INITIALIZER;
+    int i;
+
+    if (!ovsthread_once_start(&once)) {
+        return;
+    }
+
+    xpthread_cond_init(&exec_ready_cond, NULL);
+    xpthread_cond_init(&exec_space_cond, NULL);
+    done_seq = seq_create();
+    done_seqno = seq_read(done_seq);
+
+    for (i = 0; i < SIM_EXEC_N_WORKERS; i++) {
+        ovs_thread_create("sim_executor", sim_exec_worker, NULL);
+    }
+
+    unixctl_command_register("container/executor-stats", "", 0, 0,
+                             sim_executor_unixctl_stats, NULL);
+
+    ovsthread_once_done(&once);
+}
@@ -0,0 +1,688 @@
+/*
+ * (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Firewall backend on iptables, ip6tables and ipset. */
+
+#include <config.h>
+
+#include "sim-firewall.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <net/if.h>
+
+#include "dynamic-string.h"
+#include "ovs-thread.h"
+#include "shash.h"
+#include "sim-swns.h"
+#include "sset.h"
+#include "svec.h"
+#include "util.h"
+#include "openvswitch/vlog.h"
+
+VLOG_DEFINE_THIS_MODULE(sim_firewall_iptables);
+
+/* Packets received on an L2 port are switched by the ASIC OVS and must not
+ * reach the kernel IP stack.  The L2 ports are the members of the ipset
+ * L2_PORTS_IPSET, which a single DROP rule in each of the INPUT and FORWARD
+ * chains matches, so that adding or removing a port is one set update and
+ * the cost per packet does not grow with the number of L2 ports.  If ipset
+ * is not available, each L2 port gets its own DROP rules instead. */
+#define L2_PORTS_IPSET "sim-l2-ports"
+
+static struct ovs_mutex l2_ports_ipset_mutex = OVS_MUTEX_INITIALIZER;
+static bool l2_ports_ipset_initialized OVS_GUARDED_BY(l2_ports_ipset_mutex);
+static bool l2_ports_ipset_usable OVS_GUARDED_BY(l2_ports_ipset_mutex);
+
+/* The L3 statistics of an interface are counted in two chains of its own,
+ * in both iptables and ip6tables: L3STATS_RX_PREFIX<if> for the packets
+ * received on it, which INPUT and FORWARD jump to on "-i <if>", and
+ * L3STATS_TX_PREFIX<if> for those sent on it, which FORWARD and OUTPUT jump
+ * to on "-o <if>".  Each chain has a unicast and a multicast pkttype rule
+ * that only count.  A packet thus matches one interface name per L3
+ * interface in the builtin chains and then the two counting rules of its own
+ * interface, instead of going through the pkttype rules of every L3
+ * interface. */
+#define L3STATS_RX_PREFIX "L3RX-"
+#define L3STATS_TX_PREFIX "L3TX-"
+#define L3STATS_CHAIN_LEN (sizeof L3STATS_RX_PREFIX + IFNAMSIZ)
+
+/* Rules of the filter table to apply with "iptables-restore --noflush" and
+ * "ip6tables-restore --noflush", one command per line in the format of
+ * "iptables -S", e.g. "-A INPUT -i 1 -j DROP".  Each family is applied as a
+ * single table replacement, which is atomic, instead of one replacement per
+ * rule: if any command fails, none of that family's commands take effect. */
+struct xtables_batch {
+    struct ds rules[2];         /* By [is_v6]. */
+};
+
+static void
+xtables_batch_init(struct xtables_batch *batch)
+{
+    ds_init(&batch->rules[false]);
+    ds_init(&batch->rules[true]);
+}
+
+static void OVS_PRINTF_FORMAT(3, 4)
+xtables_batch_put(struct xtables_batch *batch, bool is_v6,
+                  const char *format, ...)
+{
+    va_list args;
+
+    va_start(args, format);
+    ds_put_format_valist(&batch->rules[is_v6], format, args);
+    va_end(args);
+    ds_put_char(&batch->rules[is_v6], '\n');
+}
+
+static void
+xtables_batch_destroy(struct xtables_batch *batch)
+{
+    ds_destroy(&batch->rules[false]);
+    ds_destroy(&batch->rules[true]);
+}
+
+/* Applies and destroys 'batch'.  Returns 0 if every family applied, otherwise
+ * the exit status of the restore that failed last. */
+static int
+xtables_batch_commit(struct xtables_batch *batch)
+{
+    int status = 0;
+    int is_v6;
+
+    for (is_v6 = 0; is_v6 < 2; is_v6++) {
+        struct ds *rules = &batch->rules[is_v6];
+        const char *cmd = is_v6 ? "ip6tables-restore" : "iptables-restore";
+        struct ds input = DS_EMPTY_INITIALIZER;
+        int rc;
+
+        if (!rules->length) {
+            continue;
+        }
+
+        ds_put_format(&input, "*filter\n%sCOMMIT\n", ds_cstr(rules));
+        rc = sim_swns_spawn_input((const char *[]) { cmd, "--noflush", NULL },
+                                  ds_cstr(&input), NULL);
+        if (rc != 0) {
+            VLOG_DBG("%s failed (rc=%d):\n%s", cmd, rc, ds_cstr(&input));
+            status = rc;
+        }
+        ds_destroy(&input);
+        ds_destroy(rules);
+    }
+    return status;
+}
+
+/* Runs "iptables 'op' 'chain' -m set --match-set L2_PORTS_IPSET src,src -j
+ * DROP" in the switch namespace. */
+static int
+l2_ports_ipset_rule(const char *op, const char *chain)
+{
+    return sim_swns_spawn((const char *[]) {
+                              "iptables", op, chain, "-m", "set",
+                              "--match-set", L2_PORTS_IPSET, "src,src",
+                              "-j", "DROP", "-w", NULL }, NULL);
+}
+
+/* Creates L2_PORTS_IPSET and its DROP rules, the first time it is called.
+ * Returns true if they are in place, false if the per-port rules must be
+ * used. */
+static bool
+l2_ports_ipset_ready(void)
+{
+    static const char *const chains[] = { "INPUT", "FORWARD" };
+    bool ready;
+
+    ovs_mutex_lock(&l2_ports_ipset_mutex);
+    if (!l2_ports_ipset_initialized) {
+        size_t i;
+
+        l2_ports_ipset_initialized = true;
+        ready = !sim_swns_spawn((const char *[]) {
+                                    "ipset", "create", L2_PORTS_IPSET,
+                                    "hash:net,iface", "-exist", NULL }, NULL);
+        for (i = 0; ready && i < ARRAY_SIZE(chains); i++) {
+            if (l2_ports_ipset_rule("-C", chains[i]) != 0
+                && l2_ports_ipset_rule("-A", chains[i]) != 0) {
+                ready = false;
+            }
+        }
+        if (!ready) {
+            VLOG_WARN("ipset %s is not available, using one DROP rule per "
+                      "L2 port", L2_PORTS_IPSET);
+        }
+        l2_ports_ipset_usable = ready;
+    }
+    ready = l2_ports_ipset_usable;
+    ovs_mutex_unlock(&l2_ports_ipset_mutex);
+
+    return ready;
+}
+
+/* Adds 'port_name' to L2_PORTS_IPSET if 'add', otherwise removes it. */
+static int
+l2_ports_ipset_update(const char *port_name, bool add)
+{
+    char *entry = xasprintf("0.0.0.0/0,%s", port_name);
+    int status;
+
+    status = sim_swns_spawn((const char *[]) {
+                                "ipset", add ? "add" : "del", L2_PORTS_IPSET,
+                                entry, "-exist", NULL }, NULL);
+    free(entry);
+
+    return status;
+}
+
+static int
+iptables_init(void)
+{
+    return 0;
+}
+
+static int
+iptables_l2_port_set(const char *port_name, bool drop)
+{
+    int status = 0;
+
+    if (l2_ports_ipset_ready()) {
+        return l2_ports_ipset_update(port_name, drop);
+    }
+
+    if (!drop) {
+        if (sim_swns_spawn((const char *[]) {
+                               "iptables", "-D", "INPUT", "-i", port_name,
+                               "-j", "DROP", "-w", NULL }, NULL) != 0) {
+            status = 1;
+        }
+        if (sim_swns_spawn((const char *[]) {
+                               "iptables", "-D", "FORWARD", "-i", port_name,
+                               "-j", "DROP", "-w", NULL }, NULL) != 0) {
+            status = 1;
+        }
+        return status;
+    }
+
+    /* Do not add drop rules if the "Check" command returns success. */
+    if (sim_swns_spawn((const char *[]) {
+                           "iptables", "-C", "INPUT", "-i", port_name,
+                           "-j", "DROP", "-w", NULL }, NULL) != 0) {
+
+        if (sim_swns_spawn((const char *[]) {
+                               "iptables", "-A", "INPUT", "-i", port_name,
+                               "-j", "DROP", "-w", NULL }, NULL) != 0) {
+            status = 1;
+        }
+
+        if (sim_swns_spawn((const char *[]) {
+                               "iptables", "-A", "FORWARD", "-i", port_name,
+                               "-j", "DROP", "-w", NULL }, NULL) != 0) {
+            status = 1;
+        }
+    }
+
+    return status;
+}
+
+/* The jumps from the builtin chains to the L3 statistics chains of an
+ * interface. */
+static const struct {
+    const char *chain;
+    const char *dir;
+    bool is_ingress;
+} l3stats_jumps[] = {
+    { "INPUT", "-i", true },
+    { "FORWARD", "-i", true },
+    { "FORWARD", "-o", false },
+    { "OUTPUT", "-o", false },
+};
+
+static void
+l3stats_chain_name(const char *if_name, bool is_ingress,
+                   char chain[L3STATS_CHAIN_LEN])
+{
+    snprintf(chain, L3STATS_CHAIN_LEN, "%s%s",
+             is_ingress ? L3STATS_RX_PREFIX : L3STATS_TX_PREFIX, if_name);
+}
+
+/* Adds to 'chains' the names of the user-defined chains of the filter table
+ * of IPv6 if 'is_v6', otherwise of IPv4.  Returns 0 on success, otherwise the
+ * exit status of the listing, in which case 'chains' may be incomplete. */
+static int
+xtables_list_chains(bool is_v6, struct sset *chains)
+{
+    struct ds rules = DS_EMPTY_INITIALIZER;
+    char *line, *save_ptr = NULL;
+    int status;
+
+    status = sim_swns_spawn((const char *[]) {
+                                is_v6 ? "ip6tables" : "iptables", "-S", "-w",
+                                NULL }, &rules);
+    if (!status) {
+        for (line = strtok_r(ds_cstr(&rules), "\n", &save_ptr); line;
+             line = strtok_r(NULL, "\n", &save_ptr)) {
+            if (!strncmp(line, "-N ", 3)) {
+                sset_add(chains, line + 3);
+            }
+        }
+    }
+    ds_destroy(&rules);
+
+    return status;
+}
+
+/* Adds to 'batch' the L3 statistics chains of 'if_name' for IPv6 if 'is_v6',
+ * otherwise for IPv4, and the jumps to them. */
+static void
+l3stats_add_rules(struct xtables_batch *batch, const char *if_name,
+                  bool is_v6)
+{
+    static const char *const pkttypes[] = { "unicast", "multicast" };
+    char chain[L3STATS_CHAIN_LEN];
+    size_t i, j;
+
+    for (i = 0; i < 2; i++) {
+        l3stats_chain_name(if_name, i == 0, chain);
+        xtables_batch_put(batch, is_v6, ":%s - [0:0]", chain);
+        for (j = 0; j < ARRAY_SIZE(pkttypes); j++) {
+            xtables_batch_put(batch, is_v6, "-A %s -m pkttype --pkt-type %s",
+                              chain, pkttypes[j]);
+        }
+    }
+
+    for (i = 0; i < ARRAY_SIZE(l3stats_jumps); i++) {
+        l3stats_chain_name(if_name, l3stats_jumps[i].is_ingress, chain);
+        xtables_batch_put(batch, is_v6, "-A %s %s %s -j %s",
+                          l3stats_jumps[i].chain, l3stats_jumps[i].dir,
+                          if_name, chain);
+    }
+}
+
+/* Adds to 'batch' the removal of the jumps to the L3 statistics chains of
+ * 'if_name' and of the chains themselves. */
+static void
+l3stats_delete_rules(struct xtables_batch *batch, const char *if_name,
+                     bool is_v6)
+{
+    char chain[L3STATS_CHAIN_LEN];
+    size_t i;
+
+    for (i = 0; i < ARRAY_SIZE(l3stats_jumps); i++) {
+        l3stats_chain_name(if_name, l3stats_jumps[i].is_ingress, chain);
+        xtables_batch_put(batch, is_v6, "-D %s %s %s -j %s",
+                          l3stats_jumps[i].chain, l3stats_jumps[i].dir,
+                          if_name, chain);
+    }
+
+    for (i = 0; i < 2; i++) {
+        l3stats_chain_name(if_name, i == 0, chain);
+        xtables_batch_put(batch, is_v6, "-F %s", chain);
+        xtables_batch_put(batch, is_v6, "-X %s", chain);
+    }
+}
+
+/* Removes the L3 statistics chains of the interfaces in 'del_ifs' and adds
+ * those of the interfaces in 'add_ifs', in one batch per family.  Since a
+ * batch applies entirely or not at all, the chains that are already
+ * there, e.g. from before a restart, are not created again, which also keeps
+ * their counters, and the chains that are not there are not deleted.  If the
+ * chains cannot be listed, nothing is changed: creating a chain that exists
+ * would reset its counters and duplicate its jumps. */
+static int
+iptables_l3stats_update(const struct svec *add_ifs,
+                        const struct svec *del_ifs)
+{
+    struct xtables_batch batch;
+    const char *if_name;
+    int is_v6;
+    size_t i;
+
+    xtables_batch_init(&batch);
+    for (is_v6 = 0; is_v6 < 2; is_v6++) {
+        char chain[L3STATS_CHAIN_LEN];
+        struct sset chains;
+        int status;
+
+        sset_init(&chains);
+        status = xtables_list_chains(is_v6, &chains);
+        if (status) {
+            VLOG_WARN("failed to list the %s chains (rc=%d)",
+                      is_v6 ? "ip6tables" : "iptables", status);
+            sset_destroy(&chains);
+            xtables_batch_destroy(&batch);
+            return status;
+        }
+        SVEC_FOR_EACH (i, if_name, del_ifs) {
+            l3stats_chain_name(if_name, true, chain);
+            if (sset_contains(&chains, chain)) {
+                l3stats_delete_rules(&batch, if_name, is_v6);
+            }
+        }
+        SVEC_FOR_EACH (i, if_name, add_ifs) {
+            l3stats_chain_name(if_name, true, chain);
+            if (!sset_contains(&chains, chain)) {
+                l3stats_add_rules(&batch, if_name, is_v6);
+            }
+        }
+        sset_destroy(&chains);
+    }
+    return xtables_batch_commit(&batch);
+}
+
+/* Adds to 'batch' the sFlow sampling rules of 'port', inserted at the head
+ * of the chains if 'op' is "-I". */
+static void
+sflow_put_rules(struct xtables_batch *batch, const char *op,
+                const char *port, const char *probability, int nflog_group)
+{
+    static const struct {
+        const char *chain;
+        const char *dir;
+    } rules[] = {
+        { "INPUT", "-i" },
+        { "OUTPUT", "-o" },
+        { "FORWARD", "-i" },
+        { "FORWARD", "-o" },
+    };
+    size_t i;
+
+    for (i = 0; i < ARRAY_SIZE(rules); i++) {
+        xtables_batch_put(batch, false, "%s %s %s %s -m statistic "
+                          "--mode random --probability %s -j NFLOG "
+                          "--nflog-prefix SFLOW --nflog-group %d",
+                          op, rules[i].chain, rules[i].dir, port,
+                          probability, nflog_group);
+    }
+}
+
+/* Adds to 'rules' the "-A" lines of "iptables -S" that hold an SFLOW rule,
+ * without their "-A ". */
+static int
+iptables_sflow_list(struct svec *rules)
+{
+    static const char *const list_argv[] = { "iptables", "-S", "-w", NULL };
+    struct ds listing = DS_EMPTY_INITIALIZER;
+    char *line, *save_ptr = NULL;
+    int status;
+
+    status = sim_swns_spawn(list_argv, &listing);
+    if (!status) {
+        for (line = strtok_r(ds_cstr(&listing), "\n", &save_ptr); line;
+             line = strtok_r(NULL, "\n", &save_ptr)) {
+            if (strstr(line, "SFLOW") && !strncmp(line, "-A ", 3)) {
+                svec_add(rules, line + 3);
+            }
+        }
+    }
+    ds_destroy(&listing);
+
+    return status;
+}
+
+/* Returns true if 'rule', as listed by iptables_sflow_list(), samples the
+ * packets received or sent on 'port'. */
+static bool
+sflow_rule_has_port(const char *rule, const char *port)
+{
+    static const char *const dirs[] = { " -i ", " -o " };
+    size_t len = strlen(port);
+    size_t i;
+
+    for (i = 0; i < ARRAY_SIZE(dirs); i++) {
+        const char *p = strstr(rule, dirs[i]);
+
+        if (p) {
+            p += strlen(dirs[i]);
+            if (!strncmp(p, port, len) && (p[len] == ' ' || !p[len])) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/* Removes the sampling rules of 'del_ports' and adds those of 'add_ports' in
+ * one batch.  Since a batch applies entirely or not at all, the rules are
+ * checked against the listing first: only the rules that are there are
+ * deleted, and ports that already have rules do not get a second set, so a
+ * rule that an earlier failed batch never installed cannot block the later
+ * ones. */
+static int
+iptables_sflow_update(const struct svec *add_ports,
+                      const struct svec *del_ports,
+                      unsigned int sampling_rate, int nflog_group)
+{
+    struct xtables_batch batch;
+    char probability[32];
+    struct svec rules;
+    const char *port, *rule;
+    size_t i, j;
+    int status;
+
+    svec_init(&rules);
+    status = iptables_sflow_list(&rules);
+    if (status) {
+        svec_destroy(&rules);
+        return status;
+    }
+
+    snprintf(probability, sizeof probability, "%0.12f",
+             1 / (double) sampling_rate);
+
+    xtables_batch_init(&batch);
+    SVEC_FOR_EACH (i, port, del_ports) {
+        SVEC_FOR_EACH (j, rule, &rules) {
+            if (sflow_rule_has_port(rule, port)) {
+                xtables_batch_put(&batch, false, "-D %s", rule);
+            }
+        }
+    }
+    SVEC_FOR_EACH (i, port, add_ports) {
+        bool found = false;
+
+        SVEC_FOR_EACH (j, rule, &rules) {
+            if (sflow_rule_has_port(rule, port)) {
+                found = true;
+                break;
+            }
+        }
+        if (!found) {
+            sflow_put_rules(&batch, "-I", port, probability, nflog_group);
+        }
+    }
+    svec_destroy(&rules);
+
+    return xtables_batch_commit(&batch);
+}
+
+/* Deletes every rule that "iptables -S" lists with an SFLOW prefix, by
+ * turning its "-A" into "-D", in one batch. */
+static int
+iptables_sflow_del_all(void)
+{
+    struct xtables_batch batch;
+    const char *rule;
+    struct svec rules;
+    int status;
+    size_t i;
+
+    svec_init(&rules);
+    status = iptables_sflow_list(&rules);
+    if (status != 0) {
+        svec_destroy(&rules);
+        return status;
+    }
+
+    xtables_batch_init(&batch);
+    SVEC_FOR_EACH (i, rule, &rules) {
+        xtables_batch_put(&batch, false, "-D %s", rule);
+    }
+    svec_destroy(&rules);
+
+    return xtables_batch_commit(&batch);
+}
+
+/* A rule as listed by "iptables -S -v", e.g.
+ * "-A L3RX-1 -m pkttype --pkt-type unicast -c 10 840".  The strings point
+ * into the parsed line. */
+struct xtables_rule {
+    const char *chain;          /* "INPUT", "OUTPUT", "FORWARD", ... */
+    const char *in_if;          /* "-i" argument, or NULL. */
+    const char *out_if;         /* "-o" argument, or NULL. */
+    const char *pkttype;        /* "--pkt-type" argument, or NULL. */
+    bool sflow;                 /* NFLOG rule with the SFLOW prefix. */
+    uint64_t packets;           /* "-c" counters. */
+    uint64_t bytes;
+};
+
+/* Parses 'line', one line of "iptables -S -v" output, into 'rule'.  'line'
+ * is modified.  Returns false if 'line' does not append a rule to a chain. */
+static bool
+xtables_parse_rule(char *line, struct xtables_rule *rule)
+{
+    char *save_ptr = NULL;
+    char *word;
+
+    memset(rule, 0, sizeof *rule);
+
+    word = strtok_r(line, " \t", &save_ptr);
+    if (!word || strcmp(word, "-A")) {
+        return false;
+    }
+    rule->chain = strtok_r(NULL, " \t", &save_ptr);
+    if (!rule->chain) {
+        return false;
+    }
+
+    while ((word = strtok_r(NULL, " \t", &save_ptr)) != NULL) {
+        if (!strcmp(word, "-i")) {
+            rule->in_if = strtok_r(NULL, " \t", &save_ptr);
+        } else if (!strcmp(word, "-o")) {
+            rule->out_if = strtok_r(NULL, " \t", &save_ptr);
+        } else if (!strcmp(word, "--pkt-type")) {
+            rule->pkttype = strtok_r(NULL, " \t", &save_ptr);
+        } else if (!strcmp(word, "--nflog-prefix")) {
+            word = strtok_r(NULL, " \t", &save_ptr);
+            rule->sflow = word && strstr(word, "SFLOW");
+        } else if (!strcmp(word, "-c")) {
+            word = strtok_r(NULL, " \t", &save_ptr);
+            rule->packets = word ? strtoull(word, NULL, 10) : 0;
+            word = strtok_r(NULL, " \t", &save_ptr);
+            rule->bytes = word ? strtoull(word, NULL, 10) : 0;
+        }
+    }
+    return true;
+}
+
+/* Adds the counters of the L3 statistics rule 'rule' of 'if_name' in one
+ * direction to 'stats'. */
+static void
+xtables_account_l3(struct shash *stats, const char *if_name, bool is_v6,
+                   bool is_ingress, const struct xtables_rule *rule)
+{
+    struct sim_firewall_l3_stats *l3;
+
+    l3 = &sim_firewall_if_stats_get(stats, if_name)->l3[is_v6][is_ingress];
+    if (!strcmp(rule->pkttype, "unicast")) {
+        l3->uc_packets += rule->packets;
+        l3->uc_bytes += rule->bytes;
+    } else if (!strcmp(rule->pkttype, "multicast")) {
+        l3->mc_packets += rule->packets;
+        l3->mc_bytes += rule->bytes;
+    }
+}
+
+static void
+xtables_account_sflow(struct shash *stats, const char *if_name,
+                      bool is_ingress, const struct xtables_rule *rule)
+{
+    struct sim_firewall_if_stats *ifs;
+
+    ifs = sim_firewall_if_stats_get(stats, if_name);
+    ifs->sflow_packets[is_ingress] += rule->packets;
+    ifs->sflow_bytes[is_ingress] += rule->bytes;
+}
+
+/* Lists the rules of iptables, or of ip6tables if 'is_v6', in the switch
+ * namespace, with their counters, and adds the counters to 'stats'. */
+static int
+xtables_dump_stats(struct shash *stats, bool is_v6)
+{
+    const char *xtables_cmd = is_v6 ? "ip6tables" : "iptables";
+    struct ds rules = DS_EMPTY_INITIALIZER;
+    char *line, *save_ptr = NULL;
+
+    if (sim_swns_spawn((const char *[]) { xtables_cmd, "-S", "-v", "-w",
+                                          NULL }, &rules) != 0) {
+        VLOG_DBG("Failed to list %s rules for statistics", xtables_cmd);
+        ds_destroy(&rules);
+        return 1;
+    }
+
+    for (line = strtok_r(ds_cstr(&rules), "\n", &save_ptr); line;
+         line = strtok_r(NULL, "\n", &save_ptr)) {
+        struct xtables_rule rule;
+
+        if (!xtables_parse_rule(line, &rule)) {
+            continue;
+        }
+
+        if (rule.sflow) {
+            if (is_v6) {
+                continue;
+            }
+            if (rule.in_if) {
+                xtables_account_sflow(stats, rule.in_if, true, &rule);
+            }
+            if (rule.out_if) {
+                xtables_account_sflow(stats, rule.out_if, false, &rule);
+            }
+        } else if (rule.pkttype) {
+            const char *chain = rule.chain;
+
+            if (!strncmp(chain, L3STATS_RX_PREFIX,
+                         strlen(L3STATS_RX_PREFIX))) {
+                xtables_account_l3(stats, chain + strlen(L3STATS_RX_PREFIX),
+                                   is_v6, true, &rule);
+            } else if (!strncmp(chain, L3STATS_TX_PREFIX,
+                                strlen(L3STATS_TX_PREFIX))) {
+                xtables_account_l3(stats, chain + strlen(L3STATS_TX_PREFIX),
+                                   is_v6, false, &rule);
+            }
+        }
+    }
+    ds_destroy(&rules);
+    return 0;
+}
+
+static int
+iptables_dump_stats(struct shash *stats)
+{
+    return (xtables_dump_stats(stats, false)
+            | xtables_dump_stats(stats, true));
+}
+
+const struct sim_firewall_class sim_firewall_iptables_class = {
+    "iptables",
+    iptables_init,
+    iptables_l2_port_set,
+    iptables_l3stats_update,
+    iptables_sflow_update,
+    iptables_sflow_del_all,
+    iptables_dump_stats,
+};
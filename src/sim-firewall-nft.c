@@ -0,0 +1,440 @@
+/*
+ * (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Firewall backend on nftables.
+ *
+ * All the state lives in one "inet" table, NFT_TABLE, so IPv4 and IPv6 share
+ * the same rules and nothing else in the namespace is touched:
+ *
+ *   - The set "l2_ports" holds the L2 ports, whose IPv4 traffic the input
+ *     and forward chains drop.
+ *
+ *   - The verdict maps "l3rx" and "l3tx" send the packets of each L3
+ *     interface, by input and output interface name, to its "l3rx-<if>" and
+ *     "l3tx-<if>" chains, which count them by family and packet type.  A
+ *     packet costs one hash lookup whatever the number of L3 interfaces.
+ *
+ *   - The verdict maps "sflowrx" and "sflowtx" likewise send the packets of
+ *     the sFlow ports to their "sflowrx-<port>" and "sflowtx-<port>" chains,
+ *     which sample them to NFLOG.
+ *
+ * Every update is one "nft -f" script, which the kernel applies as a single
+ * nfnetlink batch: it takes effect entirely or not at all. */
+
+#include <config.h>
+
+#include "sim-firewall.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dynamic-string.h"
+#include "shash.h"
+#include "sim-swns.h"
+#include "sset.h"
+#include "svec.h"
+#include "util.h"
+#include "openvswitch/vlog.h"
+
+VLOG_DEFINE_THIS_MODULE(sim_firewall_nft);
+
+#define NFT_TABLE "inet ops_sim"
+
+/* Applies 'script' atomically in the switch namespace.  Returns the exit
+ * status of nft. */
+static int
+nft_apply(const struct ds *script)
+{
+    static const char *const argv[] = { "nft", "-f", "-", NULL };
+    int status;
+
+    status = sim_swns_spawn_input(argv, ds_cstr_ro(script), NULL);
+    if (status != 0) {
+        VLOG_DBG("nft script failed (status %d):\n%s", status,
+                 ds_cstr_ro(script));
+    }
+    return status;
+}
+
+/* Lists NFT_TABLE, with its counters, into 'output'. */
+static int
+nft_list_table(struct ds *output)
+{
+    return sim_swns_spawn((const char *[]) { "nft", "list", "table", "inet",
+                                             "ops_sim", NULL }, output);
+}
+
+static int
+nft_init(void)
+{
+    struct ds s = DS_EMPTY_INITIALIZER;
+    int status;
+
+    ds_put_cstr(&s, "add table "NFT_TABLE"\n");
+    ds_put_cstr(&s, "add set "NFT_TABLE" l2_ports { type ifname; }\n");
+    ds_put_cstr(&s, "add map "NFT_TABLE" l3rx { type ifname : verdict; }\n");
+    ds_put_cstr(&s, "add map "NFT_TABLE" l3tx { type ifname : verdict; }\n");
+    ds_put_cstr(&s, "add map "NFT_TABLE" sflowrx "
+                "{ type ifname : verdict; }\n");
+    ds_put_cstr(&s, "add map "NFT_TABLE" sflowtx "
+                "{ type ifname : verdict; }\n");
+
+    ds_put_cstr(&s, "add chain "NFT_TABLE" input "
+                "{ type filter hook input priority 0; }\n");
+    ds_put_cstr(&s, "add chain "NFT_TABLE" forward "
+                "{ type filter hook forward priority 0; }\n");
+    ds_put_cstr(&s, "add chain "NFT_TABLE" output "
+                "{ type filter hook output priority 0; }\n");
+    ds_put_cstr(&s, "flush chain "NFT_TABLE" input\n");
+    ds_put_cstr(&s, "flush chain "NFT_TABLE" forward\n");
+    ds_put_cstr(&s, "flush chain "NFT_TABLE" output\n");
+
+    /* Sampling comes first, as the iptables rules are inserted at the head
+     * of their chains, then the L2 drops, then the L3 counters. */
+    ds_put_cstr(&s, "add rule "NFT_TABLE" input iifname vmap @sflowrx\n");
+    ds_put_cstr(&s, "add rule "NFT_TABLE" input "
+                "meta nfproto ipv4 iifname @l2_ports drop\n");
+    ds_put_cstr(&s, "add rule "NFT_TABLE" input iifname vmap @l3rx\n");
+
+    ds_put_cstr(&s, "add rule "NFT_TABLE" forward iifname vmap @sflowrx\n");
+    ds_put_cstr(&s, "add rule "NFT_TABLE" forward oifname vmap @sflowtx\n");
+    ds_put_cstr(&s, "add rule "NFT_TABLE" forward "
+                "meta nfproto ipv4 iifname @l2_ports drop\n");
+    ds_put_cstr(&s, "add rule "NFT_TABLE" forward iifname vmap @l3rx\n");
+    ds_put_cstr(&s, "add rule "NFT_TABLE" forward oifname vmap @l3tx\n");
+
+    ds_put_cstr(&s, "add rule "NFT_TABLE" output oifname vmap @sflowtx\n");
+    ds_put_cstr(&s, "add rule "NFT_TABLE" output oifname vmap @l3tx\n");
+
+    status = nft_apply(&s);
+    ds_destroy(&s);
+
+    return status;
+}
+
+static int
+nft_l2_port_set(const char *port, bool drop)
+{
+    struct ds s = DS_EMPTY_INITIALIZER;
+    int status;
+
+    ds_put_format(&s, "%s element "NFT_TABLE" l2_ports { \"%s\" }\n",
+                  drop ? "add" : "delete", port);
+    status = nft_apply(&s);
+    ds_destroy(&s);
+
+    return status;
+}
+
+/* Appends to 's' the commands that create the chain 'prefix'-'if_name',
+ * holding 'rules', and map 'if_name' to it in the map 'prefix'. */
+static void
+nft_put_if_chain(struct ds *s, const char *prefix, const char *if_name,
+                 const char *const rules[], size_t n_rules)
+{
+    size_t i;
+
+    ds_put_format(s, "add chain "NFT_TABLE" %s-%s\n", prefix, if_name);
+    ds_put_format(s, "flush chain "NFT_TABLE" %s-%s\n", prefix, if_name);
+    for (i = 0; i < n_rules; i++) {
+        ds_put_format(s, "add rule "NFT_TABLE" %s-%s %s\n",
+                      prefix, if_name, rules[i]);
+    }
+    ds_put_format(s, "add element "NFT_TABLE" %s { \"%s\" : jump %s-%s }\n",
+                  prefix, if_name, prefix, if_name);
+}
+
+/* Appends to 's' the commands that undo nft_put_if_chain(). */
+static void
+nft_put_if_chain_delete(struct ds *s, const char *prefix,
+                        const char *if_name)
+{
+    ds_put_format(s, "delete element "NFT_TABLE" %s { \"%s\" }\n",
+                  prefix, if_name);
+    ds_put_format(s, "flush chain "NFT_TABLE" %s-%s\n", prefix, if_name);
+    ds_put_format(s, "delete chain "NFT_TABLE" %s-%s\n", prefix, if_name);
+}
+
+/* Adds to 'chains' the names of the chains of NFT_TABLE. */
+static int
+nft_list_chains(struct sset *chains)
+{
+    struct ds listing = DS_EMPTY_INITIALIZER;
+    char *line, *save_ptr = NULL;
+    int status;
+
+    status = nft_list_table(&listing);
+    if (!status) {
+        for (line = strtok_r(ds_cstr(&listing), "\n", &save_ptr); line;
+             line = strtok_r(NULL, "\n", &save_ptr)) {
+            char chain[64];
+
+            if (sscanf(line, " chain %63s", chain) == 1) {
+                sset_add(chains, chain);
+            }
+        }
+    }
+    ds_destroy(&listing);
+
+    return status;
+}
+
+/* Removes the counter chains of 'del_ifs' and adds those of 'add_ifs' in one
+ * transaction.  Chains that are already there, e.g. from before a restart,
+ * keep their counters. */
+static int
+nft_l3stats_update(const struct svec *add_ifs, const struct svec *del_ifs)
+{
+    static const char *const rules[] = {
+        "meta nfproto ipv4 meta pkttype unicast counter",
+        "meta nfproto ipv4 meta pkttype multicast counter",
+        "meta nfproto ipv6 meta pkttype unicast counter",
+        "meta nfproto ipv6 meta pkttype multicast counter",
+    };
+    struct ds s = DS_EMPTY_INITIALIZER;
+    const char *if_name;
+    struct sset chains;
+    char chain[64];
+    int status;
+    size_t i;
+
+    sset_init(&chains);
+    status = nft_list_chains(&chains);
+    if (status) {
+        VLOG_WARN("failed to list the chains of "NFT_TABLE" (status %d)",
+                  status);
+        sset_destroy(&chains);
+        return status;
+    }
+
+    SVEC_FOR_EACH (i, if_name, del_ifs) {
+        snprintf(chain, sizeof chain, "l3rx-%s", if_name);
+        if (sset_contains(&chains, chain)) {
+            nft_put_if_chain_delete(&s, "l3rx", if_name);
+            nft_put_if_chain_delete(&s, "l3tx", if_name);
+        }
+    }
+    SVEC_FOR_EACH (i, if_name, add_ifs) {
+        snprintf(chain, sizeof chain, "l3rx-%s", if_name);
+        if (!sset_contains(&chains, chain)) {
+            nft_put_if_chain(&s, "l3rx", if_name, rules, ARRAY_SIZE(rules));
+            nft_put_if_chain(&s, "l3tx", if_name, rules, ARRAY_SIZE(rules));
+        }
+    }
+    status = s.length ? nft_apply(&s) : 0;
+    sset_destroy(&chains);
+    ds_destroy(&s);
+
+    return status;
+}
+
+/* Removes the sampling chains of 'del_ports' and (re)creates those of
+ * 'add_ports' in one transaction.  Only the chains that are there are
+ * deleted, so that a port left behind by a failed update does not make every
+ * later one fail too. */
+static int
+nft_sflow_update(const struct svec *add_ports, const struct svec *del_ports,
+                 unsigned int sampling_rate, int nflog_group)
+{
+    struct ds s = DS_EMPTY_INITIALIZER;
+    const char *port;
+    struct sset chains;
+    char chain[64];
+    char *rule;
+    size_t i;
+    int status;
+
+    sset_init(&chains);
+    status = nft_list_chains(&chains);
+    if (status) {
+        VLOG_WARN("failed to list the chains of "NFT_TABLE" (status %d)",
+                  status);
+        sset_destroy(&chains);
+        return status;
+    }
+
+    rule = xasprintf("meta nfproto ipv4 numgen random mod %u == 0 counter "
+                     "log prefix \"SFLOW\" group %d",
+                     sampling_rate ? sampling_rate : 1, nflog_group);
+
+    SVEC_FOR_EACH (i, port, del_ports) {
+        snprintf(chain, sizeof chain, "sflowrx-%s", port);
+        if (sset_contains(&chains, chain)) {
+            nft_put_if_chain_delete(&s, "sflowrx", port);
+            nft_put_if_chain_delete(&s, "sflowtx", port);
+        }
+    }
+    SVEC_FOR_EACH (i, port, add_ports) {
+        const char *const rules[] = { rule };
+
+        nft_put_if_chain(&s, "sflowrx", port, rules, 1);
+        nft_put_if_chain(&s, "sflowtx", port, rules, 1);
+    }
+    status = s.length ? nft_apply(&s) : 0;
+    sset_destroy(&chains);
+    free(rule);
+    ds_destroy(&s);
+
+    return status;
+}
+
+/* Calls 'cb' for every line of 'listing', an "nft list table" output, that
+ * holds a counter, with the name of the chain it is in. */
+static void
+nft_for_each_counter(char *listing,
+                     void (*cb)(const char *chain, const char *rule,
+                                uint64_t packets, uint64_t bytes, void *aux),
+                     void *aux)
+{
+    char chain[64] = "";
+    char *line, *save_ptr = NULL;
+
+    for (line = strtok_r(listing, "\n", &save_ptr); line;
+         line = strtok_r(NULL, "\n", &save_ptr)) {
+        unsigned long long int packets, bytes;
+        const char *counter;
+
+        if (sscanf(line, " chain %63s", chain) == 1) {
+            continue;
+        }
+        counter = strstr(line, "counter packets ");
+        if (counter && chain[0]
+            && sscanf(counter, "counter packets %llu bytes %llu",
+                      &packets, &bytes) == 2) {
+            cb(chain, line, packets, bytes, aux);
+        }
+    }
+}
+
+static bool
+nft_chain_has_prefix(const char *chain, const char *prefix,
+                     const char **if_name)
+{
+    size_t len = strlen(prefix);
+
+    if (!strncmp(chain, prefix, len) && chain[len]) {
+        *if_name = chain + len;
+        return true;
+    }
+    return false;
+}
+
+static void
+nft_account_counter(const char *chain, const char *rule, uint64_t packets,
+                    uint64_t bytes, void *stats_)
+{
+    struct shash *stats = stats_;
+    struct sim_firewall_if_stats *ifs;
+    const char *if_name;
+    bool is_ingress;
+
+    if (nft_chain_has_prefix(chain, "sflowrx-", &if_name)
+        || nft_chain_has_prefix(chain, "sflowtx-", &if_name)) {
+        is_ingress = chain[5] == 'r';
+        ifs = sim_firewall_if_stats_get(stats, if_name);
+        ifs->sflow_packets[is_ingress] += packets;
+        ifs->sflow_bytes[is_ingress] += bytes;
+    } else if (nft_chain_has_prefix(chain, "l3rx-", &if_name)
+               || nft_chain_has_prefix(chain, "l3tx-", &if_name)) {
+        struct sim_firewall_l3_stats *l3;
+        bool is_v6 = strstr(rule, "ipv6") != NULL;
+
+        is_ingress = chain[2] == 'r';
+        ifs = sim_firewall_if_stats_get(stats, if_name);
+        l3 = &ifs->l3[is_v6][is_ingress];
+        if (strstr(rule, "multicast")) {
+            l3->mc_packets += packets;
+            l3->mc_bytes += bytes;
+        } else if (strstr(rule, "unicast")) {
+            l3->uc_packets += packets;
+            l3->uc_bytes += bytes;
+        }
+    }
+}
+
+static int
+nft_dump_stats(struct shash *stats)
+{
+    struct ds listing = DS_EMPTY_INITIALIZER;
+    int status;
+
+    status = nft_list_table(&listing);
+    if (!status) {
+        nft_for_each_counter(ds_cstr(&listing), nft_account_counter, stats);
+    } else {
+        VLOG_DBG("Failed to list the %s table for statistics", NFT_TABLE);
+    }
+    ds_destroy(&listing);
+
+    return status;
+}
+
+static void
+nft_collect_sflow_chain(const char *chain, const char *rule OVS_UNUSED,
+                        uint64_t packets OVS_UNUSED,
+                        uint64_t bytes OVS_UNUSED, void *ports_)
+{
+    struct svec *ports = ports_;
+    const char *port;
+
+    if (nft_chain_has_prefix(chain, "sflowrx-", &port)) {
+        svec_add(ports, port);
+    }
+}
+
+static int
+nft_sflow_del_all(void)
+{
+    struct ds listing = DS_EMPTY_INITIALIZER;
+    struct ds s = DS_EMPTY_INITIALIZER;
+    struct svec ports;
+    const char *port;
+    size_t i;
+    int status;
+
+    svec_init(&ports);
+    status = nft_list_table(&listing);
+    if (!status) {
+        nft_for_each_counter(ds_cstr(&listing), nft_collect_sflow_chain,
+                             &ports);
+
+        ds_put_cstr(&s, "flush map "NFT_TABLE" sflowrx\n");
+        ds_put_cstr(&s, "flush map "NFT_TABLE" sflowtx\n");
+        SVEC_FOR_EACH (i, port, &ports) {
+            ds_put_format(&s, "flush chain "NFT_TABLE" sflowrx-%s\n", port);
+            ds_put_format(&s, "delete chain "NFT_TABLE" sflowrx-%s\n", port);
+            ds_put_format(&s, "flush chain "NFT_TABLE" sflowtx-%s\n", port);
+            ds_put_format(&s, "delete chain "NFT_TABLE" sflowtx-%s\n", port);
+        }
+        status = nft_apply(&s);
+    }
+    svec_destroy(&ports);
+    ds_destroy(&listing);
+    ds_destroy(&s);
+
+    return status;
+}
+
+const struct sim_firewall_class sim_firewall_nft_class = {
+    "nftables",
+    nft_init,
+    nft_l2_port_set,
+    nft_l3stats_update,
+    nft_sflow_update,
+    nft_sflow_del_all,
+    nft_dump_stats,
+};
@@ -0,0 +1,100 @@
+/*
+ * (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <config.h>
+
+#include "sim-firewall.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ovs-thread.h"
+#include "shash.h"
+#include "util.h"
+#include "openvswitch/vlog.h"
+
+VLOG_DEFINE_THIS_MODULE(sim_firewall);
+
+static const struct sim_firewall_class *const firewall_classes[] = {
+    &sim_firewall_iptables_class,
+    &sim_firewall_nft_class,
+};
+
+static const struct sim_firewall_class *firewall_class;
+
+/* Selects the backend named by SIM_FIREWALL_ENV, falling back to iptables.
+ * It is safe to call this more than once. */
+void
+sim_firewall_init(void)
+{
+    static struct ovsthread_once once = OVSTHREAD_ONCE_INITIALIZER;
+    const struct sim_firewall_class *class = &sim_firewall_iptables_class;
+    const char *name;
+    size_t i;
+
+    if (!ovsthread_once_start(&once)) {
+        return;
+    }
+
+    name = getenv(SIM_FIREWALL_ENV);
+    if (name && name[0]) {
+        for (i = 0; i < ARRAY_SIZE(firewall_classes); i++) {
+            if (!strcmp(name, firewall_classes[i]->name)) {
+                break;
+            }
+        }
+        if (i < ARRAY_SIZE(firewall_classes)) {
+            class = firewall_classes[i];
+        } else {
+            VLOG_WARN("%s: unknown firewall backend \"%s\"",
+                      SIM_FIREWALL_ENV, name);
+        }
+    }
+
+    if (class->init() && class != &sim_firewall_iptables_class) {
+        VLOG_WARN("%s firewall backend unavailable, using %s", class->name,
+                  sim_firewall_iptables_class.name);
+        class = &sim_firewall_iptables_class;
+        class->init();
+    }
+    VLOG_INFO("using the %s firewall backend", class->name);
+    firewall_class = class;
+
+    ovsthread_once_done(&once);
+}
+
+/* Returns the firewall backend in use. */
+const struct sim_firewall_class *
+sim_firewall(void)
+{
+    sim_firewall_init();
+    return firewall_class;
+}
+
+/* Returns the counters of 'if_name' in 'stats', adding zeroed ones if it has
+ * none yet.  For use by the backends' dump_stats(). */
+struct sim_firewall_if_stats *
+sim_firewall_if_stats_get(struct shash *stats, const char *if_name)
+{
+    struct sim_firewall_if_stats *ifs;
+
+    ifs = shash_find_data(stats, if_name);
+    if (!ifs) {
+        ifs = xzalloc(sizeof *ifs);
+        shash_add(stats, if_name, ifs);
+    }
+    return ifs;
+}
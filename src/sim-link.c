@@ -0,0 +1,1237 @@
+/*
+ * (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <config.h>
+
+#include "sim-link.h"
+
+#include <errno.h>
+#include <string.h>
+#include <net/if.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/pkt_sched.h>
+#include <linux/rtnetlink.h>
+#ifdef HAVE_LINUX_ETHTOOL_NETLINK_H
+#include <linux/ethtool.h>
+#include <linux/ethtool_netlink.h>
+#include <linux/genetlink.h>
+#endif
+
+#include "ovs-thread.h"
+#include "poll-loop.h"
+#include "shash.h"
+#include "sim-executor.h"
+#include "sim-swns.h"
+#include "util.h"
+#include "openvswitch/vlog.h"
+
+VLOG_DEFINE_THIS_MODULE(sim_link);
+
+#define SIM_LINK_EXEC_KEY "link-config"
+#define SIM_LINK_MAC_LEN 6
+
+/* Room for the messages of one interface, in both the rtnetlink batch and
+ * the ethtool batch.  The former has the deletion and creation of its VLAN
+ * device, an RTM_NEWLINK with the IFNAME, MTU and ADDRESS attributes, and the
+ * deletion and creation of its root qdisc and of its prio qdisc.  The latter
+ * has the features, channels, pause and link modes requests, and the queries
+ * of the pause and link modes. */
+#define SIM_LINK_MSGS_MAX 1024
+#define SIM_LINK_N_MSGS_MAX 8
+
+/* Qdisc handles of the queues of an interface.  The prio qdisc keeps handle
+ * "1:" whether it is the root or the child of the shaper, so that its bands
+ * are always classes 1:1 to 1:SIM_LINK_N_QUEUES. */
+#define SIM_LINK_PRIO_HANDLE 0x10000    /* "1:" */
+#define SIM_LINK_TBF_HANDLE 0x100000    /* "10:" */
+#define SIM_LINK_N_QUEUES 8
+
+/* Shaper buffer and queue, as time at the shaped rate. */
+#define SIM_LINK_TBF_BURST_DIV 250      /* 4 ms. */
+#define SIM_LINK_TBF_BURST_MIN 65536
+#define SIM_LINK_TBF_LATENCY_DIV 50     /* 20 ms. */
+
+/* Pause and autonegotiation state of an interface, as reported by its
+ * driver after they were last set. */
+struct sim_link_report {
+    bool has_pause;             /* Whether 'rx_pause' and 'tx_pause' are. */
+    bool rx_pause;
+    bool tx_pause;
+    bool has_autoneg;           /* Whether 'autoneg' is. */
+    bool autoneg;
+};
+
+/* The changes of one interface that are still to be applied. */
+struct sim_link_change {
+    bool set_vlan;
+    char vlan_parent[IFNAMSIZ]; /* Empty to delete the interface. */
+    uint16_t vlan_id;
+    bool set_mtu;
+    uint32_t mtu;
+    bool set_mac;
+    uint8_t mac[SIM_LINK_MAC_LEN];
+    bool set_admin;
+    bool up;
+    bool set_queues;
+    uint64_t rate;              /* Shaping rate in bytes/s, 0 if unshaped. */
+    unsigned int features_set;  /* 1 << SIM_LINK_F_* of features to set. */
+    unsigned int features_on;   /* Those of them to turn on. */
+    uint32_t rx_channels;       /* 0 to leave unchanged. */
+    uint32_t tx_channels;       /* 0 to leave unchanged. */
+    bool set_pause;
+    bool pause_rx;
+    bool pause_tx;
+    bool set_autoneg;
+    bool autoneg;
+
+    /* Set by the job from the interfaces in the kernel, if 'set_vlan'. */
+    int vlan_parent_ifindex;    /* Index of 'vlan_parent', 0 if none. */
+    bool vlan_exists;           /* Whether the interface exists. */
+    bool vlan_matches;          /* And is already the requested device. */
+
+    int error;                  /* Set by the job: 0 or a positive errno. */
+    struct sim_link_report report;      /* Set by the job. */
+};
+
+/* A request sent for a change. */
+struct sim_link_msg {
+    struct sim_link_change *change;
+    unsigned int seq;
+    bool may_fail;              /* Failure does not fail the change. */
+
+    /* Called for the reply to the request, if nonnull. */
+    void (*parse)(const struct nlmsghdr *, struct sim_link_change *);
+};
+
+/* Changes taken by one job, by interface name. */
+struct sim_link_batch {
+    struct shash changes;
+    unsigned int n_sends;       /* Number of batches sent to the kernel. */
+};
+
+/* Changes recorded since the last job. */
+static struct shash pending_changes = SHASH_INITIALIZER(&pending_changes);
+
+/* Last 'struct sim_link_report' of each interface, by name. */
+static struct ovs_mutex reports_mutex = OVS_MUTEX_INITIALIZER;
+static struct shash reports OVS_GUARDED_BY(reports_mutex)
+    = SHASH_INITIALIZER(&reports);
+
+static struct sim_link_change *
+sim_link_change_get(const char *name)
+{
+    struct sim_link_change *change = shash_find_data(&pending_changes, name);
+
+    if (!change) {
+        change = xzalloc(sizeof *change);
+        shash_add(&pending_changes, name, change);
+    }
+    return change;
+}
+
+/* Replaces interface 'name' by an 802.1Q device on interface 'parent' for
+ * VLAN 'vlan_id', or deletes it if 'parent' is null.  Its other changes are
+ * then applied to the new device. */
+void
+sim_link_set_vlan(const char *name, const char *parent, uint16_t vlan_id)
+{
+    struct sim_link_change *change = sim_link_change_get(name);
+
+    change->set_vlan = true;
+    ovs_strlcpy(change->vlan_parent, parent ? parent : "",
+                sizeof change->vlan_parent);
+    change->vlan_id = vlan_id;
+}
+
+/* Sets the MTU of interface 'name' to 'mtu'. */
+void
+sim_link_set_mtu(const char *name, uint32_t mtu)
+{
+    struct sim_link_change *change = sim_link_change_get(name);
+
+    change->set_mtu = true;
+    change->mtu = mtu;
+}
+
+/* Sets the MAC address of interface 'name' to 'mac'. */
+void
+sim_link_set_mac(const char *name, const uint8_t mac[SIM_LINK_MAC_LEN])
+{
+    struct sim_link_change *change = sim_link_change_get(name);
+
+    change->set_mac = true;
+    memcpy(change->mac, mac, SIM_LINK_MAC_LEN);
+}
+
+/* Brings interface 'name' administratively up if 'up' is true, otherwise
+ * down. */
+void
+sim_link_set_up(const char *name, bool up)
+{
+    struct sim_link_change *change = sim_link_change_get(name);
+
+    change->set_admin = true;
+    change->up = up;
+}
+
+/* Installs the queues of interface 'name': a prio qdisc with one band per
+ * queue, below a tbf qdisc that shapes the interface to 'rate' bytes per
+ * second if 'rate' is nonzero.  This resets the queue counters. */
+void
+sim_link_set_queues(const char *name, uint64_t rate)
+{
+    struct sim_link_change *change = sim_link_change_get(name);
+
+    change->set_queues = true;
+    change->rate = rate;
+}
+
+/* Turns 'feature' of interface 'name' on if 'on' is true, otherwise off. */
+void
+sim_link_set_feature(const char *name, enum sim_link_feature feature,
+                     bool on)
+{
+    struct sim_link_change *change = sim_link_change_get(name);
+
+    change->features_set |= 1u << feature;
+    if (on) {
+        change->features_on |= 1u << feature;
+    } else {
+        change->features_on &= ~(1u << feature);
+    }
+}
+
+/* Sets the number of receive and transmit channels of interface 'name' to
+ * 'rx' and 'tx'.  A count of 0 leaves that count unchanged. */
+void
+sim_link_set_channels(const char *name, uint32_t rx, uint32_t tx)
+{
+    struct sim_link_change *change = sim_link_change_get(name);
+
+    if (rx) {
+        change->rx_channels = rx;
+    }
+    if (tx) {
+        change->tx_channels = tx;
+    }
+}
+
+/* Sets the pause frame reception and transmission of interface 'name', and
+ * queries them back from its driver. */
+void
+sim_link_set_pause(const char *name, bool rx, bool tx)
+{
+    struct sim_link_change *change = sim_link_change_get(name);
+
+    change->set_pause = true;
+    change->pause_rx = rx;
+    change->pause_tx = tx;
+}
+
+/* Turns the autonegotiation of interface 'name', of its link modes and of
+ * its pause frames, on if 'autoneg' is true, otherwise off, and queries it
+ * back from its driver. */
+void
+sim_link_set_autoneg(const char *name, bool autoneg)
+{
+    struct sim_link_change *change = sim_link_change_get(name);
+
+    change->set_autoneg = true;
+    change->autoneg = autoneg;
+}
+
+/* Stores in '*rx' and '*tx' the pause frame state that the driver of
+ * interface 'name' reported after it was last set, and returns true.  Returns
+ * false if the driver does not support pause frames or has not reported
+ * yet. */
+bool
+sim_link_get_pause(const char *name, bool *rx, bool *tx)
+{
+    const struct sim_link_report *report;
+    bool found = false;
+
+    ovs_mutex_lock(&reports_mutex);
+    report = shash_find_data(&reports, name);
+    if (report && report->has_pause) {
+        *rx = report->rx_pause;
+        *tx = report->tx_pause;
+        found = true;
+    }
+    ovs_mutex_unlock(&reports_mutex);
+
+    return found;
+}
+
+/* Stores in '*autoneg' whether the driver of interface 'name' reported
+ * autonegotiation on after it was last set, and returns true.  Returns false
+ * if the driver does not support link modes or has not reported yet. */
+bool
+sim_link_get_autoneg(const char *name, bool *autoneg)
+{
+    const struct sim_link_report *report;
+    bool found = false;
+
+    ovs_mutex_lock(&reports_mutex);
+    report = shash_find_data(&reports, name);
+    if (report && report->has_autoneg) {
+        *autoneg = report->autoneg;
+        found = true;
+    }
+    ovs_mutex_unlock(&reports_mutex);
+
+    return found;
+}
+
+static struct rtattr *
+sim_link_put_attr(struct nlmsghdr *nlh, unsigned short type,
+                  const void *data, size_t len)
+{
+    struct rtattr *rta;
+
+    rta = (struct rtattr *) ((char *) nlh + NLMSG_ALIGN(nlh->nlmsg_len));
+    rta->rta_type = type;
+    rta->rta_len = RTA_LENGTH(len);
+    if (len) {
+        memcpy(RTA_DATA(rta), data, len);
+    }
+    nlh->nlmsg_len = NLMSG_ALIGN(nlh->nlmsg_len) + RTA_ALIGN(rta->rta_len);
+    return rta;
+}
+
+/* Closes 'nest', an attribute added with sim_link_put_attr() whose nested
+ * attributes were added after it. */
+static void
+sim_link_end_nested(struct nlmsghdr *nlh, struct rtattr *nest)
+{
+    nest->rta_len = (char *) nlh + nlh->nlmsg_len - (char *) nest;
+}
+
+static struct nlmsghdr *
+sim_link_put_header(char *buf, uint16_t type, uint16_t flags,
+                    size_t payload_len, unsigned int seq)
+{
+    struct nlmsghdr *nlh = (struct nlmsghdr *) buf;
+
+    nlh->nlmsg_len = NLMSG_LENGTH(payload_len);
+    nlh->nlmsg_type = type;
+    nlh->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK | flags;
+    nlh->nlmsg_seq = seq;
+    return nlh;
+}
+
+/* Composes in 'buf', which must be zeroed, the RTM_NEWLINK request that
+ * applies the link changes of 'change' to interface 'name'.  Returns its
+ * aligned length. */
+static size_t
+sim_link_put_link_msg(char *buf, const char *name,
+                      const struct sim_link_change *change, unsigned int seq)
+{
+    struct nlmsghdr *nlh;
+    struct ifinfomsg *ifi;
+
+    nlh = sim_link_put_header(buf, RTM_NEWLINK, 0, sizeof *ifi, seq);
+
+    /* No ifindex: the kernel looks the interface up by IFLA_IFNAME. */
+    ifi = NLMSG_DATA(nlh);
+    ifi->ifi_family = AF_UNSPEC;
+    if (change->set_admin) {
+        ifi->ifi_change = IFF_UP;
+        ifi->ifi_flags = change->up ? IFF_UP : 0;
+    }
+
+    sim_link_put_attr(nlh, IFLA_IFNAME, name, strlen(name) + 1);
+    if (change->set_mtu) {
+        sim_link_put_attr(nlh, IFLA_MTU, &change->mtu, sizeof change->mtu);
+    }
+    if (change->set_mac) {
+        sim_link_put_attr(nlh, IFLA_ADDRESS, change->mac, SIM_LINK_MAC_LEN);
+    }
+    return NLMSG_ALIGN(nlh->nlmsg_len);
+}
+
+/* Composes in 'buf', which must be zeroed, the RTM_NEWLINK request that
+ * creates interface 'name' as an 802.1Q device on interface 'parent' for
+ * VLAN 'vlan_id'.  Returns its aligned length. */
+static size_t
+sim_link_put_vlan_msg(char *buf, const char *name, int parent,
+                      uint16_t vlan_id, unsigned int seq)
+{
+    static const char kind[] = "vlan";
+    struct rtattr *linkinfo, *data;
+    struct nlmsghdr *nlh;
+    struct ifinfomsg *ifi;
+    uint32_t link = parent;
+
+    nlh = sim_link_put_header(buf, RTM_NEWLINK, NLM_F_CREATE | NLM_F_EXCL,
+                              sizeof *ifi, seq);
+    ifi = NLMSG_DATA(nlh);
+    ifi->ifi_family = AF_UNSPEC;
+
+    sim_link_put_attr(nlh, IFLA_IFNAME, name, strlen(name) + 1);
+    sim_link_put_attr(nlh, IFLA_LINK, &link, sizeof link);
+    linkinfo = sim_link_put_attr(nlh, IFLA_LINKINFO, NULL, 0);
+    sim_link_put_attr(nlh, IFLA_INFO_KIND, kind, sizeof kind);
+    data = sim_link_put_attr(nlh, IFLA_INFO_DATA, NULL, 0);
+    sim_link_put_attr(nlh, IFLA_VLAN_ID, &vlan_id, sizeof vlan_id);
+    sim_link_end_nested(nlh, data);
+    sim_link_end_nested(nlh, linkinfo);
+    return NLMSG_ALIGN(nlh->nlmsg_len);
+}
+
+/* Composes in 'buf', which must be zeroed, a request of 'type' for the qdisc
+ * of 'ifindex' with 'handle' below 'parent'.  Returns the message, to which
+ * the caller may add attributes. */
+static struct nlmsghdr *
+sim_link_put_qdisc_msg(char *buf, uint16_t type, uint16_t flags, int ifindex,
+                       uint32_t parent, uint32_t handle, const char *kind,
+                       unsigned int seq)
+{
+    struct nlmsghdr *nlh;
+    struct tcmsg *tcm;
+
+    nlh = sim_link_put_header(buf, type, flags, sizeof *tcm, seq);
+    tcm = NLMSG_DATA(nlh);
+    tcm->tcm_family = AF_UNSPEC;
+    tcm->tcm_ifindex = ifindex;
+    tcm->tcm_parent = parent;
+    tcm->tcm_handle = handle;
+    if (kind) {
+        sim_link_put_attr(nlh, TCA_KIND, kind, strlen(kind) + 1);
+    }
+    return nlh;
+}
+
+/* Adds the options of a tbf qdisc that shapes to 'rate' bytes/s to 'nlh'. */
+static void
+sim_link_put_tbf_options(struct nlmsghdr *nlh, uint64_t rate)
+{
+    uint32_t burst = MAX(MIN(rate / SIM_LINK_TBF_BURST_DIV, UINT32_MAX / 2),
+                         SIM_LINK_TBF_BURST_MIN);
+    struct tc_tbf_qopt qopt;
+    struct rtattr *nest;
+
+    memset(&qopt, 0, sizeof qopt);
+    qopt.rate.rate = MIN(rate, UINT32_MAX);
+    /* Makes the kernel compute the transmit times from the rate instead of
+     * asking for a rate table. */
+    qopt.rate.linklayer = TC_LINKLAYER_ETHERNET;
+    qopt.limit = burst + MIN(rate / SIM_LINK_TBF_LATENCY_DIV, UINT32_MAX / 2);
+    /* The time to send 'burst' at 'rate', in the 64 ns ticks of the packet
+     * scheduler.  Kernels that know TCA_TBF_BURST use that instead. */
+    qopt.buffer = MIN(burst * UINT64_C(1000000000) / rate >> 6, UINT32_MAX);
+
+    nest = sim_link_put_attr(nlh, TCA_OPTIONS, NULL, 0);
+    sim_link_put_attr(nlh, TCA_TBF_PARMS, &qopt, sizeof qopt);
+    if (rate > UINT32_MAX) {
+        sim_link_put_attr(nlh, TCA_TBF_RATE64, &rate, sizeof rate);
+    }
+    sim_link_put_attr(nlh, TCA_TBF_BURST, &burst, sizeof burst);
+    sim_link_end_nested(nlh, nest);
+}
+
+/* Adds the options of the prio qdisc of the queues to 'nlh'.  Priority 'p'
+ * goes to band SIM_LINK_N_QUEUES - 1 - p, band 0 being served first, so
+ * queue 'q' is band SIM_LINK_N_QUEUES - 1 - q. */
+static void
+sim_link_put_prio_options(struct nlmsghdr *nlh)
+{
+    struct tc_prio_qopt qopt;
+    int p;
+
+    memset(&qopt, 0, sizeof qopt);
+    qopt.bands = SIM_LINK_N_QUEUES;
+    for (p = 0; p <= TC_PRIO_MAX; p++) {
+        qopt.priomap[p] = p < SIM_LINK_N_QUEUES ? SIM_LINK_N_QUEUES - 1 - p
+                                                : SIM_LINK_N_QUEUES - 1;
+    }
+    sim_link_put_attr(nlh, TCA_OPTIONS, &qopt, sizeof qopt);
+}
+
+/* Records in 'msgs' a request for 'change' and returns its sequence
+ * number.  Runs on the swns thread. */
+static unsigned int
+sim_link_add_msg(struct sim_link_msg *msgs, size_t *n_msgs,
+                 struct sim_link_change *change, bool may_fail)
+{
+    struct sim_link_msg *msg = &msgs[(*n_msgs)++];
+
+    msg->change = change;
+    msg->seq = sim_swns_rtnl_next_seq();
+    msg->may_fail = may_fail;
+    msg->parse = NULL;
+    return msg->seq;
+}
+
+/* Composes in 'buf', which must be zeroed, the requests for 'change' of
+ * interface 'name' and records them in 'msgs'.  Returns the length of the
+ * requests.  Runs on the swns thread. */
+static size_t
+sim_link_put_msgs(char *buf, const char *name,
+                  struct sim_link_change *change,
+                  struct sim_link_msg *msgs, size_t *n_msgs)
+{
+    const uint16_t create = NLM_F_CREATE | NLM_F_REPLACE;
+    struct nlmsghdr *nlh;
+    unsigned int seq;
+    size_t len = 0;
+    int ifindex;
+
+    if (change->set_vlan && !change->vlan_matches && !change->error) {
+        /* An interface of that name that is not the requested device is
+         * replaced.  One that is, e.g. after a restart of ops-switchd, is
+         * kept with the addresses and routes that it carries. */
+        if (change->vlan_exists) {
+            struct ifinfomsg *ifi;
+
+            seq = sim_link_add_msg(msgs, n_msgs, change, false);
+            nlh = sim_link_put_header(buf + len, RTM_DELLINK, 0, sizeof *ifi,
+                                      seq);
+            ifi = NLMSG_DATA(nlh);
+            ifi->ifi_family = AF_UNSPEC;
+            sim_link_put_attr(nlh, IFLA_IFNAME, name, strlen(name) + 1);
+            len += NLMSG_ALIGN(nlh->nlmsg_len);
+        }
+
+        if (!change->vlan_parent[0]) {
+            return len;
+        }
+        if (!change->vlan_parent_ifindex) {
+            change->error = ENODEV;
+            return len;
+        }
+        seq = sim_link_add_msg(msgs, n_msgs, change, false);
+        len += sim_link_put_vlan_msg(buf + len, name,
+                                     change->vlan_parent_ifindex,
+                                     change->vlan_id, seq);
+    } else if (change->set_vlan && !change->vlan_parent[0]) {
+        /* Deleted, or never there. */
+        return len;
+    }
+
+    if (change->set_mtu || change->set_mac || change->set_admin) {
+        seq = sim_link_add_msg(msgs, n_msgs, change, false);
+        len += sim_link_put_link_msg(buf + len, name, change, seq);
+    }
+
+    if (!change->set_queues) {
+        return len;
+    }
+    ifindex = if_nametoindex(name);
+    if (!ifindex) {
+        change->error = errno ? errno : ENODEV;
+        return len;
+    }
+
+    /* Start from the default qdisc.  There may be none to delete. */
+    seq = sim_link_add_msg(msgs, n_msgs, change, true);
+    nlh = sim_link_put_qdisc_msg(buf + len, RTM_DELQDISC, 0, ifindex,
+                                 TC_H_ROOT, 0, NULL, seq);
+    len += NLMSG_ALIGN(nlh->nlmsg_len);
+
+    if (change->rate) {
+        seq = sim_link_add_msg(msgs, n_msgs, change, false);
+        nlh = sim_link_put_qdisc_msg(buf + len, RTM_NEWQDISC, create, ifindex,
+                                     TC_H_ROOT, SIM_LINK_TBF_HANDLE, "tbf",
+                                     seq);
+        sim_link_put_tbf_options(nlh, change->rate);
+        len += NLMSG_ALIGN(nlh->nlmsg_len);
+    }
+
+    seq = sim_link_add_msg(msgs, n_msgs, change, false);
+    nlh = sim_link_put_qdisc_msg(buf + len, RTM_NEWQDISC, create, ifindex,
+                                 change->rate ? SIM_LINK_TBF_HANDLE + 1
+                                              : TC_H_ROOT,
+                                 SIM_LINK_PRIO_HANDLE, "prio", seq);
+    sim_link_put_prio_options(nlh);
+    len += NLMSG_ALIGN(nlh->nlmsg_len);
+
+    return len;
+}
+
+/* Offloads and channels, through the ethtool generic netlink family. */
+#ifdef HAVE_LINUX_ETHTOOL_NETLINK_H
+/* The kernel features behind each SIM_LINK_F_*. */
+static const char *const sim_link_feature_names[SIM_LINK_N_FEATURES][3] = {
+    [SIM_LINK_F_GRO] = { "rx-gro", NULL },
+    [SIM_LINK_F_GSO] = { "tx-generic-segmentation", NULL },
+    [SIM_LINK_F_TSO] = { "tx-tcp-segmentation", "tx-tcp6-segmentation",
+                         NULL },
+    [SIM_LINK_F_CSUM] = { "rx-checksum", "tx-checksum-ip-generic", NULL },
+};
+
+/* Owned by the swns thread. */
+static int ethtool_sock = -1;
+static uint16_t ethtool_family;
+
+/* Opens a generic netlink socket in the switch namespace and looks up the
+ * ethtool family, the first time it is called.  Returns 0 if ethtool
+ * requests can be sent, otherwise a positive errno value.  Runs on the swns
+ * thread. */
+static int
+sim_link_ethtool_open(void)
+{
+    static bool tried;
+    static int error;
+    struct {
+        struct nlmsghdr hdr;
+        struct genlmsghdr genl;
+        char attrs[64];
+    } req;
+    char reply[4096];
+    struct sockaddr_nl local;
+    struct nlmsghdr *nlh;
+    struct rtattr *rta;
+    ssize_t ret;
+    int len;
+
+    if (tried) {
+        return error;
+    }
+    tried = true;
+
+    ethtool_sock = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC,
+                          NETLINK_GENERIC);
+    if (ethtool_sock < 0) {
+        error = errno;
+        goto out;
+    }
+    memset(&local, 0, sizeof local);
+    local.nl_family = AF_NETLINK;
+    if (bind(ethtool_sock, (struct sockaddr *) &local, sizeof local) < 0) {
+        error = errno;
+        goto out;
+    }
+
+    memset(&req, 0, sizeof req);
+    nlh = sim_link_put_header((char *) &req, GENL_ID_CTRL, 0, GENL_HDRLEN,
+                              sim_swns_rtnl_next_seq());
+    nlh->nlmsg_flags &= ~NLM_F_ACK;
+    req.genl.cmd = CTRL_CMD_GETFAMILY;
+    req.genl.version = 1;
+    sim_link_put_attr(nlh, CTRL_ATTR_FAMILY_NAME, ETHTOOL_GENL_NAME,
+                      sizeof ETHTOOL_GENL_NAME);
+    if (send(ethtool_sock, &req, nlh->nlmsg_len, 0) < 0) {
+        error = errno;
+        goto out;
+    }
+
+    do {
+        ret = recv(ethtool_sock, reply, sizeof reply, 0);
+    } while (ret < 0 && errno == EINTR);
+    nlh = (struct nlmsghdr *) reply;
+    if (ret < 0) {
+        error = errno;
+    } else if (!NLMSG_OK(nlh, ret)) {
+        error = EPROTO;
+    } else if (nlh->nlmsg_type == NLMSG_ERROR) {
+        const struct nlmsgerr *err = NLMSG_DATA(nlh);
+
+        error = err->error ? -err->error : EPROTO;
+    } else {
+        rta = (struct rtattr *) ((char *) NLMSG_DATA(nlh) + GENL_HDRLEN);
+        len = nlh->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN);
+        for (; RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+            if (rta->rta_type == CTRL_ATTR_FAMILY_ID
+                && RTA_PAYLOAD(rta) >= sizeof ethtool_family) {
+                memcpy(&ethtool_family, RTA_DATA(rta), sizeof ethtool_family);
+            }
+        }
+        error = ethtool_family ? 0 : EPROTO;
+    }
+
+out:
+    if (error) {
+        VLOG_WARN("ethtool netlink unavailable (%s), interface offloads and "
+                  "channels will not be configured", ovs_strerror(error));
+    }
+    return error;
+}
+
+/* Composes in 'buf' an ethtool request 'cmd' for interface 'name', with
+ * header attribute 'header_type'.  Set requests are sent without a reply,
+ * queries with compact bitsets. */
+static struct nlmsghdr *
+sim_link_put_ethtool_msg(char *buf, uint8_t cmd, uint16_t header_type,
+                         const char *name, bool query, unsigned int seq)
+{
+    uint32_t flags = (query ? ETHTOOL_FLAG_COMPACT_BITSETS
+                      : ETHTOOL_FLAG_OMIT_REPLY);
+    struct genlmsghdr *genl;
+    struct nlmsghdr *nlh;
+    struct rtattr *nest;
+
+    nlh = sim_link_put_header(buf, ethtool_family, 0, GENL_HDRLEN, seq);
+    genl = NLMSG_DATA(nlh);
+    genl->cmd = cmd;
+    genl->version = ETHTOOL_GENL_VERSION;
+
+    nest = sim_link_put_attr(nlh, header_type | NLA_F_NESTED, NULL, 0);
+    sim_link_put_attr(nlh, ETHTOOL_A_HEADER_DEV_NAME, name, strlen(name) + 1);
+    sim_link_put_attr(nlh, ETHTOOL_A_HEADER_FLAGS, &flags, sizeof flags);
+    sim_link_end_nested(nlh, nest);
+    return nlh;
+}
+
+/* Adds to 'nlh' a bitset that changes the features of 'change' only. */
+static void
+sim_link_put_features(struct nlmsghdr *nlh,
+                      const struct sim_link_change *change)
+{
+    struct rtattr *wanted, *bits;
+    int f;
+
+    wanted = sim_link_put_attr(nlh, ETHTOOL_A_FEATURES_WANTED | NLA_F_NESTED,
+                               NULL, 0);
+    bits = sim_link_put_attr(nlh, ETHTOOL_A_BITSET_BITS | NLA_F_NESTED,
+                             NULL, 0);
+    for (f = 0; f < SIM_LINK_N_FEATURES; f++) {
+        const char *const *names;
+
+        if (!(change->features_set & (1u << f))) {
+            continue;
+        }
+        for (names = sim_link_feature_names[f]; *names; names++) {
+            struct rtattr *bit;
+
+            bit = sim_link_put_attr(nlh,
+                                    ETHTOOL_A_BITSET_BITS_BIT | NLA_F_NESTED,
+                                    NULL, 0);
+            sim_link_put_attr(nlh, ETHTOOL_A_BITSET_BIT_NAME, *names,
+                              strlen(*names) + 1);
+            if (change->features_on & (1u << f)) {
+                sim_link_put_attr(nlh, ETHTOOL_A_BITSET_BIT_VALUE, NULL, 0);
+            }
+            sim_link_end_nested(nlh, bit);
+        }
+    }
+    sim_link_end_nested(nlh, bits);
+    sim_link_end_nested(nlh, wanted);
+}
+
+static bool
+sim_link_get_u8(const struct rtattr *rta)
+{
+    return RTA_PAYLOAD(rta) >= 1 && *(const uint8_t *) RTA_DATA(rta);
+}
+
+/* Parses an ETHTOOL_MSG_PAUSE_GET_REPLY into the report of 'change'. */
+static void
+sim_link_parse_pause(const struct nlmsghdr *nlh,
+                     struct sim_link_change *change)
+{
+    const struct rtattr *rta;
+    int len = nlh->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN);
+
+    rta = (const struct rtattr *) ((const char *) NLMSG_DATA(nlh)
+                                   + GENL_HDRLEN);
+    for (; RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+        switch (rta->rta_type & NLA_TYPE_MASK) {
+        case ETHTOOL_A_PAUSE_RX:
+            change->report.rx_pause = sim_link_get_u8(rta);
+            change->report.has_pause = true;
+            break;
+        case ETHTOOL_A_PAUSE_TX:
+            change->report.tx_pause = sim_link_get_u8(rta);
+            change->report.has_pause = true;
+            break;
+        }
+    }
+}
+
+/* Parses an ETHTOOL_MSG_LINKMODES_GET_REPLY into the report of 'change'. */
+static void
+sim_link_parse_linkmodes(const struct nlmsghdr *nlh,
+                         struct sim_link_change *change)
+{
+    const struct rtattr *rta;
+    int len = nlh->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN);
+
+    rta = (const struct rtattr *) ((const char *) NLMSG_DATA(nlh)
+                                   + GENL_HDRLEN);
+    for (; RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+        if ((rta->rta_type & NLA_TYPE_MASK) == ETHTOOL_A_LINKMODES_AUTONEG
+            && RTA_PAYLOAD(rta) >= 1) {
+            change->report.autoneg
+                = *(const uint8_t *) RTA_DATA(rta) == AUTONEG_ENABLE;
+            change->report.has_autoneg = true;
+        }
+    }
+}
+#endif
+
+/* Composes in 'buf', which must be zeroed, the ethtool requests for 'change'
+ * of interface 'name' and records them in 'msgs'.  Returns the length of the
+ * requests.  Runs on the swns thread. */
+static size_t
+sim_link_put_ethtool_msgs(char *buf OVS_UNUSED, const char *name OVS_UNUSED,
+                          struct sim_link_change *change,
+                          struct sim_link_msg *msgs OVS_UNUSED,
+                          size_t *n_msgs OVS_UNUSED)
+{
+    bool tuned = (change->features_set || change->rx_channels
+                  || change->tx_channels);
+    size_t len = 0;
+    int error;
+
+    if (!tuned && !change->set_pause && !change->set_autoneg) {
+        return 0;
+    }
+
+#ifdef HAVE_LINUX_ETHTOOL_NETLINK_H
+    error = sim_link_ethtool_open();
+    if (!error) {
+        struct nlmsghdr *nlh;
+        unsigned int seq;
+
+        if (change->features_set) {
+            seq = sim_link_add_msg(msgs, n_msgs, change, false);
+            nlh = sim_link_put_ethtool_msg(buf + len, ETHTOOL_MSG_FEATURES_SET,
+                                           ETHTOOL_A_FEATURES_HEADER, name,
+                                           false, seq);
+            sim_link_put_features(nlh, change);
+            len += NLMSG_ALIGN(nlh->nlmsg_len);
+        }
+
+        if (change->rx_channels || change->tx_channels) {
+            seq = sim_link_add_msg(msgs, n_msgs, change, false);
+            nlh = sim_link_put_ethtool_msg(buf + len, ETHTOOL_MSG_CHANNELS_SET,
+                                           ETHTOOL_A_CHANNELS_HEADER, name,
+                                           false, seq);
+            if (change->rx_channels) {
+                sim_link_put_attr(nlh, ETHTOOL_A_CHANNELS_RX_COUNT,
+                                  &change->rx_channels,
+                                  sizeof change->rx_channels);
+            }
+            if (change->tx_channels) {
+                sim_link_put_attr(nlh, ETHTOOL_A_CHANNELS_TX_COUNT,
+                                  &change->tx_channels,
+                                  sizeof change->tx_channels);
+            }
+            len += NLMSG_ALIGN(nlh->nlmsg_len);
+        }
+
+        /* Drivers need not support pause frames or link modes, so these
+         * requests may fail.  The queries that follow them tell what the
+         * driver ended up with, if anything. */
+        if (change->set_pause) {
+            uint8_t rx = change->pause_rx, tx = change->pause_tx;
+
+            seq = sim_link_add_msg(msgs, n_msgs, change, true);
+            nlh = sim_link_put_ethtool_msg(buf + len, ETHTOOL_MSG_PAUSE_SET,
+                                           ETHTOOL_A_PAUSE_HEADER, name,
+                                           false, seq);
+            if (change->set_autoneg) {
+                uint8_t autoneg = change->autoneg;
+
+                sim_link_put_attr(nlh, ETHTOOL_A_PAUSE_AUTONEG, &autoneg,
+                                  sizeof autoneg);
+            }
+            sim_link_put_attr(nlh, ETHTOOL_A_PAUSE_RX, &rx, sizeof rx);
+            sim_link_put_attr(nlh, ETHTOOL_A_PAUSE_TX, &tx, sizeof tx);
+            len += NLMSG_ALIGN(nlh->nlmsg_len);
+
+            seq = sim_link_add_msg(msgs, n_msgs, change, true);
+            msgs[*n_msgs - 1].parse = sim_link_parse_pause;
+            nlh = sim_link_put_ethtool_msg(buf + len, ETHTOOL_MSG_PAUSE_GET,
+                                           ETHTOOL_A_PAUSE_HEADER, name,
+                                           true, seq);
+            len += NLMSG_ALIGN(nlh->nlmsg_len);
+        }
+
+        if (change->set_autoneg) {
+            uint8_t autoneg = change->autoneg ? AUTONEG_ENABLE
+                                              : AUTONEG_DISABLE;
+
+            seq = sim_link_add_msg(msgs, n_msgs, change, true);
+            nlh = sim_link_put_ethtool_msg(buf + len,
+                                           ETHTOOL_MSG_LINKMODES_SET,
+                                           ETHTOOL_A_LINKMODES_HEADER, name,
+                                           false, seq);
+            sim_link_put_attr(nlh, ETHTOOL_A_LINKMODES_AUTONEG, &autoneg,
+                              sizeof autoneg);
+            len += NLMSG_ALIGN(nlh->nlmsg_len);
+
+            seq = sim_link_add_msg(msgs, n_msgs, change, true);
+            msgs[*n_msgs - 1].parse = sim_link_parse_linkmodes;
+            nlh = sim_link_put_ethtool_msg(buf + len,
+                                           ETHTOOL_MSG_LINKMODES_GET,
+                                           ETHTOOL_A_LINKMODES_HEADER, name,
+                                           true, seq);
+            len += NLMSG_ALIGN(nlh->nlmsg_len);
+        }
+    }
+#else
+    error = EOPNOTSUPP;
+#endif
+    /* Without ethtool, pause and autonegotiation are only reported as
+     * configured, like drivers that do not support them. */
+    if (error && tuned && !change->error) {
+        change->error = error;
+    }
+    return len;
+}
+
+/* Records in 'change' that its interface exists, as described by 'ifi' and
+ * the 'len' bytes of attributes that follow it, and whether it is the 802.1Q
+ * device that 'change' asks for. */
+static void
+sim_link_vlan_check(const struct ifinfomsg *ifi, int len,
+                    struct sim_link_change *change)
+{
+    const struct rtattr *rta, *info, *data;
+    uint32_t link = 0;
+    bool is_vlan = false;
+    int vlan_id = -1;
+
+    change->vlan_exists = true;
+    for (rta = IFLA_RTA(ifi); RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+        if (rta->rta_type == IFLA_LINK && RTA_PAYLOAD(rta) >= sizeof link) {
+            memcpy(&link, RTA_DATA(rta), sizeof link);
+        } else if (rta->rta_type == IFLA_LINKINFO) {
+            int info_len = RTA_PAYLOAD(rta);
+
+            for (info = RTA_DATA(rta); RTA_OK(info, info_len);
+                 info = RTA_NEXT(info, info_len)) {
+                if (info->rta_type == IFLA_INFO_KIND) {
+                    is_vlan = !strncmp(RTA_DATA(info), "vlan",
+                                       RTA_PAYLOAD(info));
+                } else if (info->rta_type == IFLA_INFO_DATA) {
+                    int data_len = RTA_PAYLOAD(info);
+
+                    for (data = RTA_DATA(info); RTA_OK(data, data_len);
+                         data = RTA_NEXT(data, data_len)) {
+                        if (data->rta_type == IFLA_VLAN_ID
+                            && RTA_PAYLOAD(data) >= sizeof(uint16_t)) {
+                            vlan_id = *(const uint16_t *) RTA_DATA(data);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    change->vlan_matches = (change->vlan_parent[0] && is_vlan
+                            && link == change->vlan_parent_ifindex
+                            && vlan_id == change->vlan_id);
+}
+
+/* Looks up, with one dump of the interfaces of the switch namespace, which
+ * of the VLAN devices that the changes of 'batch' ask for already exist.
+ * Returns 0 if successful, otherwise a positive errno value, which fails
+ * those changes. */
+static int
+sim_link_vlan_scan(int sock, struct sim_link_batch *batch)
+{
+    static char reply[32768];
+    struct {
+        struct nlmsghdr hdr;
+        struct ifinfomsg ifi;
+    } req;
+    struct sockaddr_nl kernel;
+    struct shash_node *node;
+    bool any = false;
+    unsigned int seq;
+
+    SHASH_FOR_EACH (node, &batch->changes) {
+        struct sim_link_change *change = node->data;
+
+        if (change->set_vlan) {
+            if (change->vlan_parent[0]) {
+                change->vlan_parent_ifindex
+                    = if_nametoindex(change->vlan_parent);
+            }
+            any = true;
+        }
+    }
+    if (!any) {
+        return 0;
+    } else if (sock < 0) {
+        return EBADF;
+    }
+
+    seq = sim_swns_rtnl_next_seq();
+    memset(&req, 0, sizeof req);
+    sim_link_put_header((char *) &req, RTM_GETLINK, NLM_F_DUMP,
+                        sizeof req.ifi, seq);
+    req.hdr.nlmsg_flags &= ~NLM_F_ACK;
+    req.ifi.ifi_family = AF_UNSPEC;
+    memset(&kernel, 0, sizeof kernel);
+    kernel.nl_family = AF_NETLINK;
+    if (sendto(sock, &req, req.hdr.nlmsg_len, 0, (struct sockaddr *) &kernel,
+               sizeof kernel) < 0) {
+        return errno;
+    }
+
+    for (;;) {
+        struct nlmsghdr *nlh;
+        ssize_t ret;
+
+        ret = recv(sock, reply, sizeof reply, 0);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno;
+        }
+
+        for (nlh = (struct nlmsghdr *) reply; NLMSG_OK(nlh, ret);
+             nlh = NLMSG_NEXT(nlh, ret)) {
+            const struct ifinfomsg *ifi = NLMSG_DATA(nlh);
+            const struct rtattr *rta;
+            struct sim_link_change *change;
+            int len;
+
+            if (nlh->nlmsg_seq != seq) {
+                /* Left over from an earlier request. */
+                continue;
+            } else if (nlh->nlmsg_type == NLMSG_DONE) {
+                return 0;
+            } else if (nlh->nlmsg_type == NLMSG_ERROR) {
+                const struct nlmsgerr *err = NLMSG_DATA(nlh);
+
+                return err->error ? -err->error : EPROTO;
+            } else if (nlh->nlmsg_type != RTM_NEWLINK) {
+                continue;
+            }
+
+            len = nlh->nlmsg_len - NLMSG_LENGTH(sizeof *ifi);
+            for (rta = IFLA_RTA(ifi); RTA_OK(rta, len);
+                 rta = RTA_NEXT(rta, len)) {
+                if (rta->rta_type == IFLA_IFNAME
+                    && memchr(RTA_DATA(rta), '\0', RTA_PAYLOAD(rta))) {
+                    change = shash_find_data(&batch->changes, RTA_DATA(rta));
+                    if (change && change->set_vlan) {
+                        sim_link_vlan_check(
+                            ifi, nlh->nlmsg_len - NLMSG_LENGTH(sizeof *ifi),
+                            change);
+                    }
+                    break;
+                }
+            }
+        }
+    }
+}
+
+/* Sends the 'n' requests in 'msgs', composed in 'buf', and waits for their
+ * acknowledgements.  Their sequence numbers are consecutive.  Returns 0 if
+ * they could be sent, otherwise a positive errno value. */
+static int
+sim_link_transact(int sock, char *buf, size_t len,
+                  const struct sim_link_msg *msgs, size_t n)
+{
+    static char reply[32768];
+    struct sockaddr_nl kernel;
+    size_t n_acked = 0;
+
+    memset(&kernel, 0, sizeof kernel);
+    kernel.nl_family = AF_NETLINK;
+    if (sendto(sock, buf, len, 0, (struct sockaddr *) &kernel,
+               sizeof kernel) < 0) {
+        return errno;
+    }
+
+    while (n_acked < n) {
+        struct nlmsghdr *nlh;
+        ssize_t ret;
+
+        ret = recv(sock, reply, sizeof reply, 0);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno;
+        }
+
+        for (nlh = (struct nlmsghdr *) reply; NLMSG_OK(nlh, ret);
+             nlh = NLMSG_NEXT(nlh, ret)) {
+            unsigned int i = nlh->nlmsg_seq - msgs[0].seq;
+
+            if (i >= n) {
+                /* Left over from an earlier request. */
+            } else if (nlh->nlmsg_type == NLMSG_ERROR) {
+                const struct nlmsgerr *err = NLMSG_DATA(nlh);
+                struct sim_link_change *change = msgs[i].change;
+
+                if (err->error && !msgs[i].may_fail && !change->error) {
+                    change->error = -err->error;
+                }
+                n_acked++;
+            } else if (msgs[i].parse) {
+                msgs[i].parse(nlh, msgs[i].change);
+            }
+        }
+    }
+    return 0;
+}
+
+/* Applies the changes of a batch.  Runs on the swns thread. */
+static int
+sim_link_apply__(void *batch_)
+{
+    struct sim_link_batch *batch = batch_;
+    const struct shash_node **nodes;
+    size_t n = shash_count(&batch->changes);
+    int sock = sim_swns_rtnl_sock();
+    struct sim_link_msg *msgs, *gmsgs;
+    size_t n_failed = 0;
+    size_t i = 0;
+    int error;
+
+    nodes = shash_sort(&batch->changes);
+
+    error = sim_link_vlan_scan(sock, batch);
+    if (error) {
+        for (i = 0; i < n; i++) {
+            struct sim_link_change *change = nodes[i]->data;
+
+            if (change->set_vlan && !change->error) {
+                change->error = error;
+            }
+        }
+        i = 0;
+    }
+
+    msgs = xmalloc(n * SIM_LINK_N_MSGS_MAX * sizeof *msgs);
+    gmsgs = xmalloc(n * SIM_LINK_N_MSGS_MAX * sizeof *gmsgs);
+    while (i < n) {
+        /* Route requests in 'buf', ethtool requests in 'gbuf'. */
+        char buf[16384], gbuf[16384];
+        size_t n_msgs = 0, n_gmsgs = 0;
+        size_t len = 0, glen = 0;
+        size_t start = i;
+        size_t j;
+
+        memset(buf, 0, sizeof buf);
+        memset(gbuf, 0, sizeof gbuf);
+        for (; i < n && len + SIM_LINK_MSGS_MAX <= sizeof buf
+               && glen + SIM_LINK_MSGS_MAX <= sizeof gbuf; i++) {
+            len += sim_link_put_msgs(buf + len, nodes[i]->name,
+                                     nodes[i]->data, msgs, &n_msgs);
+        }
+        /* After the route requests, so that each set of requests has
+         * consecutive sequence numbers. */
+        for (j = start; j < i; j++) {
+            glen += sim_link_put_ethtool_msgs(gbuf + glen, nodes[j]->name,
+                                              nodes[j]->data, gmsgs,
+                                              &n_gmsgs);
+        }
+
+        error = !n_msgs ? 0
+                : sock < 0 ? EBADF
+                : sim_link_transact(sock, buf, len, msgs, n_msgs);
+        batch->n_sends += n_msgs > 0;
+#ifdef HAVE_LINUX_ETHTOOL_NETLINK_H
+        if (!error && n_gmsgs) {
+            error = sim_link_transact(ethtool_sock, gbuf, glen, gmsgs,
+                                      n_gmsgs);
+            batch->n_sends++;
+        }
+#endif
+        for (j = start; j < i; j++) {
+            struct sim_link_change *change = nodes[j]->data;
+
+            if (error && !change->error) {
+                change->error = error;
+            }
+            n_failed += change->error != 0;
+        }
+    }
+    free(gmsgs);
+    free(msgs);
+    free(nodes);
+
+    return n_failed;
+}
+
+static int
+sim_link_work(void *batch)
+{
+    return sim_swns_call(sim_link_apply__, batch);
+}
+
+static void
+sim_link_done(int status, void *batch_)
+{
+    struct sim_link_batch *batch = batch_;
+    struct shash_node *node;
+
+    if (status) {
+        SHASH_FOR_EACH (node, &batch->changes) {
+            const struct sim_link_change *change = node->data;
+
+            if (change->error) {
+                VLOG_WARN("%s: link configuration failed (%s)", node->name,
+                          ovs_strerror(change->error));
+            }
+        }
+    }
+
+    ovs_mutex_lock(&reports_mutex);
+    SHASH_FOR_EACH (node, &batch->changes) {
+        const struct sim_link_change *change = node->data;
+        struct sim_link_report *report;
+
+        if (!change->set_pause && !change->set_autoneg) {
+            continue;
+        }
+        report = shash_find_data(&reports, node->name);
+        if (!report) {
+            report = xzalloc(sizeof *report);
+            shash_add(&reports, node->name, report);
+        }
+        if (change->set_pause) {
+            report->has_pause = change->report.has_pause;
+            report->rx_pause = change->report.rx_pause;
+            report->tx_pause = change->report.tx_pause;
+        }
+        if (change->set_autoneg) {
+            report->has_autoneg = change->report.has_autoneg;
+            report->autoneg = change->report.autoneg;
+        }
+    }
+    ovs_mutex_unlock(&reports_mutex);
+    VLOG_DBG("applied link configuration of %"PRIuSIZE" interfaces in %u "
+             "netlink batches", shash_count(&batch->changes),
+             batch->n_sends);
+
+    shash_destroy_free_data(&batch->changes);
+    free(batch);
+}
+
+/* Starts applying the changes recorded since the last call. */
+void
+sim_link_run(void)
+{
+    struct sim_link_batch *batch;
+
+    if (shash_is_empty(&pending_changes)) {
+        return;
+    }
+
+    batch = xzalloc(sizeof *batch);
+    shash_init(&batch->changes);
+    shash_swap(&batch->changes, &pending_changes);
+    sim_exec_submit(SIM_LINK_EXEC_KEY, sim_link_work, sim_link_done, batch);
+}
+
+void
+sim_link_wait(void)
+{
+    if (!shash_is_empty(&pending_changes)) {
+        poll_immediate_wake();
+    }
+}
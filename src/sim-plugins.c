@@ -14,7 +14,9 @@
  *  under the License.
  */
 
+#include <errno.h>
 #include <unistd.h>
+#include "util.h"
 #include "openvswitch/vlog.h"
 #include "netdev-provider.h"
 #include "ofproto/ofproto-provider.h"
@@ -24,6 +26,12 @@
 #include "sim-copp-plugin.h"
 #include "ops-classifier-sim.h"
 #include "sim-stp.h"
+#include "sim-asic-ovsdb.h"
+#include "sim-executor.h"
+#include "sim-firewall.h"
+#include "sim-link.h"
+#include "sim-spawn.h"
+#include "sim-swns.h"
 
 #define init libovs_sim_plugin_LTX_init
 #define run libovs_sim_plugin_LTX_run
@@ -38,7 +46,6 @@ void
 init(void)
 {
     int retval;
-    char cmd_str[MAX_CMD_LEN];
 
     /* Event log initialization for sFlow */
     retval = event_log_init("SFLOW");
@@ -46,7 +53,10 @@ init(void)
         VLOG_ERR("Event log initialization failed for SFLOW");
     }
 
-    memset(cmd_str, 0, sizeof(cmd_str));
+    sim_spawn_init();
+    sim_swns_init();
+    sim_firewall_init();
+
     /* Cleaning up the Internal "ASIC" OVS everytime ops-switchd daemon is
     * started or restarted or killed to keep the "ASIC" OVS database in sync
     * with the OpenSwitch OVS database.
@@ -55,31 +65,39 @@ init(void)
     * ovsdb-server again which recreates the "ASIC" database file and finally
     * start the ovs-vswitchd-sim daemon before ops-switchd daemon gets
     * restarted.*/
-    if (system("systemctl stop openvswitch-sim") != 0) {
+    if (sim_spawn((const char *[]) { "systemctl", "stop", "openvswitch-sim",
+                                     NULL }, NULL) != 0) {
         VLOG_ERR("Failed to stop Internal 'ASIC' OVS openvswitch.service");
     }
 
-    if (system("systemctl stop ovsdb-server-sim") != 0) {
+    if (sim_spawn((const char *[]) { "systemctl", "stop", "ovsdb-server-sim",
+                                     NULL }, NULL) != 0) {
         VLOG_ERR("Failed to stop Internal 'ASIC' OVS ovsdb-server-sim.service");
     }
 
     if (access(ASIC_OVSDB_PATH, F_OK) != -1) {
-        snprintf(cmd_str, MAX_CMD_LEN, "sudo rm -rf %s", ASIC_OVSDB_PATH);
-        if (system(cmd_str) != 0) {
-            VLOG_ERR("Failed to delete Internal 'ASIC' OVS ovsdb.db file");
+        if (unlink(ASIC_OVSDB_PATH) != 0) {
+            VLOG_ERR("Failed to delete Internal 'ASIC' OVS ovsdb.db file (%s)",
+                     ovs_strerror(errno));
         }
     } else {
         VLOG_DBG("Internal 'ASIC' OVS ovsdb.db file does not exist");
     }
 
-    if (system("systemctl start ovsdb-server-sim") != 0) {
+    if (sim_spawn((const char *[]) { "systemctl", "start", "ovsdb-server-sim",
+                                     NULL }, NULL) != 0) {
         VLOG_ERR("Failed to start Internal 'ASIC' OVS ovsdb-server-sim.service");
     }
 
-    if (system("systemctl start openvswitch-sim") != 0) {
+    if (sim_spawn((const char *[]) { "systemctl", "start", "openvswitch-sim",
+                                     NULL }, NULL) != 0) {
         VLOG_ERR("Failed to start Internal 'ASIC' OVS openvswitch.service");
     }
 
+    /* Connect to the freshly started "ASIC" ovsdb-server. */
+    asic_ovsdb_init();
+    sim_executor_init();
+
     register_qos_extension();
     sim_copp_init();
     /* Register ASIC plugins */
@@ -95,11 +113,17 @@ init(void)
 void
 run(void)
 {
+    asic_ovsdb_run();
+    sim_link_run();
+    sim_executor_run();
 }
 
 void
 wait(void)
 {
+    asic_ovsdb_wait();
+    sim_link_wait();
+    sim_executor_wait();
 }
 
 void
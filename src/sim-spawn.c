@@ -0,0 +1,432 @@
+/*
+ * (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <config.h>
+
+#include "sim-spawn.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <spawn.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "dynamic-string.h"
+#include "ovs-thread.h"
+#include "shash.h"
+#include "sim-executor.h"
+#include "timeval.h"
+#include "unixctl.h"
+#include "util.h"
+#include "openvswitch/vlog.h"
+
+VLOG_DEFINE_THIS_MODULE(sim_spawn);
+
+extern char **environ;
+
+/* Time spent running one program. */
+struct sim_spawn_stats {
+    unsigned long long int n_runs;
+    unsigned long long int n_failed;
+    long long int total_usec;
+    long long int max_usec;
+};
+
+static struct ovs_mutex spawn_mutex = OVS_MUTEX_INITIALIZER;
+
+/* Maps a program name to its 'struct sim_spawn_stats'. */
+static struct shash spawn_stats OVS_GUARDED_BY(spawn_mutex)
+    = SHASH_INITIALIZER(&spawn_stats);
+
+static void
+sim_spawn_account(const char *const argv[], int status, long long int usec)
+{
+    const char *program = argv[0];
+    struct sim_spawn_stats *stats;
+
+    ovs_mutex_lock(&spawn_mutex);
+    stats = shash_find_data(&spawn_stats, program);
+    if (!stats) {
+        stats = xzalloc(sizeof *stats);
+        shash_add(&spawn_stats, program, stats);
+    }
+    stats->n_runs++;
+    if (status != 0) {
+        stats->n_failed++;
+    }
+    stats->total_usec += usec;
+    stats->max_usec = MAX(stats->max_usec, usec);
+    ovs_mutex_unlock(&spawn_mutex);
+}
+
+/* Appends 'argv', separated by spaces, to 'ds', e.g. for logging. */
+void
+sim_spawn_format_argv(const char *const argv[], struct ds *ds)
+{
+    size_t i;
+
+    for (i = 0; argv[i]; i++) {
+        if (i) {
+            ds_put_char(ds, ' ');
+        }
+        ds_put_cstr(ds, argv[i]);
+    }
+}
+
+/* Writes 'input' to 'fd' and closes it.  The program may exit without
+ * reading all of it, which its exit status then reports. */
+static void
+sim_spawn_write_input(int fd, const char *input)
+{
+    size_t len = strlen(input);
+
+    while (len > 0) {
+        ssize_t n = write(fd, input, len);
+
+        if (n > 0) {
+            input += n;
+            len -= n;
+        } else if (n < 0 && errno != EINTR) {
+            break;
+        }
+    }
+    close(fd);
+}
+
+/* Starts 'argv' with 'in_fd' as standard input and 'out_fd' as standard
+ * output, inside the network namespace 'netns_fd' unless it is negative.
+ * Returns 0 and the child in '*pid', otherwise a positive errno value.
+ *
+ * posix_spawn() cannot enter a namespace, so then the child is started with
+ * vfork() and does it itself, calling only async-signal-safe functions before
+ * exec.  Either way the calling thread stays in its own namespace. */
+static int
+sim_spawn_start(const char *const argv[], int in_fd, int out_fd,
+                int netns_fd, pid_t *pid)
+{
+    posix_spawn_file_actions_t actions;
+    volatile int child_error = 0;
+    int error;
+
+    if (netns_fd < 0) {
+        posix_spawn_file_actions_init(&actions);
+        posix_spawn_file_actions_adddup2(&actions, in_fd, STDIN_FILENO);
+        posix_spawn_file_actions_adddup2(&actions, out_fd, STDOUT_FILENO);
+        error = posix_spawnp(pid, argv[0], &actions, NULL,
+                             CONST_CAST(char **, argv), environ);
+        posix_spawn_file_actions_destroy(&actions);
+        return error;
+    }
+
+    *pid = vfork();
+    if (*pid < 0) {
+        return errno;
+    } else if (!*pid) {
+        /* The child shares the memory of the parent until it execs, so it
+         * reports a failure through 'child_error'. */
+        if (dup2(in_fd, STDIN_FILENO) < 0
+            || dup2(out_fd, STDOUT_FILENO) < 0
+            || setns(netns_fd, CLONE_NEWNET)) {
+            child_error = errno;
+        } else {
+            execvp(argv[0], CONST_CAST(char **, argv));
+            child_error = errno;
+        }
+        _exit(127);
+    }
+
+    if (child_error) {
+        while (waitpid(*pid, NULL, 0) < 0 && errno == EINTR) {
+            continue;
+        }
+        return child_error;
+    }
+    return 0;
+}
+
+static int
+sim_spawn__(const char *const argv[], const char *input, struct ds *output,
+            int netns_fd)
+{
+    int in_fds[2] = { -1, -1 };
+    int fds[2] = { -1, -1 };
+    int null_fd = -1;
+    int status = -1;
+    int error;
+    pid_t pid;
+
+    if ((!input || !output)
+        && (null_fd = open("/dev/null", O_RDWR | O_CLOEXEC)) < 0) {
+        error = errno;
+        goto out;
+    }
+    if (input && pipe2(in_fds, O_CLOEXEC)) {
+        error = errno;
+        goto out;
+    }
+    if (output && pipe2(fds, O_CLOEXEC)) {
+        error = errno;
+        goto out;
+    }
+
+    error = sim_spawn_start(argv, input ? in_fds[0] : null_fd,
+                            output ? fds[1] : null_fd, netns_fd, &pid);
+    if (fds[1] >= 0) {
+        close(fds[1]);
+        fds[1] = -1;
+    }
+    if (in_fds[0] >= 0) {
+        close(in_fds[0]);
+        in_fds[0] = -1;
+    }
+    if (error) {
+        goto out;
+    }
+
+    /* The input is written in full before the output is read, so programs
+     * that are given input must not write much output before reading it. */
+    if (input) {
+        sim_spawn_write_input(in_fds[1], input);
+        in_fds[1] = -1;
+    }
+
+    if (output) {
+        char buf[4096];
+        ssize_t n;
+
+        for (;;) {
+            n = read(fds[0], buf, sizeof buf);
+            if (n > 0) {
+                ds_put_buffer(output, buf, n);
+            } else if (!n || errno != EINTR) {
+                break;
+            }
+        }
+    }
+
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            error = errno;
+            status = -1;
+            break;
+        }
+    }
+
+out:
+    if (null_fd >= 0) {
+        close(null_fd);
+    }
+    if (in_fds[0] >= 0) {
+        close(in_fds[0]);
+    }
+    if (in_fds[1] >= 0) {
+        close(in_fds[1]);
+    }
+    if (fds[0] >= 0) {
+        close(fds[0]);
+    }
+    if (fds[1] >= 0) {
+        close(fds[1]);
+    }
+    if (error) {
+        struct ds cmd = DS_EMPTY_INITIALIZER;
+
+        sim_spawn_format_argv(argv, &cmd);
+        VLOG_ERR("Failed to run '%s' (%s)", ds_cstr(&cmd),
+                 ovs_strerror(error));
+        ds_destroy(&cmd);
+    }
+    return status;
+}
+
+/* Runs the program named by 'argv[0]', found through $PATH, with arguments
+ * 'argv', and waits for it to exit.  'argv' must be null-terminated.
+ *
+ * The program's standard input is /dev/null and its standard error is that of
+ * ops-switchd.  If 'output' is nonnull, its standard output is appended to
+ * 'output', otherwise it is discarded.
+ *
+ * Returns the exit status as reported by waitpid(), which is 0 if and only if
+ * the program exited successfully, or -1 if it could not be run, i.e. the
+ * same as system() would. */
+int
+sim_spawn(const char *const argv[], struct ds *output)
+{
+    return sim_spawn_input(argv, NULL, output);
+}
+
+/* Like sim_spawn(), but if 'input' is nonnull the program reads it from its
+ * standard input instead of /dev/null, e.g. a batch of rules for
+ * "iptables-restore" or "nft -f -". */
+int
+sim_spawn_input(const char *const argv[], const char *input,
+                struct ds *output)
+{
+    long long int start = time_usec();
+    int status;
+
+    status = sim_spawn__(argv, input, output, -1);
+    sim_spawn_account(argv, status, time_usec() - start);
+
+    return status;
+}
+
+/* Like sim_spawn_input(), but runs the program inside the network namespace
+ * that 'netns_fd' refers to.  Only the program enters it, the calling thread
+ * stays where it is. */
+int
+sim_spawn_netns(int netns_fd, const char *const argv[], const char *input,
+                struct ds *output)
+{
+    long long int start = time_usec();
+    int status;
+
+    status = sim_spawn__(argv, input, output, netns_fd);
+    sim_spawn_account(argv, status, time_usec() - start);
+
+    return status;
+}
+
+static void
+sim_spawn_unixctl_stats(struct unixctl_conn *conn, int argc OVS_UNUSED,
+                        const char *argv[] OVS_UNUSED, void *aux OVS_UNUSED)
+{
+    struct ds ds = DS_EMPTY_INITIALIZER;
+    const struct shash_node **nodes;
+    size_t i, n;
+
+    ds_put_format(&ds, "%-20s %10s %8s %12s %12s\n",
+                  "program", "runs", "failed", "avg usec", "max usec");
+
+    ovs_mutex_lock(&spawn_mutex);
+    nodes = shash_sort(&spawn_stats);
+    n = shash_count(&spawn_stats);
+    for (i = 0; i < n; i++) {
+        const struct sim_spawn_stats *stats = nodes[i]->data;
+
+        ds_put_format(&ds, "%-20s %10llu %8llu %12lld %12lld\n",
+                      nodes[i]->name, stats->n_runs, stats->n_failed,
+                      stats->total_usec / (long long int) stats->n_runs,
+                      stats->max_usec);
+    }
+    ovs_mutex_unlock(&spawn_mutex);
+    free(nodes);
+
+    unixctl_command_reply(conn, ds_cstr(&ds));
+    ds_destroy(&ds);
+}
+
+/* A "container/spawn-benchmark" run.  It runs on an executor worker, so that
+ * thousands of commands do not stall the main loop, and replies to 'conn'
+ * from the completion callback. */
+struct spawn_benchmark {
+    struct unixctl_conn *conn;
+    int n;                      /* Number of runs of each command. */
+    struct ds report;
+};
+
+/* Runs a trivial command 'sb->n' times directly, through a shell, and as a
+ * shell pipeline, and reports the average cost of each. */
+static int
+sim_spawn_benchmark_work(void *sb_)
+{
+    static const char *const true_argv[] = { "true", NULL };
+    struct spawn_benchmark *sb = sb_;
+    long long int spawn_usec, system_usec, pipeline_usec, start;
+    int n = sb->n;
+    int i;
+
+    start = time_usec();
+    for (i = 0; i < n; i++) {
+        sim_spawn__(true_argv, NULL, NULL, -1);
+    }
+    spawn_usec = time_usec() - start;
+
+    start = time_usec();
+    for (i = 0; i < n; i++) {
+        if (system("true")) {
+            break;
+        }
+    }
+    system_usec = time_usec() - start;
+
+    start = time_usec();
+    for (i = 0; i < n; i++) {
+        if (system("true | cat > /dev/null")) {
+            break;
+        }
+    }
+    pipeline_usec = time_usec() - start;
+
+    ds_put_format(&sb->report, "%d runs, average cost per command:\n", n);
+    ds_put_format(&sb->report, "  sim_spawn(true)          %8lld usec\n",
+                  spawn_usec / n);
+    ds_put_format(&sb->report, "  system(\"true\")           %8lld usec\n",
+                  system_usec / n);
+    ds_put_format(&sb->report, "  system(\"true | cat\")     %8lld usec\n",
+                  pipeline_usec / n);
+    return 0;
+}
+
+static void
+sim_spawn_benchmark_done(int status OVS_UNUSED, void *sb_)
+{
+    struct spawn_benchmark *sb = sb_;
+
+    unixctl_command_reply(sb->conn, ds_cstr(&sb->report));
+    ds_destroy(&sb->report);
+    free(sb);
+}
+
+static void
+sim_spawn_unixctl_benchmark(struct unixctl_conn *conn, int argc,
+                            const char *argv[], void *aux OVS_UNUSED)
+{
+    struct spawn_benchmark *sb;
+    int n = 100;
+
+    if (argc > 1) {
+        n = atoi(argv[1]);
+        if (n <= 0 || n > 10000) {
+            unixctl_command_reply_error(conn, "count must be 1 to 10000");
+            return;
+        }
+    }
+
+    sb = xmalloc(sizeof *sb);
+    sb->conn = conn;
+    sb->n = n;
+    ds_init(&sb->report);
+    sim_exec_submit("spawn-benchmark", sim_spawn_benchmark_work,
+                    sim_spawn_benchmark_done, sb);
+}
+
+void
+sim_spawn_init(void)
+{
+    static struct ovsthread_once once = OVSTHREAD_ONCE_INITIALIZER;
+
+    if (ovsthread_once_start(&once)) {
+        unixctl_command_register("container/spawn-stats", "", 0, 0,
+                                 sim_spawn_unixctl_stats, NULL);
+        unixctl_command_register("container/spawn-benchmark", "[count]", 0, 1,
+                                 sim_spawn_unixctl_benchmark, NULL);
+        ovsthread_once_done(&once);
+    }
+}
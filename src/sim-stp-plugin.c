@@ -31,6 +31,9 @@
 #include "plugin-extensions.h"
 #include "asic-plugin.h"
 #include "sim-stp.h"
+#include "sim-executor.h"
+#include "sim-spawn.h"
+#include "svec.h"
 #include <netinet/in.h>
 #include <linux/if_bridge.h>
 #include <sys/ioctl.h>
@@ -47,19 +50,65 @@ VLOG_DEFINE_THIS_MODULE(sim_stp_plugin);
 
 #define SYSFS_PATH_MAX        256
 #define INSTANCE_STRING_LEN 10
-#define MAX_CMD_LEN         256
 
 struct hmap all_mstp_instances = HMAP_INITIALIZER(&all_mstp_instances);
 const char *port_state_str[] = {"Disabled", "Listening", "Learning",
                                 "Blocking", "Forwarding", "Invalid"};
-char cmd[MAX_CMD_LEN];
 
-#define RUNCMD(cmd) {\
-          if (system(cmd) != 0) {\
-              VLOG_ERR("Failed to run the command : %s", cmd);\
-              return false;\
-          }\
-        }
+/* Kernel bridge changes are queued on the executor under the bridge's name so
+ * that they are applied in order without blocking the caller.  The result is
+ * only known once the command has run, so it is logged from the completion
+ * callback: 'SUCCESS', a malloc'd message or NULL, if the command succeeds,
+ * an error otherwise.  The other arguments are the command's argv. */
+#define RUNCMD(SUCCESS, ...) \
+    stp_cmd_run(SUCCESS, (const char *[]) { __VA_ARGS__, NULL })
+
+struct stp_cmd {
+    struct svec argv;
+    char *success;              /* Logged if the command succeeds, or NULL. */
+};
+
+static int
+stp_cmd_work(void *cmd_)
+{
+    struct stp_cmd *cmd = cmd_;
+
+    return sim_spawn((const char *const *) cmd->argv.names, NULL);
+}
+
+static void
+stp_cmd_done(int status, void *cmd_)
+{
+    struct stp_cmd *cmd = cmd_;
+
+    if (status) {
+        struct ds s = DS_EMPTY_INITIALIZER;
+
+        sim_spawn_format_argv((const char *const *) cmd->argv.names, &s);
+        VLOG_ERR("Failed to run the command: %s (status %d)",
+                 ds_cstr(&s), status);
+        ds_destroy(&s);
+    } else if (cmd->success) {
+        VLOG_INFO("%s", cmd->success);
+    }
+    svec_destroy(&cmd->argv);
+    free(cmd->success);
+    free(cmd);
+}
+
+static void
+stp_cmd_run(char *success, const char *const argv[])
+{
+    struct stp_cmd *cmd = xmalloc(sizeof *cmd);
+
+    svec_init(&cmd->argv);
+    for (; *argv; argv++) {
+        svec_add(&cmd->argv, *argv);
+    }
+    svec_terminate(&cmd->argv);
+    cmd->success = success;
+    sim_exec_submit(CIST_BR_NAME, stp_cmd_work, stp_cmd_done, cmd);
+}
 
 /** @fn int init(int phase_id)
     @brief Initialization of the plugin, needs to be run.
@@ -252,22 +301,22 @@ mstp_inform_stp_global_port_state(const struct stp_blk_params *br,
 | Description: add/delete a port to/from cist bridge
 | Parameters[in]:
 | Parameters[out]:
-| Return: true - if operation is successful
-|         false - otherwise
+| Return: true - the change has been queued; whether it succeeded is
+|         logged once it has run
 -----------------------------------------------------------------------------*/
 bool mstp_cist_add_del_port(char *port, bool add)
 {
-    int ret = -1;
     char *master = (add) ? "master" : "nomaster";
-
-    /* command syntax "ip link set <port> [no]master <brname>  */
-    sprintf(cmd, "ip link set %s %s %s", port, master, CIST_BR_NAME);
-    RUNCMD(cmd);
+    char *success;
 
     if (add)
-        VLOG_INFO("Added port %s to bridge %s", port, CIST_BR_NAME);
+        success = xasprintf("Added port %s to bridge %s", port, CIST_BR_NAME);
     else
-        VLOG_INFO("Delete port %s from bridge %s", port, CIST_BR_NAME);
+        success = xasprintf("Deleted port %s from bridge %s", port,
+                            CIST_BR_NAME);
+
+    /* command syntax "ip link set <port> [no]master <brname>  */
+    RUNCMD(success, "ip", "link", "set", port, master, CIST_BR_NAME);
 
     return true;
 }
@@ -277,17 +326,16 @@ bool mstp_cist_add_del_port(char *port, bool add)
 | Description: change state of a port
 | Parameters[in]:
 | Parameters[out]:
-| Return: true - if operation is successful
-|         false - otherwise
+| Return: true - the change has been queued; whether it succeeded is
+|         logged once it has run
 -----------------------------------------------------------------------------*/
 bool mstp_cist_set_port(char *port, int state)
 {
-    int ret = -1;
-
-    sprintf(cmd, "bridge link set dev %s state %d", port, state);
-    RUNCMD(cmd);
+    char state_str[INSTANCE_STRING_LEN];
 
-    VLOG_INFO("%s: state changed to %d", port, state);
+    snprintf(state_str, sizeof state_str, "%d", state);
+    RUNCMD(xasprintf("%s: state changed to %d", port, state),
+           "bridge", "link", "set", "dev", port, "state", state_str);
 
     return true;
 }
@@ -586,29 +634,25 @@ mstp_cist_configure_ports(const struct stp_blk_params *br,
 | Description: create/delete kernel bridge for cist
 | Parameters[in]: bool - true/false to indicate add/delete
 | Parameters[out]: None
-| Return: true - if operation is successful
-|         false - otherwise
+| Return: true - the change has been queued; whether it succeeded is
+|         logged once it has run
 -----------------------------------------------------------------------------*/
 bool mstp_cist_add_del_bridge(bool add)
 {
-    int ret = -1;
     char *op = (add) ? "add" : "del";
 
     /* command syntax "ip link {add | del} <brname> type bridge  */
-    sprintf(cmd, "ip link %s %s type %s", op, CIST_BR_NAME, BR_LINK_TYPE);
-
-    RUNCMD(cmd);
+    RUNCMD(add ? NULL : xasprintf("Deleted the bridge %s", CIST_BR_NAME),
+           "ip", "link", op, CIST_BR_NAME, "type", BR_LINK_TYPE);
 
     /* Set the bridge state to UP and enable STP on it */
     if (add)
     {
         /* Set the bridge status up */
-        sprintf(cmd, "ip link set dev %s up", CIST_BR_NAME);
-        RUNCMD(cmd);
+        RUNCMD(xasprintf("Successfully created the bridge %s", CIST_BR_NAME),
+               "ip", "link", "set", "dev", CIST_BR_NAME, "up");
     }
 
-    VLOG_INFO("Successfully create the bridge :: %s", CIST_BR_NAME);
-
     return true;
 }
 
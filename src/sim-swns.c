@@ -0,0 +1,360 @@
+/*
+ * (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <config.h>
+
+#include "sim-swns.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+#include "list.h"
+#include "ovs-thread.h"
+#include "sim-spawn.h"
+#include "util.h"
+#include "openvswitch/vlog.h"
+
+VLOG_DEFINE_THIS_MODULE(sim_swns);
+
+/* A call waiting for the swns thread. */
+struct sim_swns_request {
+    struct ovs_list list_node;      /* In 'swns_requests'. */
+    sim_swns_func *func;
+    void *aux;
+    int retval;
+    bool done;
+};
+
+static struct ovs_mutex swns_mutex = OVS_MUTEX_INITIALIZER;
+static pthread_cond_t swns_request_cond;    /* Signaled on a new request. */
+static pthread_cond_t swns_done_cond;       /* Signaled when one is done. */
+static struct ovs_list swns_requests OVS_GUARDED_BY(swns_mutex)
+    = OVS_LIST_INITIALIZER(&swns_requests);
+
+static pthread_t swns_thread;
+static bool swns_started;
+
+/* The switch namespace, opened once it exists, and its inode, which changes
+ * if the namespace is deleted and created again. */
+static int swns_netns_fd OVS_GUARDED_BY(swns_mutex) = -1;
+static ino_t swns_netns_ino OVS_GUARDED_BY(swns_mutex);
+
+/* Owned by the swns thread. */
+static bool swns_entered;
+static ino_t swns_entered_ino;  /* Inode of the namespace it entered. */
+static int swns_ioctl_sock = -1;
+static int swns_rtnl_sock = -1;
+static unsigned int swns_rtnl_seq;
+
+static bool
+sim_swns_is_current_thread(void)
+{
+    return swns_started && pthread_equal(pthread_self(), swns_thread);
+}
+
+static void
+sim_swns_close_sockets(void)
+{
+    if (swns_ioctl_sock >= 0) {
+        close(swns_ioctl_sock);
+        swns_ioctl_sock = -1;
+    }
+    if (swns_rtnl_sock >= 0) {
+        close(swns_rtnl_sock);
+        swns_rtnl_sock = -1;
+    }
+}
+
+static void
+sim_swns_open_sockets(void)
+{
+    struct sockaddr_nl local;
+
+    sim_swns_close_sockets();
+    swns_ioctl_sock = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (swns_ioctl_sock < 0) {
+        VLOG_ERR("swns ioctl socket creation failed (%s)",
+                 ovs_strerror(errno));
+    }
+
+    swns_rtnl_sock = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC,
+                            NETLINK_ROUTE);
+    if (swns_rtnl_sock < 0) {
+        VLOG_ERR("swns netlink socket creation failed (%s)",
+                 ovs_strerror(errno));
+        return;
+    }
+
+    /* Let the kernel pick the port id, so that the socket does not clash
+     * with other netlink sockets of this process. */
+    memset(&local, 0, sizeof local);
+    local.nl_family = AF_NETLINK;
+    if (bind(swns_rtnl_sock, (struct sockaddr *) &local, sizeof local) < 0) {
+        VLOG_ERR("swns netlink socket bind failed (%s)", ovs_strerror(errno));
+        close(swns_rtnl_sock);
+        swns_rtnl_sock = -1;
+    }
+}
+
+/* Returns a new file descriptor for the switch namespace, which the caller
+ * must close, or -1 if it cannot be opened, e.g. because it does not exist
+ * yet.  A later call tries again.  If the namespace was created again since
+ * it was opened, as seen from the inode of SWNS_NETNS_PATH, the new one is
+ * opened.  If 'inop' is nonnull, stores the namespace's inode in '*inop'.
+ *
+ * The cached descriptor is duplicated, so that reopening it cannot close a
+ * descriptor that another thread is about to hand to setns(). */
+static int
+sim_swns_netns_fd(ino_t *inop)
+{
+    static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(1, 5);
+    struct stat st;
+    int fd = -1;
+
+    ovs_mutex_lock(&swns_mutex);
+    if (stat(SWNS_NETNS_PATH, &st)) {
+        VLOG_WARN_RL(&rl, "%s: stat failed (%s)", SWNS_NETNS_PATH,
+                     ovs_strerror(errno));
+        goto out;
+    }
+
+    if (swns_netns_fd >= 0 && st.st_ino != swns_netns_ino) {
+        VLOG_INFO("%s: namespace was recreated, reopening it",
+                  SWNS_NETNS_PATH);
+        close(swns_netns_fd);
+        swns_netns_fd = -1;
+    }
+    if (swns_netns_fd < 0) {
+        swns_netns_fd = open(SWNS_NETNS_PATH, O_RDONLY | O_CLOEXEC);
+        if (swns_netns_fd < 0) {
+            VLOG_WARN_RL(&rl, "%s: open failed (%s)", SWNS_NETNS_PATH,
+                         ovs_strerror(errno));
+            goto out;
+        }
+        if (fstat(swns_netns_fd, &st)) {
+            VLOG_WARN_RL(&rl, "%s: fstat failed (%s)", SWNS_NETNS_PATH,
+                         ovs_strerror(errno));
+            close(swns_netns_fd);
+            swns_netns_fd = -1;
+            goto out;
+        }
+        swns_netns_ino = st.st_ino;
+    }
+
+    fd = fcntl(swns_netns_fd, F_DUPFD_CLOEXEC, 0);
+    if (fd < 0) {
+        VLOG_WARN_RL(&rl, "%s: dup failed (%s)", SWNS_NETNS_PATH,
+                     ovs_strerror(errno));
+    } else if (inop) {
+        *inop = swns_netns_ino;
+    }
+
+out:
+    ovs_mutex_unlock(&swns_mutex);
+    return fd;
+}
+
+/* Moves the swns thread into the switch namespace and opens its sockets
+ * there, unless that has been done already.  Returns true if the thread is
+ * in the namespace.  On failure it stays out of it, so that nothing meant for
+ * the switch reaches the namespace of ops-switchd, and a later call tries
+ * again.  If the namespace is deleted and created again, the thread moves
+ * into the new one and reopens its sockets. */
+static bool
+sim_swns_enter(void)
+{
+    static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(1, 5);
+    struct stat st;
+    ino_t ino;
+    int fd;
+
+    if (swns_entered && !stat(SWNS_NETNS_PATH, &st)
+        && st.st_ino == swns_entered_ino) {
+        return true;
+    }
+
+    fd = sim_swns_netns_fd(&ino);
+    if (fd < 0) {
+        return false;
+    }
+    if (setns(fd, CLONE_NEWNET)) {
+        VLOG_WARN_RL(&rl, "%s: setns failed (%s)", SWNS_NETNS_PATH,
+                     ovs_strerror(errno));
+        close(fd);
+        return false;
+    }
+    close(fd);
+
+    if (swns_entered) {
+        VLOG_INFO("%s: entered the recreated namespace", SWNS_NETNS_PATH);
+    }
+    swns_entered = true;
+    swns_entered_ino = ino;
+    sim_swns_open_sockets();
+    return true;
+}
+
+static void *
+sim_swns_main(void *arg OVS_UNUSED)
+{
+    sim_swns_enter();
+
+    for (;;) {
+        struct sim_swns_request *request;
+
+        ovs_mutex_lock(&swns_mutex);
+        while (list_is_empty(&swns_requests)) {
+            ovs_mutex_cond_wait(&swns_request_cond, &swns_mutex);
+        }
+        request = CONTAINER_OF(list_pop_front(&swns_requests),
+                               struct sim_swns_request, list_node);
+        ovs_mutex_unlock(&swns_mutex);
+
+        request->retval = sim_swns_enter() ? request->func(request->aux) : -1;
+
+        ovs_mutex_lock(&swns_mutex);
+        request->done = true;
+        xpthread_cond_broadcast(&swns_done_cond);
+        ovs_mutex_unlock(&swns_mutex);
+    }
+
+    return NULL;
+}
+
+/* Starts the swns thread.  It is safe to call this more than once. */
+void
+sim_swns_init(void)
+{
+    static struct ovsthread_once once = OVSTHREAD_ONCE_INITIALIZER;
+
+    if (ovsthread_once_start(&once)) {
+        xpthread_cond_init(&swns_request_cond, NULL);
+        xpthread_cond_init(&swns_done_cond, NULL);
+        swns_thread = ovs_thread_create("sim_swns", sim_swns_main, NULL);
+        swns_started = true;
+        ovsthread_once_done(&once);
+    }
+}
+
+/* Runs 'func' with 'aux' on the swns thread, waits for it and returns what
+ * it returned.  If the thread cannot enter the switch namespace, 'func' is
+ * not run and the return value is -1. */
+int
+sim_swns_call(sim_swns_func *func, void *aux)
+{
+    struct sim_swns_request request;
+
+    sim_swns_init();
+    if (sim_swns_is_current_thread()) {
+        return func(aux);
+    }
+
+    request.func = func;
+    request.aux = aux;
+    request.retval = 0;
+    request.done = false;
+
+    ovs_mutex_lock(&swns_mutex);
+    list_push_back(&swns_requests, &request.list_node);
+    xpthread_cond_signal(&swns_request_cond);
+    while (!request.done) {
+        ovs_mutex_cond_wait(&swns_done_cond, &swns_mutex);
+    }
+    ovs_mutex_unlock(&swns_mutex);
+
+    return request.retval;
+}
+
+/* Like sim_spawn(), but runs the program inside the switch namespace. */
+int
+sim_swns_spawn(const char *const argv[], struct ds *output)
+{
+    return sim_swns_spawn_input(argv, NULL, output);
+}
+
+/* Like sim_spawn_input(), but runs the program inside the switch
+ * namespace.  The program is started and waited for by the calling thread,
+ * not by the swns thread, so slow programs do not hold up other operations
+ * on the switch.  Returns -1 without running it if the namespace cannot be
+ * opened. */
+int
+sim_swns_spawn_input(const char *const argv[], const char *input,
+                     struct ds *output)
+{
+    int fd = sim_swns_netns_fd(NULL);
+    int status;
+
+    if (fd < 0) {
+        return -1;
+    }
+    status = sim_spawn_netns(fd, argv, input, output);
+    close(fd);
+
+    return status;
+}
+
+struct sim_swns_ioctl_args {
+    unsigned long int cmd;
+    void *arg;
+};
+
+static int
+sim_swns_ioctl__(void *args_)
+{
+    struct sim_swns_ioctl_args *args = args_;
+
+    if (swns_ioctl_sock < 0) {
+        return EBADF;
+    }
+    return ioctl(swns_ioctl_sock, args->cmd, args->arg) < 0 ? errno : 0;
+}
+
+/* Issues the interface ioctl 'cmd' with 'arg', e.g. a 'struct ifreq', on a
+ * socket in the switch namespace.  Returns 0 on success, otherwise a
+ * positive errno value. */
+int
+sim_swns_ioctl(unsigned long int cmd, void *arg)
+{
+    struct sim_swns_ioctl_args args = { cmd, arg };
+
+    return sim_swns_call(sim_swns_ioctl__, &args);
+}
+
+/* Returns the rtnetlink socket of the switch namespace, or -1 if it could not
+ * be opened. */
+int
+sim_swns_rtnl_sock(void)
+{
+    ovs_assert(sim_swns_is_current_thread());
+    return swns_rtnl_sock;
+}
+
+/* Returns a sequence number for a request on sim_swns_rtnl_sock(), so that
+ * stale replies to an earlier, abandoned request can be told apart. */
+unsigned int
+sim_swns_rtnl_next_seq(void)
+{
+    ovs_assert(sim_swns_is_current_thread());
+    return ++swns_rtnl_seq;
+}